@@ -0,0 +1,295 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Firmware benchmark: configuration switch latency
+ *
+ * Times vfgs_init_sei() / vfgs_init_afgs1() and their parts (iDCT, pattern
+ * making, LUT building) on every configuration file given on the command line
+ * (or found in cfg/), plus synthetic worst cases, and reports min / median /
+ * p99 / max latency. The firmware is included as source, to reach its internals.
+ */
+
+#include "vfgs_fw.c"
+#include "vfgs_cfg.h"
+#include "yuv.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <time.h>
+#include <dirent.h>
+#endif
+
+#ifndef VFGS_CFG_DIR
+#define VFGS_CFG_DIR "cfg"
+#endif
+
+static int iters = 100;
+static double* t = NULL; // per-iteration latencies (us)
+
+static double now_us()
+{
+#ifdef _MSC_VER
+	LARGE_INTEGER c, f;
+	QueryPerformanceCounter(&c);
+	QueryPerformanceFrequency(&f);
+	return (double)c.QuadPart * 1e6 / f.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+#endif
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static void report(const char* name)
+{
+	qsort(t, iters, sizeof(double), cmp_double);
+	printf("%-52s %10.1f %10.1f %10.1f %10.1f\n", name, t[0], t[iters/2], t[(iters*99)/100], t[iters-1]);
+}
+
+#define TIME(name, code) \
+	{ \
+		for (int it=0; it<iters; it++) \
+		{ \
+			double t0 = now_us(); \
+			code; \
+			t[it] = now_us() - t0; \
+		} \
+		report(name); \
+	}
+
+/** Time firmware parts, on worst-case inputs */
+static void bench_parts()
+{
+	int8 B[64][64], B0[64][64];
+	int8 C[32][32];
+	int8 P[64*64];
+	int8 Lbuf[73*82];
+	int8 Cbuf[38*44];
+	int16 coef[25];
+	uint8 lut[256], in[14], out[14];
+	uint32 rnd = Seed_LUT[0];
+
+	for (int i=0; i<64*64; i++, rnd = prng(rnd))
+		B0[i/64][i%64] = Gaussian_LUT[rnd & 2047];
+	for (int i=0; i<25; i++)
+		coef[i] = (i & 1) ? 12 : -6;
+	for (int k=0; k<14; k++)
+	{
+		in[k] = k * 255 / 13;
+		out[k] = (k * 37) & 255;
+	}
+
+	TIME("idct2_64",                          memcpy(B, B0, sizeof(B)); idct2_64(B));
+	TIME("idct2_32",                          memcpy(C, B0, sizeof(C)); idct2_32(C));
+	TIME("vfgs_make_sei_ff_pattern64 (14/14)", vfgs_make_sei_ff_pattern64(B, 14, 14));
+	TIME("vfgs_make_sei_ff_pattern32 (14/14)", vfgs_make_sei_ff_pattern32(C, 14, 14));
+	TIME("vfgs_make_ar_pattern (SEI.AR luma)", vfgs_make_ar_pattern(NULL, Lbuf, P, 64, coef, 6, 1, 5, Seed_LUT[0]));
+	TIME("vfgs_make_ar_pattern (lag 3 luma)",  vfgs_make_ar_pattern(NULL, Lbuf, P, 64, coef, 24, 1, 7, Seed_LUT[0]));
+	TIME("vfgs_make_ar_pattern (lag 3 chroma)", vfgs_make_ar_pattern(Lbuf, Cbuf, P, 32, coef, 25, 1, 7, Seed_LUT[1]));
+	TIME("vfgs_make_lut_piecewise_linear (14)", vfgs_make_lut_piecewise_linear(lut, in, out, 14));
+}
+
+/** Time full initialization, and LUT building only (lazy mode: no pattern made) */
+static void bench_init(const char* name, fgs_params* par)
+{
+	char s[256];
+
+	if (par->afgs1.num_y_points)
+		TIME(name, vfgs_init_afgs1(&par->afgs1))
+	else
+	{
+		TIME(name, vfgs_init_sei(&par->sei));
+		vfgs_set_lazy_patterns(1);
+		snprintf(s, sizeof(s), "%s (LUTs)", name);
+		TIME(s, vfgs_init_sei(&par->sei));
+		vfgs_set_lazy_patterns(0);
+	}
+}
+
+static int bench_file(const char* filename)
+{
+	fgs_params par;
+	const char* name = strrchr(filename, '/');
+
+	memset(&par, 0, sizeof(par));
+	if (vfgs_read_cfg(&par, filename) || vfgs_check_cfg(&par, 10, YUV_420))
+		return 1;
+	vfgs_adjust_chroma_cfg(&par, YUV_420);
+	bench_init(name ? name+1 : filename, &par);
+	vfgs_free_cfg(&par);
+	return 0;
+}
+
+/** Synthetic worst cases: max number of distinct patterns, max intervals, max AR lag */
+static void bench_synthetic()
+{
+	static fgs_params par;
+
+	// FGC SEI frequency filtering: 8 luma + 8 chroma patterns, 256 intervals
+	memset(&par, 0, sizeof(par));
+	par.sei.model_id = 0;
+	par.sei.log2_scale_factor = 5;
+	for (int c=0; c<3; c++)
+	{
+		par.sei.comp_model_present_flag[c] = 1;
+		par.sei.num_intensity_intervals[c] = 256;
+		par.sei.num_model_values[c] = 3;
+		for (int k=0; k<256; k++)
+		{
+			int p = k * VFGS_MAX_PATTERNS / 256;
+			par.sei.intensity_interval_lower_bound[c][k] = k;
+			par.sei.intensity_interval_upper_bound[c][k] = k;
+			par.sei.comp_model_value[c][k][0] = 100;
+			par.sei.comp_model_value[c][k][1] = 2 + p;  // all (h,v) pairs distinct
+			par.sei.comp_model_value[c][k][2] = 14 - p;
+		}
+	}
+	bench_init("synthetic: SEI FF, 8 patterns, 256 intervals", &par);
+
+	// FGC SEI auto-regressive: 8 luma patterns, 256 intervals
+	memset(&par, 0, sizeof(par));
+	par.sei.model_id = 1;
+	par.sei.log2_scale_factor = 5;
+	par.sei.comp_model_present_flag[0] = 1;
+	par.sei.num_intensity_intervals[0] = 256;
+	par.sei.num_model_values[0] = 6;
+	for (int k=0; k<256; k++)
+	{
+		int16* v = par.sei.comp_model_value[0][k];
+		par.sei.intensity_interval_lower_bound[0][k] = k;
+		par.sei.intensity_interval_upper_bound[0][k] = k;
+		v[0] = 100;
+		v[1] = 4 + 2 * (k * VFGS_MAX_PATTERNS / 256);
+		v[3] = 2;
+		v[4] = 1 << par.sei.log2_scale_factor;
+		v[5] = -4;
+	}
+	bench_init("synthetic: SEI AR, 8 patterns, 256 intervals", &par);
+
+	// AFGS1: lag 3, chroma with luma injection, max number of points
+	memset(&par, 0, sizeof(par));
+	par.afgs1.grain_seed = 1234;
+	par.afgs1.num_y_points = 14;
+	par.afgs1.num_cb_points = 10;
+	par.afgs1.num_cr_points = 10;
+	for (int k=0; k<14; k++)
+	{
+		par.afgs1.point_y_values[k] = k * 255 / 13;
+		par.afgs1.point_y_scaling[k] = 20 + 4*k;
+	}
+	for (int k=0; k<10; k++)
+	{
+		par.afgs1.point_cb_values[k] = par.afgs1.point_cr_values[k] = k * 255 / 9;
+		par.afgs1.point_cb_scaling[k] = par.afgs1.point_cr_scaling[k] = 10 + 3*k;
+	}
+	par.afgs1.grain_scaling = 11;
+	par.afgs1.ar_coeff_lag = 3;
+	par.afgs1.ar_coeff_shift = 7;
+	for (int i=0; i<24; i++)
+		par.afgs1.ar_coeffs_y[i] = (i & 1) ? 10 : -4;
+	for (int i=0; i<25; i++)
+		par.afgs1.ar_coeffs_cb[i] = par.afgs1.ar_coeffs_cr[i] = (i & 1) ? -5 : 8;
+	bench_init("synthetic: AFGS1, lag 3", &par);
+}
+
+int main(int argc, const char **argv)
+{
+	int i, nfiles = 0;
+
+	for (i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i+1 < argc)
+			iters = atoi(argv[++i]);
+		else if (argv[i][0] == '-')
+		{
+			printf("Usage: %s [-n <iterations>] [<cfg files>] (default: all files in %s)\n", argv[0], VFGS_CFG_DIR);
+			return 1;
+		}
+		else
+			nfiles ++;
+	}
+	if (iters < 1)
+		iters = 1;
+	t = malloc(iters * sizeof(double));
+
+	vfgs_set_depth(10);
+	vfgs_set_chroma_subsampling(2, 2);
+
+	printf("%d iterations, latency in us\n", iters);
+	printf("%-52s %10s %10s %10s %10s\n", "", "min", "median", "p99", "max");
+	bench_parts();
+	bench_synthetic();
+
+	for (i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-n"))
+			i ++;
+		else
+			bench_file(argv[i]);
+	}
+#ifndef _MSC_VER
+	if (!nfiles)
+	{
+		struct dirent** e;
+		char path[1024];
+		int n = scandir(VFGS_CFG_DIR, &e, NULL, alphasort);
+
+		for (i=0; i<n; i++)
+		{
+			if (e[i]->d_name[0] != '.')
+			{
+				snprintf(path, sizeof(path), "%s/%s", VFGS_CFG_DIR, e[i]->d_name);
+				bench_file(path);
+			}
+			free(e[i]);
+		}
+		if (n >= 0)
+			free(e);
+	}
+#endif
+
+	free(t);
+	return 0;
+}
@@ -0,0 +1,84 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Shared-memory ring peer: producer / consumer stand-in for vfgs --shm
+ *
+ * "put" feeds the frames of a raw YUV file into the ring (as a decoder
+ * would), "get" writes the frames out of the ring to a file (as an encoder
+ * would). Frame geometry is taken from the ring, which vfgs creates.
+ */
+
+#include "vfgs_shm.h"
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(cond, ...) { if (!(cond)) { fprintf(stderr, "Error: "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); return 1; } }
+
+int main(int argc, const char **argv)
+{
+	int put = argc == 4 && !strcmp(argv[1], "put");
+	int get = argc == 4 && !strcmp(argv[1], "get");
+	int err = 0, n = 0;
+	vfgs_shm* shm;
+	yuv geom, frame;
+	FILE* f;
+
+	if (!put && !get)
+	{
+		printf("Usage: %s put <name> <input.yuv>   Feed frames of input file into ring\n", argv[0]);
+		printf("       %s get <name> <output.yuv>  Write frames out of ring to output file\n", argv[0]);
+		return 1;
+	}
+
+	f = !strcmp(argv[3], "-") ? (put ? stdin : stdout) : fopen(argv[3], put ? "rb" : "wb");
+	CHECK(f, "can not open file %s", argv[3]);
+	shm = vfgs_shm_attach(argv[2], put ? VFGS_SHM_PRODUCER : VFGS_SHM_CONSUMER, 10000, &geom);
+	CHECK(shm, "can not attach to shared-memory frame ring %s", argv[2]);
+
+	while (!err && !vfgs_shm_acquire(shm, &frame))
+	{
+		if (put && yuv_read(&frame, f) != yuv_size(&frame))
+			break; // (slot not released)
+		if (get)
+			err = yuv_write(&frame, f);
+		vfgs_shm_release(shm);
+		n ++;
+	}
+	vfgs_shm_close(shm);
+	fprintf(stderr, "%d frames %s\n", n, put ? "sent" : "received");
+	CHECK(!err && !(get && fclose(f)), "can not write file %s", argv[3]);
+	return 0;
+}
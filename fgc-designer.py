@@ -46,6 +46,11 @@ import math
 from math import log2
 import os
 import re
+import io
+try:
+	import vfgs # libvfgs binding (in-process regrain)
+except ImportError:
+	vfgs = None
 
 matplotlib.use('TkAgg')
 from matplotlib.figure import Figure
@@ -183,6 +188,11 @@ class FgcSei:
 
 	def save(self, filename, mask=False):
 		with open(filename, 'w') as f:
+			f.write(self.text(mask))
+
+	def text(self, mask=False):
+		# configuration file contents
+		with io.StringIO() as f:
 			f.write('SEIFGCEnabled                          : 1\n')
 			f.write('SEIFGCCancelFlag                       : 0\n')
 			f.write('SEIFGCPersistenceFlag                  : 1\n')
@@ -211,6 +221,7 @@ class FgcSei:
 						if mask and not self.enable[c][k]:
 							x[k][0] = 0
 					f.write(f'SEIFGCCompModelValuesComp{c}             : {array2str2(x)}\n')
+			return f.getvalue()
 
 	def split(self,c,k,i):
 		if (self.comp_model_present_flag[c] and k < self.num_intensity_intervals[c]):
@@ -570,6 +581,9 @@ class App(tk.Tk):
 		self.picked_k = []
 		self.seed = 0xdeadbeef
 		self.yuvname = []
+		self.fg = None # libvfgs context, or preview server session
+		self.clean = None # clean frame, and grained copy
+		self.clean_key = None
 		self.__frame = tk.IntVar(value=0)
 		self.frame = 0
 
@@ -876,14 +890,66 @@ class App(tk.Tk):
 
 	def regrain(self):
 		if (self.yuvname):
-			cfg.save('__preview.cfg',mask=True);
 			outdepth = 8 if self.yuvinfo[4] else self.yuvinfo[2]
-			outname = f"__preview_{self.yuvinfo[0]}x{self.yuvinfo[1]}_{self.yuvinfo[3]}_{outdepth}b.yuv"
-			os.system(f'vfgs -w {self.yuvinfo[0]} -h {self.yuvinfo[1]} -b {self.yuvinfo[2]} --outdepth {outdepth} -f {self.yuvinfo[3]} -n 1 -s {self.frame} -r {self.seed} -g {cfg.gain} -c __preview.cfg {self.yuvname} {outname}')
-			yuv = read_yuv(outname, 0, *self.yuvinfo[0:2], outdepth, self.yuvinfo[3])
+			yuv = self.regrain_lib(outdepth)
+			if yuv is None:
+				yuv = self.regrain_exe(outdepth)
 			#self.yuvview.mode = 3 if self.color_view.get() else self.color_component.get()
 			#self.yuvview.regrain(yuv)
 
+	# Regrain in-process with libvfgs (same output as vfgs), or with a preview
+	# server (vfgs --serve) when VFGS_SERVE is set to its socket
+	def regrain_lib(self, outdepth):
+		width, height, depth, format = self.yuvinfo[0:4]
+		try:
+			if os.environ.get('VFGS_SERVE'):
+				grain = self.regrain_server(width, height, depth, format)
+			else:
+				grain = self.regrain_local(width, height, depth, format)
+		except (AttributeError, OSError):
+			return None # no library or server
+		if grain is not None and outdepth < depth:
+			return tuple(np.minimum((a + 2) >> 2, 255).astype(np.uint8) for a in grain)
+		return grain
+
+	# The clean frame is read once, then grain is written straight into a
+	# preallocated copy
+	def regrain_local(self, width, height, depth, format):
+		if format not in (420, 422, 444):
+			return None
+		if not self.fg or (self.fg.depth, self.fg.format) != (depth, format):
+			self.fg = vfgs.Vfgs(depth, format)
+		key = (self.yuvname, self.frame, width, height, depth, format)
+		if self.clean_key != key:
+			clean = read_yuv(self.yuvname, self.frame, width, height, depth, format)
+			self.clean = (clean, tuple(np.empty_like(a) for a in clean))
+			self.clean_key = key
+		clean, grain = self.clean
+		self.fg.configure(cfg.text(mask=True), seed=self.seed, gain=cfg.gain)
+		self.fg.grain(*grain, src=clean)
+		return grain
+
+	# The server keeps source frames and patterns (shared by several designers);
+	# the grained frame is read from shared memory
+	def regrain_server(self, width, height, depth, format):
+		if format not in (420, 422, 444):
+			return None
+		source = (self.yuvname, width, height, depth, format)
+		if self.clean_key != source:
+			if self.fg:
+				self.fg.close()
+			self.fg = vfgs.VfgsClient(os.environ['VFGS_SERVE'], os.path.abspath(self.yuvname), width, height, depth, format)
+			self.clean_key = source
+		self.fg.configure(cfg.text(mask=True), seed=self.seed, gain=cfg.gain)
+		return self.fg.grain(self.frame)
+
+	# Regrain through the vfgs executable and files
+	def regrain_exe(self, outdepth):
+		cfg.save('__preview.cfg',mask=True);
+		outname = f"__preview_{self.yuvinfo[0]}x{self.yuvinfo[1]}_{self.yuvinfo[3]}_{outdepth}b.yuv"
+		os.system(f'vfgs -w {self.yuvinfo[0]} -h {self.yuvinfo[1]} -b {self.yuvinfo[2]} --outdepth {outdepth} -f {self.yuvinfo[3]} -n 1 -s {self.frame} -r {self.seed} -g {cfg.gain} -c __preview.cfg {self.yuvname} {outname}')
+		return read_yuv(outname, 0, *self.yuvinfo[0:2], outdepth, self.yuvinfo[3])
+
 	# Update plot from cfg
 	def update_plot(self, c):
 		# clear plot + saved lines
@@ -0,0 +1,421 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "vfgs.h"
+#include "vfgs_cfg.h"
+#include "vfgs_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) { if (!(cond)) { fprintf(stderr, "Error: "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); return 1; } }
+
+#define ALIGN16(x) (((x) + 15) & ~15)
+#define min(a,b) ((a)<(b)?(a):(b))
+
+struct vfgs_ctx_s {
+	int depth;
+	int format;
+	int layout;
+	unsigned gain;    // percent
+	unsigned seed;    // 0: from configuration
+	int state;        // programmed from a state file (no configuration)
+	fgs_params par;   // configuration
+	vfgs_hw_cfg hw;   // programmed configuration memory
+	fgs_sei prog;     // FGC SEI the hardware was programmed from (gain applied)
+	int prog_sei;     // (valid)
+	uint32 prng[2];   // random generator state
+	uint8* line;      // row buffers (rows not padded to 16 samples)
+	int line_size;
+};
+
+// Parameters not given by a configuration file: no grain
+static const fgs_sei sei_none = { .log2_scale_factor = 5 };
+
+// Point the (single) hardware instance at a context
+static void ctx_bind(vfgs_ctx* ctx)
+{
+	vfgs_set_cfg(&ctx->hw);
+	vfgs_set_prng(ctx->prng);
+	vfgs_set_sample_layout(ctx->layout == VFGS_SEMI ? 2 : 1, (ctx->layout == VFGS_SEMI && ctx->depth > 8) ? 6 : 0);
+}
+
+// Keep hardware state in the context (the configuration memory was copied
+// internally if modified)
+static void ctx_save(vfgs_ctx* ctx)
+{
+	const vfgs_hw_cfg* hw = vfgs_get_cfg();
+
+	if (hw != &ctx->hw)
+		memcpy(&ctx->hw, hw, sizeof(ctx->hw));
+	vfgs_get_prng(ctx->prng);
+	vfgs_set_cfg(&ctx->hw);
+}
+
+// Program the hardware from the configuration (first entry of a grain table
+// or SEI dump), restarting the random generator if reseed
+static void ctx_program(vfgs_ctx* ctx, int reseed)
+{
+	fgs_params p = ctx->par;
+
+	p.tbl = NULL;
+	p.ntbl = 0;
+	p.seis = NULL;
+	p.nsei = 0;
+	vfgs_apply_gain(&p, ctx->gain);
+
+	ctx_bind(ctx);
+	vfgs_set_lazy_patterns(0);
+	if (ctx->prog_sei && !p.afgs1.num_y_points)
+		vfgs_update_sei(&ctx->prog, &p.sei); // only make patterns that changed
+	else
+		vfgs_init_params(&p);
+	ctx->prog = p.sei;
+	ctx->prog_sei = !p.afgs1.num_y_points;
+	if (!reseed)
+		vfgs_set_prng(ctx->prng);
+	else if (ctx->seed)
+		vfgs_set_seed(ctx->seed);
+	ctx_save(ctx);
+}
+
+// Take a configuration over (freed on error)
+static int ctx_set_params(vfgs_ctx* ctx, fgs_params* par)
+{
+	if (vfgs_check_cfg(par, ctx->depth, ctx->format))
+	{
+		vfgs_free_cfg(par);
+		return 1;
+	}
+	vfgs_adjust_chroma_cfg(par, ctx->format);
+	vfgs_free_cfg(&ctx->par);
+	ctx->par = *par;
+	ctx->state = 0;
+	ctx_program(ctx, 1);
+	return 0;
+}
+
+static void init_params(fgs_params* par)
+{
+	memset(par, 0, sizeof(*par));
+	par->sei = sei_none;
+}
+
+/** Create a context for frames of given bit depth (8 or 10), chroma format
+ * and layout, with no grain until configured */
+vfgs_ctx* vfgs_create(int depth, int format, int layout)
+{
+	vfgs_ctx* ctx;
+
+	if (!(depth == 8 || depth == 10) || format < VFGS_420 || format > VFGS_444 || layout < VFGS_PLANAR || layout > VFGS_SEMI)
+	{
+		fprintf(stderr, "Error: unsupported bit depth, chroma format or frame layout\n");
+		return NULL;
+	}
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+	ctx->depth = depth;
+	ctx->format = format;
+	ctx->layout = layout;
+	ctx->gain = 100;
+	init_params(&ctx->par);
+
+	vfgs_reset();
+	vfgs_set_depth(depth);
+	vfgs_set_chroma_subsampling(format < VFGS_444 ? 2 : 1, format < VFGS_422 ? 2 : 1);
+	ctx_save(ctx);
+	ctx_program(ctx, 1);
+	return ctx;
+}
+
+void vfgs_destroy(vfgs_ctx* ctx)
+{
+	if (!ctx)
+		return;
+	if (vfgs_get_cfg() == &ctx->hw)
+		vfgs_reset();
+	vfgs_free_cfg(&ctx->par);
+	free(ctx->line);
+	free(ctx);
+}
+
+/** Configure from FGC SEI parameters */
+int vfgs_ctx_set_sei(vfgs_ctx* ctx, const vfgs_sei* sei)
+{
+	fgs_params par;
+
+	init_params(&par);
+	vfgs_sei_from_api(&par.sei, sei);
+	return ctx_set_params(ctx, &par);
+}
+
+/** Configure from AFGS1 parameters */
+int vfgs_ctx_set_afgs1(vfgs_ctx* ctx, const vfgs_afgs1* afgs1)
+{
+	fgs_params par;
+
+	init_params(&par);
+	vfgs_afgs1_from_api(&par.afgs1, afgs1);
+	return ctx_set_params(ctx, &par);
+}
+
+/** Configure from a file (as vfgs -c) */
+int vfgs_ctx_read_cfg(vfgs_ctx* ctx, const char* filename)
+{
+	fgs_params par;
+
+	init_params(&par);
+	if (vfgs_read_cfg(&par, filename))
+	{
+		vfgs_free_cfg(&par);
+		return 1;
+	}
+	return ctx_set_params(ctx, &par);
+}
+
+/** Configure from text, with the configuration file syntax */
+int vfgs_ctx_read_cfg_text(vfgs_ctx* ctx, const char* text)
+{
+	fgs_params par;
+
+	init_params(&par);
+	if (vfgs_read_cfg_text(&par, text))
+	{
+		vfgs_free_cfg(&par);
+		return 1;
+	}
+	return ctx_set_params(ctx, &par);
+}
+
+/** Load hardware state compiled by vfgs --compile-state (same bit depth and
+ * chroma format); gain can not be changed afterwards */
+int vfgs_ctx_load_state(vfgs_ctx* ctx, const char* filename)
+{
+	const vfgs_hw_cfg* cfg;
+
+	ctx_bind(ctx);
+	if (vfgs_state_load(filename))
+	{
+		ctx_bind(ctx);
+		return 1;
+	}
+	cfg = vfgs_get_cfg();
+	if (cfg->bs != ctx->depth - 8 || cfg->csubx != (ctx->format < VFGS_444 ? 2 : 1) || cfg->csuby != (ctx->format < VFGS_422 ? 2 : 1))
+	{
+		ctx_bind(ctx);
+		vfgs_state_unload();
+		CHECK(0, "state file %s was compiled for a different bit depth or chroma format", filename);
+	}
+	ctx_save(ctx); // the context has its own copy: drop the file
+	vfgs_state_unload();
+	ctx->state = 1;
+	ctx->prog_sei = 0;
+	return 0;
+}
+
+/** Restart random generator from seed (kept over configuration changes) */
+void vfgs_ctx_set_seed(vfgs_ctx* ctx, unsigned seed)
+{
+	ctx->seed = seed;
+	ctx_bind(ctx);
+	vfgs_set_seed(seed);
+	ctx_save(ctx);
+}
+
+/** Scale grain strength (in percent) */
+int vfgs_ctx_set_gain(vfgs_ctx* ctx, unsigned gain)
+{
+	CHECK(!ctx->state, "gain can not be changed on a compiled state");
+	ctx->gain = gain;
+	ctx_program(ctx, 0);
+	return 0;
+}
+
+/** Add grain to rows [y0, y0 + height) of a picture, with the hardware as
+ * programmed: plane[c] points to row y0 of component c (to its first Cr
+ * sample when interleaved), rows being stride[c] bytes apart and padded to
+ * a multiple of 16 samples; rows are processed in order from row 0 of each
+ * picture, y0 being a multiple of 16 (or any row, one at a time) */
+void vfgs_add_grain_planes(void* const plane[3], const int stride[3], int width, int height, int y0)
+{
+	vfgs_add_grain_planes_from(plane, stride, (const void* const*)plane, stride, width, height, y0);
+}
+
+/** Same, reading source rows src[c] (strides sstride[c]) and writing grained
+ * rows to plane[c]: the source is left untouched */
+void vfgs_add_grain_planes_from(void* const plane[3], const int stride[3], const void* const src[3], const int sstride[3], int width, int height, int y0)
+{
+	uint8 *Y = plane[0];
+	uint8 *U = plane[1];
+	uint8 *V = plane[2];
+	const uint8 *sY = src[0];
+	const uint8 *sU = src[1];
+	const uint8 *sV = src[2];
+	int suby = vfgs_get_cfg()->csuby;
+
+	for (int y=0; y<height; y++)
+	{
+		vfgs_add_grain_line_from(Y, U, V, sY, sU, sV, y0 + y, width);
+		Y += stride[0];
+		sY += sstride[0];
+		if ((y & 1) || suby == 1)
+		{
+			U += stride[1];
+			V += stride[2];
+			sU += sstride[1];
+			sV += sstride[2];
+		}
+	}
+}
+
+/** Add grain to the rows of region (x, y, w, h), over the block columns
+ * covering it, of a picture of width x height, with the hardware as
+ * programmed: planes at row 0, as for vfgs_add_grain_planes_from(); samples
+ * are the same as over the whole picture (random generator jumped to the
+ * first block row, and to the first block of each row), and the random
+ * generator is left as after the whole picture */
+void vfgs_add_grain_region(void* const plane[3], const int stride[3], const void* const src[3], const int sstride[3], int width, int height, int x, int y, int w, int h)
+{
+	int suby = vfgs_get_cfg()->csuby;
+	int y0 = y & ~(suby - 1); // (chroma rows are processed with even luma rows)
+	int whole = y0 == 0 && y + h >= height && x <= 0 && x + w >= width;
+	uint32 prng[2];
+
+	vfgs_get_prng(prng);
+	vfgs_jump_rows(y0, width);
+	for (int j=y0; j<y+h; j++)
+	{
+		int cj = j / suby;
+		vfgs_add_grain_line_part((uint8*)plane[0] + (size_t)j * stride[0], (uint8*)plane[1] + (size_t)cj * stride[1], (uint8*)plane[2] + (size_t)cj * stride[2],
+		                         (const uint8*)src[0] + (size_t)j * sstride[0], (const uint8*)src[1] + (size_t)cj * sstride[1], (const uint8*)src[2] + (size_t)cj * sstride[2],
+		                         j, width, x, w);
+	}
+	if (!whole)
+	{
+		vfgs_set_prng(prng);
+		vfgs_skip_frame(width, height);
+	}
+}
+
+/** Add grain to a frame in place, and advance random generator */
+int vfgs_process_frame(vfgs_ctx* ctx, void* const plane[3], const int stride[3], int width, int height)
+{
+	return vfgs_process_region(ctx, plane, stride, (const void* const*)plane, stride, width, height, 0, 0, width, height);
+}
+
+/** Add grain to a source frame src (strides sstride), output to frame plane
+ * (strides stride), and advance random generator */
+int vfgs_process_frame_from(vfgs_ctx* ctx, void* const plane[3], const int stride[3], const void* const src[3], const int sstride[3], int width, int height)
+{
+	return vfgs_process_region(ctx, plane, stride, src, sstride, width, height, 0, 0, width, height);
+}
+
+/** Same, only output to the rows of region (x, y, w, h), over the block
+ * columns covering it, with the same samples as over the whole frame; random generator is advanced past
+ * the whole frame */
+int vfgs_process_region(vfgs_ctx* ctx, void* const plane[3], const int stride[3], const void* const src[3], const int sstride[3], int width, int height, int x, int y, int w, int h)
+{
+	int sz = ctx->depth > 8 ? 2 : 1;
+	int subx = ctx->format < VFGS_444 ? 2 : 1;
+	int suby = ctx->format < VFGS_422 ? 2 : 1;
+	int semi = ctx->layout == VFGS_SEMI;
+	int span[2] = { ALIGN16(width) * sz, ALIGN16(width) / subx * (semi ? 2 : 1) * sz }; // bytes the kernel reads per row
+	int x0 = x & ~15, x1 = min(width, ALIGN16(x + w)); // columns of the blocks output
+	int col[2] = { x0 * sz, x0 / subx * (semi ? 2 : 1) * sz }; // (bytes)
+	int colbytes[2] = { (x1 - x0) * sz, (x1 - x0) / subx * (semi ? 2 : 1) * sz };
+	int y0 = y & ~(suby - 1);
+	void* p[3] = { plane[0], plane[1], semi ? (uint8*)plane[1] + sz : plane[2] };
+	int s[3] = { stride[0], stride[1], semi ? stride[1] : stride[2] };
+	const void* q[3] = { src[0], src[1], semi ? (const uint8*)src[1] + sz : src[2] };
+	int qs[3] = { sstride[0], sstride[1], semi ? sstride[1] : sstride[2] };
+
+	CHECK(width > 128 && height > 0 && !(width % subx) && !(height % suby), "unsupported picture size %dx%d", width, height);
+	CHECK(x >= 0 && y >= 0 && w > 0 && h > 0 && x + w <= width && y + h <= height, "region %dx%d at %d,%d out of picture", w, h, x, y);
+
+	ctx_bind(ctx);
+	if (!vfgs_grain_active())
+	{
+		vfgs_skip_frame(width, height);
+		for (int j=y0; j<y+h && q[0] != p[0]; j++) // (out of place: copy)
+		{
+			memcpy((uint8*)p[0] + (size_t)j * s[0] + col[0], (const uint8*)q[0] + (size_t)j * qs[0] + col[0], colbytes[0]);
+			for (int c=1; c<3 && !(j % suby); c += 1 + semi)
+				memcpy((uint8*)p[c] + (size_t)(j / suby) * s[c] + col[1], (const uint8*)q[c] + (size_t)(j / suby) * qs[c] + col[1], colbytes[1]);
+		}
+	}
+	else if (s[0] >= span[0] && s[1] >= span[1] && s[2] >= span[1] && qs[0] >= span[0] && qs[1] >= span[1] && qs[2] >= span[1])
+		vfgs_add_grain_region(p, s, q, qs, width, height, x, y, w, h);
+	else
+	{
+		// Rows too short for 16-sample blocks: process copies, one row at a time
+		int rowbytes[2] = { width * sz, width / subx * (semi ? 2 : 1) * sz };
+		int whole = y0 == 0 && y + h >= height && x1 - x0 >= width;
+		uint32 prng[2];
+		void* l[3];
+		if (ctx->line_size < 3 * span[0] * 2)
+		{
+			free(ctx->line);
+			ctx->line_size = 3 * span[0] * 2;
+			ctx->line = calloc(1, ctx->line_size);
+			CHECK(ctx->line, "out of memory");
+		}
+		l[0] = ctx->line;
+		l[1] = ctx->line + span[0] * 2;
+		l[2] = semi ? ctx->line + span[0] * 2 + sz : ctx->line + span[0] * 4;
+		vfgs_get_prng(prng);
+		vfgs_jump_rows(y0, width);
+		for (int j=y0; j<y+h; j++)
+		{
+			int cj = j / suby;
+			int chroma = !(j % suby); // (chroma rows are processed with even luma rows)
+			memcpy(l[0], (const uint8*)q[0] + (size_t)j * qs[0], rowbytes[0]);
+			for (int c=1; c<3 && chroma; c += 1 + semi)
+				memcpy(l[c], (const uint8*)q[c] + (size_t)cj * qs[c], rowbytes[1]);
+			vfgs_add_grain_line_part(l[0], l[1], l[2], l[0], l[1], l[2], j, width, x, w);
+			memcpy((uint8*)p[0] + (size_t)j * s[0] + col[0], (uint8*)l[0] + col[0], colbytes[0]);
+			for (int c=1; c<3 && chroma; c += 1 + semi)
+				memcpy((uint8*)p[c] + (size_t)cj * s[c] + col[1], (uint8*)l[c] + col[1], colbytes[1]);
+		}
+		if (!whole)
+		{
+			vfgs_set_prng(prng);
+			vfgs_skip_frame(width, height);
+		}
+	}
+	ctx_save(ctx);
+	return 0;
+}
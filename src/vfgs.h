@@ -0,0 +1,148 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VFGS_H_
+#define _VFGS_H_
+
+/** Film grain synthesis library (libvfgs)
+ *
+ * Adds grain in-process to frames in caller-owned buffers (e.g. decoder
+ * output), from an FGC SEI / AFGS1 configuration given as structures, as
+ * configuration text, or read from a file (configuration file, grain table,
+ * SEI dump, Annex-B / IVF bitstream, or compiled state file). Grain tables
+ * and SEI dumps are not followed over time: their first entry applies.
+ *
+ * Each context holds its own configuration, programmed hardware state and
+ * random generator state, so that several streams can be processed in turn;
+ * as contexts share the single hardware model, calls must not be concurrent.
+ * Functions return 0 on success and 1 on error (reported on stderr).
+ */
+
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(VFGS_SHARED)
+#define VFGS_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define VFGS_API __attribute__((visibility("default")))
+#else
+#define VFGS_API
+#endif
+
+// Chroma formats
+#define VFGS_420 0
+#define VFGS_422 1
+#define VFGS_444 2
+
+// Frame layouts
+#define VFGS_PLANAR 0 // one plane per component, 16-bit samples LSB-aligned
+#define VFGS_SEMI   1 // luma plane + interleaved Cb/Cr plane (NV12, or P010 with 16-bit samples MSB-aligned)
+
+#define VFGS_MAX_MODEL_VALUES 6
+
+// FGC SEI parameters (as in the SEI message, intervals / model values per
+// component)
+typedef struct vfgs_sei_s {
+	uint8_t model_id;
+	uint8_t log2_scale_factor;
+	uint8_t comp_model_present_flag[3];
+	uint16_t num_intensity_intervals[3];
+	uint8_t num_model_values[3];
+	uint8_t intensity_interval_lower_bound[3][256];
+	uint8_t intensity_interval_upper_bound[3][256];
+	int16_t comp_model_value[3][256][VFGS_MAX_MODEL_VALUES];
+} vfgs_sei;
+
+// AFGS1 / AV1 film grain parameters
+typedef struct vfgs_afgs1_s {
+	uint16_t grain_seed;
+	uint8_t num_y_points; // 0..14
+	uint8_t point_y_values[14]; // increasing
+	uint8_t point_y_scaling[14];
+	uint8_t chroma_scaling_from_luma;
+	uint8_t num_cb_points; // 0..10
+	uint8_t point_cb_values[10];
+	uint8_t point_cb_scaling[10];
+	uint8_t num_cr_points; // 0..10
+	uint8_t point_cr_values[10];
+	uint8_t point_cr_scaling[10];
+	uint8_t grain_scaling; // 8..11
+	uint8_t ar_coeff_lag; // 0..3
+	int16_t ar_coeffs_y[24];
+	int16_t ar_coeffs_cb[25]; // last one: luma injection
+	int16_t ar_coeffs_cr[25];
+	uint8_t ar_coeff_shift; // 6..9
+	uint8_t grain_scale_shift; // 0..3
+	uint8_t cb_mult;
+	uint8_t cb_luma_mult;
+	uint16_t cb_offset; // 9-bit
+	uint8_t cr_mult;
+	uint8_t cr_luma_mult;
+	uint16_t cr_offset; // 9-bit
+	uint8_t overlap_flag;
+	uint8_t clip_to_restricted_range;
+} vfgs_afgs1;
+
+typedef struct vfgs_ctx_s vfgs_ctx;
+
+VFGS_API vfgs_ctx* vfgs_create(int depth, int format, int layout); // NULL on error
+VFGS_API void vfgs_destroy(vfgs_ctx* ctx);
+
+VFGS_API int  vfgs_ctx_set_sei(vfgs_ctx* ctx, const vfgs_sei* sei);
+VFGS_API int  vfgs_ctx_set_afgs1(vfgs_ctx* ctx, const vfgs_afgs1* afgs1);
+VFGS_API int  vfgs_ctx_read_cfg(vfgs_ctx* ctx, const char* filename);
+VFGS_API int  vfgs_ctx_read_cfg_text(vfgs_ctx* ctx, const char* text); // configuration file syntax
+VFGS_API int  vfgs_ctx_load_state(vfgs_ctx* ctx, const char* filename);
+VFGS_API void vfgs_ctx_set_seed(vfgs_ctx* ctx, unsigned seed);
+VFGS_API int  vfgs_ctx_set_gain(vfgs_ctx* ctx, unsigned gain); // percent
+
+// Add grain to a frame: plane[c] points to the first row of component c
+// (semi-planar: plane[2] is not used), rows being stride[c] bytes apart;
+// samples are 8-bit, or 16-bit words for depth > 8
+VFGS_API int  vfgs_process_frame(vfgs_ctx* ctx, void* const plane[3], const int stride[3], int width, int height);
+// Same, out of place: grained samples of frame src (strides sstride) are
+// written to frame plane, src being left untouched
+VFGS_API int  vfgs_process_frame_from(vfgs_ctx* ctx, void* const plane[3], const int stride[3], const void* const src[3], const int sstride[3], int width, int height);
+// Same, only for the rows of region (x, y, w, h), over the 16-sample block
+// columns covering it: samples are the same as over the whole frame, other
+// ones are left as they are
+VFGS_API int  vfgs_process_region(vfgs_ctx* ctx, void* const plane[3], const int stride[3], const void* const src[3], const int sstride[3], int width, int height, int x, int y, int w, int h);
+
+// Frame walker over the hardware as programmed (no context)
+VFGS_API void vfgs_add_grain_planes(void* const plane[3], const int stride[3], int width, int height, int y0);
+VFGS_API void vfgs_add_grain_planes_from(void* const plane[3], const int stride[3], const void* const src[3], const int sstride[3], int width, int height, int y0);
+VFGS_API void vfgs_add_grain_region(void* const plane[3], const int stride[3], const void* const src[3], const int sstride[3], int width, int height, int x, int y, int w, int h);
+
+#endif  // _VFGS_H_
@@ -0,0 +1,844 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE // fmemopen()
+#include "vfgs_cfg.h"
+#include "vfgs_nal.h"
+#include "vfgs_obu.h"
+#include "yuv.h"
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#define strncasecmp _strnicmp
+#else
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#endif
+
+#define DEFAULT_FREQ 8
+#define CHECK(cond, ...) { if (!(cond)) { fprintf(stderr, "Error: "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); return 1; } }
+
+static int read_array_i16(int16* x, char* s)
+{
+	while (isdigit(*s) || *s=='-' || *s=='+')
+	{
+		*x++ = atoi(s);
+		while (isdigit(*s) || *s=='-' || *s=='+')
+			s++;
+		while (isblank(*s))
+			s++;
+	}
+	return 0;
+}
+
+static int read_array_u8(uint8* x, char* s)
+{
+	while (isdigit(*s))
+	{
+		*x++ = atoi(s);
+		while (isdigit(*s))
+			s++;
+		while (isblank(*s))
+			s++;
+	}
+	return 0;
+}
+
+/** Fill model array with default values when unspecified */
+void vfgs_fill_model_array(int16 *x, int n, int model_id, int log2_scale_factor)
+{
+	x += n;
+	if (n<2) { *x++ = model_id ? 0 : DEFAULT_FREQ; } // H high cutoff / 1st AR coef (left & top)
+	if (n<3) { x[0] = model_id ? 0 : x[-1]; x++;   } // V high cutoff / x-comp corr
+	if (n<4) { *x++ = 0;                           } // H low cutoff / 2nd AR coef (top-left, top-right)
+	if (n<5) { *x++ = model_id << log2_scale_factor; } // V low cutoff / aspect ratio
+	if (n<6) { *x++ = 0;                           } // x-comp corr / 3rd AR coef (left-left, top-top)
+}
+
+static int read_model_array(int16 *x, char* s, int n, int model_id, int log2_scale_factor)
+{
+	int i;
+
+	// Note: frequency cutoffs are included bounds (<=)
+
+	while (isdigit(*s) || *s=='-' || *s=='+')
+	{
+		for (i=0; i<n; i++)
+		{
+			*x++ = atoi(s);
+			while (isdigit(*s) || *s=='-' || *s=='+')
+				s++;
+			while (isblank(*s))
+				s++;
+		}
+		vfgs_fill_model_array(x-n, n, model_id, log2_scale_factor);
+		x += SEI_MAX_MODEL_VALUES-n;
+	}
+	return 0;
+}
+
+static void adjust_chroma_sei(fgs_sei* sei, int format)
+{
+	if (sei->model_id == 0)
+	{
+		// Conversion of component model values for 4:2:2 and 4:2:0 chroma formats
+		for (int c=1; c<3; c++)
+			if (sei->comp_model_present_flag[c])
+				for (int k=0; k<sei->num_intensity_intervals[c]; k++)
+				{
+					if (format < YUV_444)
+						sei->comp_model_value[c][k][1] = max(2, min(14, sei->comp_model_value[c][k][1] << 1)); // Horizontal frequency
+					if (format < YUV_422)
+						sei->comp_model_value[c][k][2] = max(2, min(14, sei->comp_model_value[c][k][2] << 1)); // Vertical frequency
+
+					if (format == YUV_420)
+						sei->comp_model_value[c][k][0] >>= 1;
+					else if (format == YUV_422)
+						sei->comp_model_value[c][k][0] = (sei->comp_model_value[c][k][0] * 181 + 128) >> 8;
+				}
+	}
+}
+
+void vfgs_adjust_chroma_cfg(fgs_params* par, int format)
+{
+	adjust_chroma_sei(&par->sei, format);
+	for (int k=0; k<par->nsei; k++)
+		adjust_chroma_sei(&par->seis[k].sei, format);
+}
+
+static int check_cfg_sei(const fgs_sei* sei, int depth, int format)
+{
+	// Unsupported features
+	CHECK(format == YUV_420 || (!sei->comp_model_present_flag[1] && !sei->comp_model_present_flag[2]), "color grain currently not supported on yuv422 and yuv444 formats");
+	CHECK(sei->model_id==0 || (!sei->comp_model_present_flag[1] && !sei->comp_model_present_flag[2]), "color grain currently not supported in SEI.AR mode");
+
+	// Sanity checks
+	CHECK(sei->model_id <= 1, "SEIFGCModelId shall be 0 or 1");
+	CHECK(sei->log2_scale_factor - sei->model_id >= 2 && sei->log2_scale_factor - sei->model_id < 8, "SEIFGCLog2ScaleFactor out of %d..%d range", 2 + sei->model_id, 7 + sei->model_id);
+	for (int c = 0; c < 3; c++)
+	{
+		if (sei->comp_model_present_flag[c])
+		{
+			int rng = (1 << depth);
+			CHECK(sei->num_model_values[c] >= 1 && sei->num_model_values[c] <= 6, "SEIFGCNumModelValuesMinus1Comp%d out of 0..5 range", c);
+			for (int i = 0; i < sei->num_intensity_intervals[c]; i++)
+			{
+				CHECK(sei->intensity_interval_lower_bound[c][i] <= sei->intensity_interval_upper_bound[c][i], "inconsistent interval %d for component %d: upper bound should be larger or equal than lower bound", i, c);
+
+				CHECK(sei->comp_model_value[c][i][0] < rng, "scaling factor for component %d and interval %d is too large", c, i);
+				if (sei->model_id == 0) // Frequency-filtering mode
+				{
+					CHECK(sei->comp_model_value[c][i][1] >= 2 && sei->comp_model_value[c][i][1] <= 14,  "horizontal cutoff frequency for component %d and interval %d out of 2..14 range", c, i);
+					CHECK(sei->comp_model_value[c][i][1] >= 2 && sei->comp_model_value[c][i][2] <= 14,  "vertical cutoff frequency for component %d and interval %d out of 2..14 range", c, i);
+				}
+				else // Auto-regressive
+				{
+					CHECK(sei->comp_model_value[c][i][1] >= -rng/2 && sei->comp_model_value[c][i][1] < rng/2,  "first AR coefficient for component %d and interval %d is out of range", c, i);
+					CHECK(sei->comp_model_value[c][i][3] >= -rng/2 && sei->comp_model_value[c][i][3] < rng/2,  "second AR coefficient for component %d and interval %d is out of range", c, i);
+					CHECK(sei->comp_model_value[c][i][5] >= -rng/2 && sei->comp_model_value[c][i][5] < rng/2,  "third AR coefficient for component %d and interval %d is out of range", c, i);
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int check_cfg_afgs1(const fgs_afgs1* afgs1, int format)
+{
+	int i, val;
+
+	// Unsupported features
+	CHECK(format == YUV_420 || (!afgs1->num_cb_points && !afgs1->num_cr_points), "color grain currently not supported on yuv422 and yuv444 formats");
+
+	// Check point_y_values are in increasing order
+	for (i=1, val=afgs1->point_y_values[0]; i < afgs1->num_y_points; i++)
+	{
+		CHECK(afgs1->point_y_values[i] > val, "afgs1.point_y_values shall be in increasing order");
+		val = afgs1->point_y_values[i];
+	}
+
+	// Check point_cb_values are in increasing order
+	for (i=1, val=afgs1->point_cb_values[0]; i < afgs1->num_cb_points; i++)
+	{
+		CHECK(afgs1->point_cb_values[i] > val, "afgs1.point_cb_values shall be in increasing order");
+		val = afgs1->point_cb_values[i];
+	}
+
+	// Check point_y_values are in increasing order
+	for (i=1, val=afgs1->point_cr_values[0]; i < afgs1->num_cr_points; i++)
+	{
+		CHECK(afgs1->point_cr_values[i] > val, "afgs1.point_cr_values shall be in increasing order");
+		val = afgs1->point_cr_values[i];
+	}
+
+	return 0;
+}
+
+int vfgs_check_cfg(const fgs_params* par, int depth, int format)
+{
+	if (par->afgs1.num_y_points || par->ntbl)
+	{
+		for (int k=0; k<par->ntbl; k++)
+			if (check_cfg_afgs1(&par->tbl[k].afgs1, format))
+				return 1;
+		return check_cfg_afgs1(&par->afgs1, format);
+	}
+	else
+	{
+		for (int k=0; k<par->nsei; k++)
+			if (par->seis[k].apply && check_cfg_sei(&par->seis[k].sei, depth, format))
+				return 1;
+		return check_cfg_sei(&par->sei, depth, format);
+	}
+}
+
+#define AERR "AFGS1 table entry: "
+
+// Read AFGS1 parameters of a "grain table" entry (lines following the E header line)
+static int read_afgs1_tbl_params(fgs_afgs1* afgs1, FILE* cfg)
+{
+	char line[1024];
+	char *s;
+	const char* sep = " \t"; // separators (white space)
+	int ncoef;
+
+	// Parameters line
+	fgets(line, sizeof(line), cfg);
+	for (s = line; isblank(*s); s++); // skip whitespace
+	s = strtok(line, sep);             CHECK(s && !strcmp(s,"p"), AERR "expecting parameters (p)");
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing ar_coeff_lag");
+	afgs1->ar_coeff_lag = atoi(s);     CHECK(afgs1->ar_coeff_lag <= 3, "ar_coeff_lag higher than 3");
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing ar_coeff_shift");
+	afgs1->ar_coeff_shift = atoi(s);   CHECK(afgs1->ar_coeff_shift >= 6 && afgs1->ar_coeff_shift <= 9, "ar_coeff_shift out of 6..9 range");
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing grain_scale_shift");
+	afgs1->grain_scale_shift = atoi(s); CHECK(afgs1->grain_scale_shift <= 3, "grain_scale_shift higher than 3");
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing grain_scaling");
+	afgs1->grain_scaling = atoi(s);    CHECK(afgs1->grain_scaling >= 8 && afgs1->grain_scaling <= 11, "grain_scaling out of 8..11 range");
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing chroma_scaling_from_luma");
+	afgs1->chroma_scaling_from_luma = atoi(s);
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing overlap_flag");
+	afgs1->overlap_flag = atoi(s);
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing cb_mult");
+	afgs1->cb_mult = atoi(s);
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing cb_luma_mult");
+	afgs1->cb_luma_mult = atoi(s);
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing cb_offset");
+	afgs1->cb_offset = atoi(s);
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing cr_mult");
+	afgs1->cr_mult = atoi(s);
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing cr_luma_mult");
+	afgs1->cr_luma_mult = atoi(s);
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing cr_offset");
+	afgs1->cr_offset = atoi(s);
+
+	// Y scaling function line
+	fgets(line, sizeof(line), cfg);
+	for (s = line; isblank(*s); s++); // skip whitespace
+	s = strtok(line, sep);             CHECK(s && !strcmp(s,"sY"), AERR "expecting luma scaling function (sY)");
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing num_y_points");
+	afgs1->num_y_points = atoi(s);     CHECK(afgs1->num_y_points <= 14, "num_y_points higher than 14");
+	for (int k=0; k<afgs1->num_y_points; k++)
+	{
+		s = strtok(NULL, sep);         CHECK(s, AERR "missing luma scaling point (value)");
+		afgs1->point_y_values[k] = atoi(s);
+		s = strtok(NULL, sep);         CHECK(s, AERR "missing luma scaling point (scale)");
+		afgs1->point_y_scaling[k] = atoi(s);
+	}
+
+	// Cb scaling function line
+	fgets(line, sizeof(line), cfg);
+	for (s = line; isblank(*s); s++); // skip whitespace
+	s = strtok(line, sep);             CHECK(s && !strcmp(s,"sCb"), AERR "expecting Cb scaling function (sCb)");
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing num_cb_points");
+	afgs1->num_cb_points = atoi(s);    CHECK(afgs1->num_cb_points <= 10, "num_cb_points higher than 10");
+	for (int k=0; k<afgs1->num_cb_points; k++)
+	{
+		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cb scaling point (value)");
+		afgs1->point_cb_values[k] = atoi(s);
+		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cb scaling point (scale)");
+		afgs1->point_cb_scaling[k] = atoi(s);
+	}
+
+	// Cr scaling function line
+	fgets(line, sizeof(line), cfg);
+	for (s = line; isblank(*s); s++); // skip whitespace
+	s = strtok(line, sep);             CHECK(s && !strcmp(s,"sCr"), AERR "expecting Cr scaling function (sCr)");
+	s = strtok(NULL, sep);             CHECK(s, AERR "missing num_cr_points");
+	afgs1->num_cr_points = atoi(s);    CHECK(afgs1->num_cr_points <= 10, "num_cr_points higher than 10");
+	for (int k=0; k<afgs1->num_cr_points; k++)
+	{
+		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cr scaling point (value)");
+		afgs1->point_cr_values[k] = atoi(s);
+		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cr scaling point (scale)");
+		afgs1->point_cr_scaling[k] = atoi(s);
+	}
+
+	// Y coefficients line
+	fgets(line, sizeof(line), cfg);
+	for (s = line; isblank(*s); s++); // skip whitespace
+	s = strtok(line, sep);             CHECK(s && !strcmp(s,"cY"), AERR "expecting luma coefficients");
+	ncoef = 2 * afgs1->ar_coeff_lag * (afgs1->ar_coeff_lag + 1);
+	for (int k=0; k<ncoef; k++)
+	{
+		s = strtok(NULL, sep);         CHECK(s, AERR "missing luma AR coefficient");
+		afgs1->ar_coeffs_y[k] = atoi(s);
+	}
+
+	// Cb coefficients line
+	ncoef++;
+	fgets(line, sizeof(line), cfg);
+	for (s = line; isblank(*s); s++); // skip whitespace
+	s = strtok(line, sep);             CHECK(s && !strcmp(s,"cCb"), AERR "expecting Cb coefficients");
+	for (int k=0; k<ncoef; k++)
+	{
+		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cb AR coefficient");
+		afgs1->ar_coeffs_cb[k] = atoi(s);
+	}
+
+	// Cr coefficients line
+	fgets(line, sizeof(line), cfg);
+	for (s = line; isblank(*s); s++); // skip whitespace
+	s = strtok(line, sep);             CHECK(s && !strcmp(s,"cCr"), AERR "expecting Cr coefficients");
+	for (int k=0; k<ncoef; k++)
+	{
+		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cr AR coefficient");
+		afgs1->ar_coeffs_cr[k] = atoi(s);
+	}
+
+	// Note: afgs1->clip_to_restricted_range is missing in .tbl files --> set it to a default value ?
+
+	return 0;
+}
+
+// Read AFGS1 "grain table", as output by the grain analyzer in AOM reference
+// software: all entries, sorted by start time
+static int read_afgs1_tbl(fgs_params* par, FILE* cfg)
+{
+	char line[1024];
+	char *s;
+	const char* sep = " \t"; // separators (white space)
+	fgs_tbl_entry* e;
+	uint16 seed;
+
+	while (fgets(line, sizeof(line), cfg))
+	{
+		for (s = line; isspace(*s); s++); // skip whitespace
+		if (*s == '\0') // skip empty lines
+			continue;
+
+		// Header line
+		s = strtok(s, sep);    CHECK(s && !strcmp(s,"E"), AERR "expecting header (E)");
+		par->tbl = realloc(par->tbl, (par->ntbl + 1) * sizeof(fgs_tbl_entry));
+		CHECK(par->tbl, "out of memory");
+		e = &par->tbl[par->ntbl];
+		memset(e, 0, sizeof(*e));
+		s = strtok(NULL, sep); CHECK(s, AERR "missing start_time");
+		e->start = atoll(s);
+		s = strtok(NULL, sep); CHECK(s, AERR "missing end_time");
+		e->end = atoll(s);
+		s = strtok(NULL, sep); CHECK(s, AERR "missing apply_grain");
+		e->apply = atoi(s);
+		s = strtok(NULL, sep); CHECK(s, AERR "missing random_seed");
+		seed = atoi(s);
+		s = strtok(NULL, sep); CHECK(s, AERR "missing update_parameters");
+		e->update = atoi(s);
+
+		if (e->update)
+		{
+			if (read_afgs1_tbl_params(&e->afgs1, cfg))
+				return 1;
+		}
+		else
+		{
+			// Same parameters as previous entry
+			CHECK(par->ntbl > 0, AERR "first entry shall update parameters");
+			memcpy(&e->afgs1, &e[-1].afgs1, sizeof(fgs_afgs1));
+		}
+		e->afgs1.grain_seed = seed;
+		par->ntbl ++;
+
+		// Keep sorted by start time (entries are normally already in order)
+		for (int k = par->ntbl-1; k > 0 && par->tbl[k-1].start > par->tbl[k].start; k--)
+		{
+			fgs_tbl_entry tmp = par->tbl[k];
+			par->tbl[k] = par->tbl[k-1];
+			par->tbl[k-1] = tmp;
+		}
+	}
+	CHECK(par->ntbl > 0, AERR "expecting header (E)");
+	memcpy(&par->afgs1, &par->tbl[0].afgs1, sizeof(fgs_afgs1));
+
+	return 0;
+}
+
+
+// Next color component present in FGC SEI, from c (3 if none)
+static int next_comp(const fgs_sei* sei, int c)
+{
+	while (c < 3 && !sei->comp_model_present_flag[c])
+		c ++;
+	return c;
+}
+
+/** Record current SEI (SEI dump or bitstream), applied from picture poc */
+int vfgs_push_sei(fgs_params* par, int poc, int apply, int persist)
+{
+	fgs_sei_entry* e = par->nsei ? &par->seis[par->nsei-1] : NULL;
+
+	// Skip repetitions of a persistent SEI (e.g. at each IRAP)
+	if (e && apply && e->apply && e->persist && persist && !memcmp(&e->sei, &par->sei, sizeof(fgs_sei)))
+		return 0;
+
+	if ((par->nsei & (par->nsei - 1)) == 0) // grow at powers of 2
+	{
+		par->seis = realloc(par->seis, (par->nsei ? 2*par->nsei : 1) * sizeof(fgs_sei_entry));
+		CHECK(par->seis, "out of memory");
+	}
+	e = &par->seis[par->nsei++];
+	e->poc = poc;
+	e->apply = apply;
+	e->persist = persist;
+	memcpy(&e->sei, &par->sei, sizeof(fgs_sei));
+
+	return 0;
+}
+
+// Picture of a SEI dump, from the decoder log line "POC <n> ..." (decoding order)
+typedef struct dump_pic_s {
+	int cvs; // coded video sequence index (IDR / BLA pictures start one)
+	int poc;
+	int sei; // last FGC SEI of the picture (par->seis index), or -1
+} dump_pic;
+
+static int cmp_dump_pic(const void* a, const void* b)
+{
+	const dump_pic* p = a;
+	const dump_pic* q = b;
+	return p->cvs != q->cvs ? p->cvs - q->cvs : p->poc - q->poc;
+}
+
+// Move FGC SEIs of a SEI dump from decoding order to output order, from the
+// picture order counts of the decoder log lines
+static int dump_output_order(fgs_params* par, dump_pic* pics, int npoc, int npics, const char* filename)
+{
+	fgs_sei_entry* seis = par->seis;
+	int nsei = par->nsei, err = 0, cvs = -1;
+
+	CHECK(npoc == npics, "%d POC lines for %d decoded picture hash SEIs in %s", npoc, npics, filename);
+	for (int k=0; k<nsei; k++)
+		if (seis[k].poc < npoc) // (else after last picture)
+			pics[seis[k].poc].sei = k;
+	qsort(pics, npoc, sizeof(dump_pic), cmp_dump_pic);
+	par->seis = NULL;
+	par->nsei = 0;
+	for (int k=0; !err && k<npoc; k++)
+	{
+		if (pics[k].sei >= 0)
+		{
+			memcpy(&par->sei, &seis[pics[k].sei].sei, sizeof(fgs_sei));
+			err = vfgs_push_sei(par, k, seis[pics[k].sei].apply, seis[pics[k].sei].persist);
+		}
+		else if (pics[k].cvs != cvs && par->nsei && par->seis[par->nsei-1].persist)
+			err = vfgs_push_sei(par, k, 0, 0); // persistence ends with the coded video sequence
+		cvs = pics[k].cvs;
+	}
+	free(seis);
+	return err;
+}
+
+static int read_cfg(fgs_params* par, FILE* cfg, const char* filename)
+{
+	char line[1024];
+	char *s, *v, *e;
+	int c=0, i=0, j=0;
+	int cnt1=0, cnt2=0;
+	int npics=0; // pictures seen so far (SEI dump)
+	dump_pic* pics = NULL; // pictures of decoder log lines (SEI dump)
+	int npoc=0, cvs=-1, poc, err;
+
+	par->afgs1.num_y_points = 0; // reset afgs1/sei detection
+	par->afgs1.num_cb_points = 0;
+	par->afgs1.num_cr_points = 0;
+	vfgs_free_cfg(par);
+
+	while (fgets(line, sizeof(line), cfg))
+	{
+		if (line[0] == '#') // remove comments (special case for 1st character)
+			continue;
+		if (sscanf(line, "POC %d", &poc) == 1) // decoder log line (SEI dump)
+		{
+			if ((npoc & (npoc - 1)) == 0) // grow at powers of 2
+			{
+				dump_pic* tmp = realloc(pics, (npoc ? 2*npoc : 1) * sizeof(dump_pic));
+				CHECK(tmp, "out of memory");
+				pics = tmp;
+			}
+			if (cvs < 0 || strstr(line, "IDR") || strstr(line, "BLA"))
+				cvs ++;
+			pics[npoc].cvs = cvs;
+			pics[npoc].poc = poc;
+			pics[npoc++].sei = -1;
+			continue;
+		}
+		s = strtok(line, "#"); // remove comments
+		while (isblank(*s)) // skip leading whitespace
+			s++;
+		s = strtok(s, ":"); // get "name"
+		v = strtok(NULL, ":"); // get "value"
+
+		if (v == NULL)
+		{
+			if (!strncasecmp(s, "filmgrn1", 8))
+			{
+				free(pics);
+				return read_afgs1_tbl(par, cfg);
+			}
+			else if (!strncasecmp(s, "Decoded picture hash SEI", 24))
+				npics ++; // suffix SEI, one per picture: next FGC SEI (prefix) applies to next picture
+			else if (!strncasecmp(s, "Film grain characteristics SEI", 30))
+				c = i = j = 0;
+			continue;
+		}
+		while (isblank(*v)) // skip leading whitespace of "value"
+			v++;
+		for (e=s; !isblank(*e) && *e; e++) // trim trailing whitespace of "name"
+			;
+		*e = '\0';
+		cnt1 ++;
+
+		// SEI
+		if      (!strcasecmp(s, "SEIFGCModelId"))                          { par->sei.model_id                   = atoi(v); }
+		else if (!strcasecmp(s, "SEIFGCLog2ScaleFactor"))                  { par->sei.log2_scale_factor          = atoi(v); }
+		else if (!strcasecmp(s, "SEIFGCCompModelPresentComp0"))            { par->sei.comp_model_present_flag[0] = atoi(v); }
+		else if (!strcasecmp(s, "SEIFGCCompModelPresentComp1"))            { par->sei.comp_model_present_flag[1] = atoi(v); }
+		else if (!strcasecmp(s, "SEIFGCCompModelPresentComp2"))            { par->sei.comp_model_present_flag[2] = atoi(v); }
+		else if (!strcasecmp(s, "SEIFGCNumIntensityIntervalMinus1Comp0"))  { par->sei.num_intensity_intervals[0] = atoi(v) + 1; }
+		else if (!strcasecmp(s, "SEIFGCNumIntensityIntervalMinus1Comp1"))  { par->sei.num_intensity_intervals[1] = atoi(v) + 1; }
+		else if (!strcasecmp(s, "SEIFGCNumIntensityIntervalMinus1Comp2"))  { par->sei.num_intensity_intervals[2] = atoi(v) + 1; }
+		else if (!strcasecmp(s, "SEIFGCNumModelValuesMinus1Comp0"))        { par->sei.num_model_values[0]        = atoi(v) + 1; }
+		else if (!strcasecmp(s, "SEIFGCNumModelValuesMinus1Comp1"))        { par->sei.num_model_values[1]        = atoi(v) + 1; }
+		else if (!strcasecmp(s, "SEIFGCNumModelValuesMinus1Comp2"))        { par->sei.num_model_values[2]        = atoi(v) + 1; }
+		else if (!strcasecmp(s, "SEIFGCIntensityIntervalLowerBoundComp0")) { read_array_u8(par->sei.intensity_interval_lower_bound[0], v); }
+		else if (!strcasecmp(s, "SEIFGCIntensityIntervalLowerBoundComp1")) { read_array_u8(par->sei.intensity_interval_lower_bound[1], v); }
+		else if (!strcasecmp(s, "SEIFGCIntensityIntervalLowerBoundComp2")) { read_array_u8(par->sei.intensity_interval_lower_bound[2], v); }
+		else if (!strcasecmp(s, "SEIFGCIntensityIntervalUpperBoundComp0")) { read_array_u8(par->sei.intensity_interval_upper_bound[0], v); }
+		else if (!strcasecmp(s, "SEIFGCIntensityIntervalUpperBoundComp1")) { read_array_u8(par->sei.intensity_interval_upper_bound[1], v); }
+		else if (!strcasecmp(s, "SEIFGCIntensityIntervalUpperBoundComp2")) { read_array_u8(par->sei.intensity_interval_upper_bound[2], v); }
+		else if (!strcasecmp(s, "SEIFGCCompModelValuesComp0")) { read_model_array(par->sei.comp_model_value[0][0], v, par->sei.num_model_values[0], par->sei.model_id, par->sei.log2_scale_factor); }
+		else if (!strcasecmp(s, "SEIFGCCompModelValuesComp1")) { read_model_array(par->sei.comp_model_value[1][0], v, par->sei.num_model_values[1], par->sei.model_id, par->sei.log2_scale_factor); }
+		else if (!strcasecmp(s, "SEIFGCCompModelValuesComp2")) { read_model_array(par->sei.comp_model_value[2][0], v, par->sei.num_model_values[2], par->sei.model_id, par->sei.log2_scale_factor); }
+
+		// SEI, dump style
+		else if (!strcasecmp(s, "fg_characteristics_cancel_flag"))
+		{
+			c = i = j = 0; // new FGC SEI
+			if (atoi(v) && vfgs_push_sei(par, npics, 0, 0))
+				return 1;
+		}
+		else if (!strcasecmp(s, "fg_model_id"))                             { par->sei.model_id                   = atoi(v); }
+		else if (!strcasecmp(s, "fg_log2_scale_factor"))                    { par->sei.log2_scale_factor          = atoi(v); }
+		else if (!strcasecmp(s, "fg_comp_model_present_flag[c]"))           { par->sei.comp_model_present_flag[c] = atoi(v);     c = (c<2) ? c+1 : next_comp(&par->sei, 0); }
+		else if (!strcasecmp(s, "fg_num_intensity_intervals_minus1[c]"))    { par->sei.num_intensity_intervals[c] = atoi(v) + 1; }
+		else if (!strcasecmp(s, "fg_num_model_values_minus1[c]"))
+		{
+			par->sei.num_model_values[c] = atoi(v) + 1;
+			c = next_comp(&par->sei, c+1);
+			if (c == 3)
+				c = next_comp(&par->sei, 0); // intervals follow
+		}
+		else if (!strcasecmp(s, "fg_intensity_interval_lower_bound[c][i]")) { par->sei.intensity_interval_lower_bound[c][i] = atoi(v); }
+		else if (!strcasecmp(s, "fg_intensity_interval_upper_bound[c][i]")) { par->sei.intensity_interval_upper_bound[c][i] = atoi(v); }
+		else if (!strcasecmp(s, "fg_comp_model_value[c][i]"))
+		{
+			par->sei.comp_model_value[c][i][j++] = atoi(v);
+			if (j == par->sei.num_model_values[c])
+			{
+				vfgs_fill_model_array(par->sei.comp_model_value[c][i], par->sei.num_model_values[c], par->sei.model_id, par->sei.log2_scale_factor);
+				i ++; // next intensity interval
+				j = 0;
+				if (i == par->sei.num_intensity_intervals[c])
+				{
+					c = next_comp(&par->sei, c+1); // next color component
+					i = 0;
+				}
+			}
+		}
+		else if (!strcasecmp(s, "fg_characteristics_persistence_flag"))     { if (vfgs_push_sei(par, npics, 1, atoi(v))) return 1; }
+
+		// AFGS1
+		else if (!strcasecmp(s, "AFGS1GrainSeed"))             { par->afgs1.grain_seed = atoi(v); }
+		else if (!strcasecmp(s, "AFGS1NumYPoints"))            { par->afgs1.num_y_points = atoi(v); CHECK(par->afgs1.num_y_points <= 14, "AFGS1NumYPoints higher than 14"); }
+		else if (!strcasecmp(s, "AFGS1PointYValues"))          { read_array_u8(par->afgs1.point_y_values, v); }
+		else if (!strcasecmp(s, "AFGS1PointYScaling"))         { read_array_u8(par->afgs1.point_y_scaling, v); }
+		else if (!strcasecmp(s, "AFGS1ChromaScalingFromLuma")) { par->afgs1.chroma_scaling_from_luma = atoi(v); }
+		else if (!strcasecmp(s, "AFGS1NumCbPoints"))           { par->afgs1.num_cb_points = atoi(v); CHECK(par->afgs1.num_cb_points <= 10, "AFGS1NumCbPoints higher than 10"); }
+		else if (!strcasecmp(s, "AFGS1PointCbValues"))         { read_array_u8(par->afgs1.point_cb_values, v); }
+		else if (!strcasecmp(s, "AFGS1PointCbScaling"))        { read_array_u8(par->afgs1.point_cb_scaling, v); }
+		else if (!strcasecmp(s, "AFGS1NumCrPoints"))           { par->afgs1.num_cr_points = atoi(v); CHECK(par->afgs1.num_cr_points <= 10, "AFGS1NumCrPoints higher than 10"); }
+		else if (!strcasecmp(s, "AFGS1PointCrValues"))         { read_array_u8(par->afgs1.point_cr_values, v); }
+		else if (!strcasecmp(s, "AFGS1PointCrScaling"))        { read_array_u8(par->afgs1.point_cr_scaling, v); }
+		else if (!strcasecmp(s, "AFGS1GrainScaling"))          { par->afgs1.grain_scaling = atoi(v); CHECK(par->afgs1.grain_scaling >= 8 && par->afgs1.grain_scaling <= 11, "AFGS1GrainScaling out of 8..11 range"); }
+		else if (!strcasecmp(s, "AFGS1ARCoeffLag"))            { par->afgs1.ar_coeff_lag = atoi(v); CHECK(par->afgs1.ar_coeff_lag <= 3, "AFGS1ARCoeffLag higher than 3"); }
+		else if (!strcasecmp(s, "AFGS1ARCoeffsY"))             { read_array_i16(par->afgs1.ar_coeffs_y, v); }
+		else if (!strcasecmp(s, "AFGS1ARCoeffsCb"))            { read_array_i16(par->afgs1.ar_coeffs_cb, v); }
+		else if (!strcasecmp(s, "AFGS1ARCoeffsCr"))            { read_array_i16(par->afgs1.ar_coeffs_cr, v); }
+		else if (!strcasecmp(s, "AFGS1ARCoeffShift"))          { par->afgs1.ar_coeff_shift = atoi(v); CHECK(par->afgs1.ar_coeff_shift >= 6 && par->afgs1.ar_coeff_shift <= 9, "AFGS1ARCoeffShift out of 6..9 range"); }
+		else if (!strcasecmp(s, "AFGS1GrainScaleShift"))       { par->afgs1.grain_scale_shift = atoi(v); CHECK(par->afgs1.grain_scale_shift <= 3, "AFGS1GrainScaleShift higher than 3"); }
+		else if (!strcasecmp(s, "AFGS1CbMult"))                { par->afgs1.cb_mult = atoi(v); }
+		else if (!strcasecmp(s, "AFGS1CbLumaMult"))            { par->afgs1.cb_luma_mult = atoi(v); }
+		else if (!strcasecmp(s, "AFGS1CbOffset"))              { par->afgs1.cb_offset = atoi(v); }
+		else if (!strcasecmp(s, "AFGS1CrMult"))                { par->afgs1.cr_mult = atoi(v); }
+		else if (!strcasecmp(s, "AFGS1CrLumaMult"))            { par->afgs1.cr_luma_mult = atoi(v); }
+		else if (!strcasecmp(s, "AFGS1CrOffset"))              { par->afgs1.cr_offset = atoi(v); }
+		else if (!strcasecmp(s, "AFGS1OverlapFlag"))           { par->afgs1.overlap_flag = atoi(v); }
+		else if (!strcasecmp(s, "AFGS1ClipToRestrictedRange")) { par->afgs1.clip_to_restricted_range = atoi(v); }
+
+		else cnt2 ++;
+	}
+	err = cnt1 <= cnt2;
+	if (err)
+		fprintf(stderr, "Error: could not ready anything from configuration file\n");
+
+	if (!err && par->nsei > 1)
+	{
+		// FGC SEIs are counted in decoding order: output order needs the
+		// picture order counts of decoder log lines, if any
+		err = !npics;
+		if (err)
+			fprintf(stderr, "Error: no decoded picture hash SEI in %s, can not tell which pictures its FGC SEIs apply to\n", filename);
+		else if (npoc)
+			err = dump_output_order(par, pics, npoc, npics, filename);
+		else
+			fprintf(stderr, "Warning: no POC line in %s, FGC SEIs are applied in decoding order (wrong with picture reordering)\n", filename);
+	}
+	free(pics);
+	if (err)
+		return 1;
+	if (par->nsei)
+		memcpy(&par->sei, &par->seis[0].sei, sizeof(fgs_sei));
+
+	return 0;
+}
+
+int vfgs_read_cfg(fgs_params* par, const char* filename)
+{
+	FILE* cfg;
+	int err;
+
+	cfg = fopen(filename, "rb");
+	if (!cfg)
+	{
+		printf("Can not open file %s\n\n", filename);
+		return 1;
+	}
+	if (vfgs_is_annexb(cfg))
+		err = vfgs_read_annexb(par, cfg, filename);
+	else if (vfgs_is_ivf(cfg))
+		err = vfgs_read_ivf(par, cfg, filename);
+	else
+	{
+		cfg = freopen(filename, "rt", cfg);
+		CHECK(cfg, "can not reopen file %s", filename);
+		err = read_cfg(par, cfg, filename);
+	}
+	fclose(cfg);
+
+	return err;
+}
+
+/** Read configuration from text (same syntax as configuration files) */
+int vfgs_read_cfg_text(fgs_params* par, const char* text)
+{
+	FILE* cfg;
+	int err;
+
+#ifdef _MSC_VER
+	// No fmemopen(): go through a temporary file
+	cfg = tmpfile();
+	CHECK(cfg, "can not create temporary file");
+	fputs(text, cfg);
+	rewind(cfg);
+#else
+	CHECK(*text, "empty inline parameters");
+	cfg = fmemopen((void*)text, strlen(text), "r");
+	CHECK(cfg, "can not read inline parameters");
+#endif
+	err = read_cfg(par, cfg, "inline parameters");
+	fclose(cfg);
+
+	return err;
+}
+
+/** Compare parameters (content, including grain table / SEI dump entries) */
+int vfgs_same_cfg(const fgs_params* a, const fgs_params* b)
+{
+	return !memcmp(&a->sei, &b->sei, sizeof(fgs_sei))
+	    && !memcmp(&a->afgs1, &b->afgs1, sizeof(fgs_afgs1))
+	    && a->ntbl == b->ntbl && a->tbl_frames == b->tbl_frames && (!a->ntbl || !memcmp(a->tbl, b->tbl, a->ntbl * sizeof(fgs_tbl_entry)))
+	    && a->nsei == b->nsei && (!a->nsei || !memcmp(a->seis, b->seis, a->nsei * sizeof(fgs_sei_entry)));
+}
+
+/** Free grain table / SEI dump entries */
+void vfgs_free_cfg(fgs_params* par)
+{
+	free(par->tbl);
+	par->tbl = NULL;
+	par->ntbl = 0;
+	par->tbl_frames = 0;
+	free(par->seis);
+	par->seis = NULL;
+	par->nsei = 0;
+}
+
+static void apply_gain_afgs1(fgs_afgs1* afgs1, unsigned gain)
+{
+	for(;gain>100; gain/=2)
+		afgs1->grain_scaling --;
+	for(;gain && gain<50; gain*=2)
+		afgs1->grain_scaling ++;
+
+	for (int i=0; i<afgs1->num_y_points; i++)
+		afgs1->point_y_scaling[i] = (uint8)((int)afgs1->point_y_scaling[i] * gain / 100);
+	for (int i=0; i<afgs1->num_cb_points; i++)
+		afgs1->point_cb_scaling[i] = (uint8)((int)afgs1->point_cb_scaling[i] * gain / 100);
+	for (int i=0; i<afgs1->num_cr_points; i++)
+		afgs1->point_cr_scaling[i] = (uint8)((int)afgs1->point_cr_scaling[i] * gain / 100);
+}
+
+static void apply_gain_sei(fgs_sei* sei, unsigned gain)
+{
+	for(;gain>100; gain/=2)
+		sei->log2_scale_factor --;
+	for(;gain && gain<50; gain*=2)
+		sei->log2_scale_factor ++;
+
+	for (int c=0; c<3; c++)
+		for (int i=0; sei->comp_model_present_flag[c] && i<sei->num_intensity_intervals[c]; i++)
+			sei->comp_model_value[c][i][0] = (int16)((int)sei->comp_model_value[c][i][0] * gain / 100);
+}
+
+void vfgs_apply_gain(fgs_params* par, unsigned gain)
+{
+	if (gain==100)
+		return;
+
+	if (par->afgs1.num_y_points || par->ntbl)
+	{
+		// AFGS1
+		apply_gain_afgs1(&par->afgs1, gain);
+		for (int k=0; k<par->ntbl; k++)
+			apply_gain_afgs1(&par->tbl[k].afgs1, gain);
+	}
+	else
+	{
+		// FGC SEI
+		apply_gain_sei(&par->sei, gain);
+		for (int k=0; k<par->nsei; k++)
+			apply_gain_sei(&par->seis[k].sei, gain);
+	}
+}
+
+void vfgs_init_params(fgs_params* par)
+{
+	if (par->afgs1.num_y_points || par->ntbl)
+		vfgs_init_afgs1(&par->afgs1);
+	else
+		vfgs_init_sei(&par->sei);
+}
+
+// Copy field f of s to d (same size: checked at compile time)
+#define COPY_FIELD(d, s, f) { (void)sizeof(char[sizeof((d)->f) == sizeof((s)->f) ? 1 : -1]); memcpy(&(d)->f, &(s)->f, sizeof((d)->f)); }
+
+/** FGC SEI parameters from the libvfgs API structure */
+void vfgs_sei_from_api(fgs_sei* sei, const vfgs_sei* s)
+{
+	COPY_FIELD(sei, s, model_id);
+	COPY_FIELD(sei, s, log2_scale_factor);
+	COPY_FIELD(sei, s, comp_model_present_flag);
+	COPY_FIELD(sei, s, num_intensity_intervals);
+	COPY_FIELD(sei, s, num_model_values);
+	COPY_FIELD(sei, s, intensity_interval_lower_bound);
+	COPY_FIELD(sei, s, intensity_interval_upper_bound);
+	COPY_FIELD(sei, s, comp_model_value);
+}
+
+/** FGC SEI parameters to the libvfgs API structure */
+void vfgs_sei_to_api(vfgs_sei* s, const fgs_sei* sei)
+{
+	COPY_FIELD(s, sei, model_id);
+	COPY_FIELD(s, sei, log2_scale_factor);
+	COPY_FIELD(s, sei, comp_model_present_flag);
+	COPY_FIELD(s, sei, num_intensity_intervals);
+	COPY_FIELD(s, sei, num_model_values);
+	COPY_FIELD(s, sei, intensity_interval_lower_bound);
+	COPY_FIELD(s, sei, intensity_interval_upper_bound);
+	COPY_FIELD(s, sei, comp_model_value);
+}
+
+/** AFGS1 parameters from the libvfgs API structure */
+void vfgs_afgs1_from_api(fgs_afgs1* afgs1, const vfgs_afgs1* s)
+{
+	COPY_FIELD(afgs1, s, grain_seed);
+	COPY_FIELD(afgs1, s, num_y_points);
+	COPY_FIELD(afgs1, s, point_y_values);
+	COPY_FIELD(afgs1, s, point_y_scaling);
+	COPY_FIELD(afgs1, s, chroma_scaling_from_luma);
+	COPY_FIELD(afgs1, s, num_cb_points);
+	COPY_FIELD(afgs1, s, point_cb_values);
+	COPY_FIELD(afgs1, s, point_cb_scaling);
+	COPY_FIELD(afgs1, s, num_cr_points);
+	COPY_FIELD(afgs1, s, point_cr_values);
+	COPY_FIELD(afgs1, s, point_cr_scaling);
+	COPY_FIELD(afgs1, s, grain_scaling);
+	COPY_FIELD(afgs1, s, ar_coeff_lag);
+	COPY_FIELD(afgs1, s, ar_coeffs_y);
+	COPY_FIELD(afgs1, s, ar_coeffs_cb);
+	COPY_FIELD(afgs1, s, ar_coeffs_cr);
+	COPY_FIELD(afgs1, s, ar_coeff_shift);
+	COPY_FIELD(afgs1, s, grain_scale_shift);
+	COPY_FIELD(afgs1, s, cb_mult);
+	COPY_FIELD(afgs1, s, cb_luma_mult);
+	COPY_FIELD(afgs1, s, cb_offset);
+	COPY_FIELD(afgs1, s, cr_mult);
+	COPY_FIELD(afgs1, s, cr_luma_mult);
+	COPY_FIELD(afgs1, s, cr_offset);
+	COPY_FIELD(afgs1, s, overlap_flag);
+	COPY_FIELD(afgs1, s, clip_to_restricted_range);
+}
@@ -0,0 +1,91 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VFGS_CFG_H_
+#define _VFGS_CFG_H_
+
+#include "vfgs_fw.h"
+#include "vfgs.h"
+#include <stdio.h>
+
+/** AFGS1 grain table entry (time stamps in 10 MHz ticks, or frame indices for AV1 bitstreams) */
+typedef struct fgs_tbl_entry_s {
+	long long start;
+	long long end;
+	uint8 apply;  // 0: no grain
+	uint8 update; // 0: same parameters as previous entry (new seed only)
+	fgs_afgs1 afgs1;
+} fgs_tbl_entry;
+
+/** FGC SEI dump entry */
+typedef struct fgs_sei_entry_s {
+	int poc;       // picture the SEI applies from (output order; decoding order for SEI dumps without POC lines)
+	uint8 apply;   // 0: cancel (no grain)
+	uint8 persist; // 0: current picture only
+	fgs_sei sei;
+} fgs_sei_entry;
+
+/** Film grain parameters, as read from a configuration file */
+typedef struct fgs_params_s {
+	fgs_sei sei;
+	fgs_afgs1 afgs1; // AFGS1 mode when afgs1.num_y_points != 0 or ntbl != 0, else FGC SEI mode
+	fgs_tbl_entry* tbl; // AFGS1 grain table (sorted by start time); afgs1 is a copy of 1st entry
+	int ntbl;
+	uint8 tbl_frames; // grain table times are frame indices (AV1 bitstream), else 10 MHz ticks
+	fgs_sei_entry* seis; // FGC SEIs of a SEI dump (in order); sei is a copy of 1st one
+	int nsei;
+} fgs_params;
+
+int  vfgs_read_cfg(fgs_params* par, const char* filename);
+int  vfgs_read_cfg_text(fgs_params* par, const char* text);
+int  vfgs_check_cfg(const fgs_params* par, int depth, int format);
+void vfgs_adjust_chroma_cfg(fgs_params* par, int format);
+void vfgs_apply_gain(fgs_params* par, unsigned gain);
+void vfgs_init_params(fgs_params* par);
+int  vfgs_same_cfg(const fgs_params* a, const fgs_params* b);
+void vfgs_free_cfg(fgs_params* par);
+
+/* Conversions from / to the libvfgs API structures (vfgs.h) */
+void vfgs_sei_from_api(fgs_sei* sei, const vfgs_sei* s);
+void vfgs_sei_to_api(vfgs_sei* s, const fgs_sei* sei);
+void vfgs_afgs1_from_api(fgs_afgs1* afgs1, const vfgs_afgs1* s);
+
+/* Used by bitstream readers */
+void vfgs_fill_model_array(int16 *x, int n, int model_id, int log2_scale_factor);
+int  vfgs_push_sei(fgs_params* par, int poc, int apply, int persist);
+
+#endif  // _VFGS_CFG_H_
+
@@ -293,6 +293,23 @@ static uint32 prng(uint32 x)
 	return x;
 }
 
+// Scale registers as last programmed by vfgs_init_xxx(), kept as reference for
+// vfgs_set_gain() (so that a gain change does not need a full re-init)
+static uint8 base_slut[3][256] = {0, };
+static int base_shift = 5;
+
+static void set_scale_lut(int c, uint8 lut[])
+{
+	memcpy(base_slut[c], lut, 256);
+	vfgs_set_scale_lut(c, lut);
+}
+
+static void set_scale_shift(int shift)
+{
+	base_shift = shift;
+	vfgs_set_scale_shift(shift);
+}
+
 /** Apply iDCT2 to block B[64][64] + clipping */
 static void idct2_64(int8 B[][64])
 {
@@ -501,10 +518,82 @@ static void vfgs_make_ar_pattern(const int8* buf0, int8 buf[], int8 P[], int siz
 			P[size*y+x] = buf[width*(3+6/suby+y) + (3+6/subx+x)];
 }
 
-static int same_pattern(fgs_sei* cfg, int32 a, int32 b)
+/** Make FGC SEI pattern for component c (luma or chroma) and register it at index i */
+static void make_sei_pattern(int c, int i, int model_id, int log2_scale_factor, const int16* coef)
+{
+	int8 P[64*64];
+	int8 buf[73*82];
+
+	if (c==0)
+	{
+		if (model_id)
+			vfgs_make_ar_pattern(NULL, buf, P, 64, coef, 6, 1, log2_scale_factor, Seed_LUT[0]);
+		else
+			vfgs_make_sei_ff_pattern64((int8 (*)[64])P, coef[1], coef[2]);
+
+		vfgs_set_luma_pattern(i, P);
+	}
+	else
+	{
+		// Note: no cross-component coefficient in SEI.AR mode, so no luma buffer needed
+		if (model_id)
+			vfgs_make_ar_pattern(NULL, buf, P, 32, coef, 6, 1, log2_scale_factor, Seed_LUT[1]);
+		else
+			vfgs_make_sei_ff_pattern32((int8 (*)[32])P, coef[1], coef[2]);
+
+		vfgs_set_chroma_pattern(i, P);
+	}
+}
+
+// Lazy mode (FGC SEI only): vfgs_init_sei() leaves patterns pending, and they
+// are only made by vfgs_make_pending_patterns() once a picture actually uses them
+static int lazy = 0;
+static int lazy_pending = 0; // number of pending patterns
+static struct {
+	uint8 pending;
+	int16 coef[SEI_MAX_MODEL_VALUES];
+} lazy_pattern[2][VFGS_MAX_PATTERNS];
+static uint8 lazy_model_id;
+static uint8 lazy_log2_scale_factor;
+static uint8 lazy_plut[3][256];
+
+static void clear_pending_patterns()
+{
+	memset(lazy_pattern, 0, sizeof(lazy_pattern));
+	lazy_pending = 0;
+}
+
+/** Enable/disable lazy pattern generation (applies from next vfgs_init_sei) */
+void vfgs_set_lazy_patterns(int enable)
 {
-	int16* coef_a = &cfg->comp_model_value[0][0][0] + a;
-	int16* coef_b = &cfg->comp_model_value[0][0][0] + b;
+	lazy = enable;
+}
+
+/** Make pending patterns used by a picture (lazy mode)
+ *
+ * hist[c][k] is the number of samples of component c with 8-bit intensity k
+ * (i.e. the pattern LUT input); patterns never selected are left pending.
+ */
+void vfgs_make_pending_patterns(const unsigned hist[3][256])
+{
+	for (int c=0; c<3 && lazy_pending; c++)
+		for (int k=0; k<256 && lazy_pending; k++)
+		{
+			int i = lazy_plut[c][k] >> 4;
+
+			if (hist[c][k] && lazy_pattern[c?1:0][i].pending)
+			{
+				make_sei_pattern(c, i, lazy_model_id, lazy_log2_scale_factor, lazy_pattern[c?1:0][i].coef);
+				lazy_pattern[c?1:0][i].pending = 0;
+				lazy_pending --;
+			}
+		}
+}
+
+static int same_pattern(const fgs_sei* cfg, int32 a, int32 b)
+{
+	const int16* coef_a = &cfg->comp_model_value[0][0][0] + a;
+	const int16* coef_b = &cfg->comp_model_value[0][0][0] + b;
 
 	for (int i=1; i<SEI_MAX_MODEL_VALUES; i++)
 		if (coef_a[i] != coef_b[i])
@@ -513,134 +602,153 @@ static int same_pattern(fgs_sei* cfg, int32 a, int32 b)
 	return 1;
 }
 
-/** Initialize "hardware" interface from FGC SEI message */
-void vfgs_init_sei(fgs_sei* cfg)
+/** Look for different patterns of luma (c=0) or chroma (c=1: both chroma
+ * components), up to max supported number; returns their number */
+static uint8 find_patterns(const fgs_sei* cfg, int c, uint32 patterns[VFGS_MAX_PATTERNS])
 {
-	int8 P[64*64];
-	int8 Lbuf[73*82];
-	int8 Cbuf[38*44];
-	uint8 slut[256];
-	uint8 plut[256];
 	uint8 intensities[VFGS_MAX_PATTERNS];
-	uint32 patterns[VFGS_MAX_PATTERNS];
 	uint8 np = 0; // number of patterns
-	uint8 a, b, i;
-	int   c, k;
+	uint8 a, i;
 
-	for (c=0; c<3; c++)
+	memset(intensities, 0, sizeof(intensities));
+	memset(patterns, ~0, VFGS_MAX_PATTERNS * sizeof(uint32));
+	for (int cc=c; cc<=2*c; cc++)
 	{
-		memset(slut, 0, sizeof(slut));
-		if (c<2)
+		if (!cfg->comp_model_present_flag[cc])
+			continue;
+		for (int k=0; k<cfg->num_intensity_intervals[cc]; k++)
 		{
-			np = 0;
-			memset(intensities, 0, sizeof(intensities));
-			memset(patterns, ~0, sizeof(patterns));
-		}
-		// 1. Look for different patterns, up to max supported number
-		if (cfg->comp_model_present_flag[c])
-		{
-			for (k=0; k<cfg->num_intensity_intervals[c]; k++)
-			{
-				a  = cfg->intensity_interval_lower_bound[c][k];
-				uint32 id = SEI_MAX_MODEL_VALUES*(k + 256*c);
+			a  = cfg->intensity_interval_lower_bound[cc][k];
+			uint32 id = SEI_MAX_MODEL_VALUES*(k + 256*cc);
 
-				for (i=0; i<VFGS_MAX_PATTERNS; i++)
-					if (same_pattern(cfg, patterns[i], id))
-						break;
+			for (i=0; i<VFGS_MAX_PATTERNS; i++)
+				if (same_pattern(cfg, patterns[i], id))
+					break;
 
-				if (i==VFGS_MAX_PATTERNS && np < VFGS_MAX_PATTERNS) // can add it
+			if (i==VFGS_MAX_PATTERNS && np < VFGS_MAX_PATTERNS) // can add it
+			{
+				// keep them sorted (by intensity). The goal of this sort is
+				// to enable meaningful pattern interpolation
+				for (i=np; i>0; i--)
 				{
-					// keep them sorted (by intensity). The goal of this sort is
-					// to enable meaningful pattern interpolation
-					for (i=np; i>0; i--)
+					if (intensities[i-1] > a)
 					{
-						if (intensities[i-1] > a)
-						{
-							intensities[i] = intensities[i-1];
-							patterns[i] = patterns[i-1];
-						}
-						else
-							break;
+						intensities[i] = intensities[i-1];
+						patterns[i] = patterns[i-1];
 					}
-					intensities[i] = a;
-					patterns[i] = id;
-					np ++;
+					else
+						break;
 				}
+				intensities[i] = a;
+				patterns[i] = id;
+				np ++;
 			}
 		}
-		if (c==0 || c==2)
-		{
-			// 2. Register the patterns (with correct order)
-			for (i=0; i<np; i++)
-			{
-				int16* coef = &cfg->comp_model_value[0][0][0] + patterns[i];
+	}
+	return np;
+}
 
-				if (c==0)
-				{
-					if (cfg->model_id)
-						vfgs_make_ar_pattern(NULL, Lbuf, P, 64, coef, 6, 1, cfg->log2_scale_factor, Seed_LUT[0]);
-					else
-						vfgs_make_sei_ff_pattern64((int8 (*)[64])P, coef[1], coef[2]);
+// Configuration the hardware was last programmed from, when known to the
+// caller (vfgs_update_sei): patterns it already holds are not made again
+static const fgs_sei* sei_prev = NULL;
 
-					vfgs_set_luma_pattern(i, P);
-				}
-				else if (c==2)
-				{
-					if (cfg->model_id)
-						vfgs_make_ar_pattern(Lbuf, Cbuf, P, 32, coef, 6, 1, cfg->log2_scale_factor, Seed_LUT[1]);
-					else
-						vfgs_make_sei_ff_pattern32((int8 (*)[32])P, coef[1], coef[2]);
+/** Initialize "hardware" interface from FGC SEI message */
+void vfgs_init_sei(fgs_sei* cfg)
+{
+	uint8 slut[256];
+	uint8 plut[256];
+	uint32 patterns[VFGS_MAX_PATTERNS];
+	uint32 prev_patterns[VFGS_MAX_PATTERNS];
+	uint8 np, prev_np = 0; // number of patterns
+	uint8 a, b, i;
+	int   c, k;
 
-					vfgs_set_chroma_pattern(i, P);
-				}
+	clear_pending_patterns();
+	lazy_model_id = cfg->model_id;
+	lazy_log2_scale_factor = cfg->log2_scale_factor;
+
+	for (c=0; c<3; c += c ? 1 : 2)
+	{
+		memset(slut, 0, sizeof(slut));
+		// 1. Look for different patterns
+		np = find_patterns(cfg, c ? 1 : 0, patterns);
+		if (sei_prev)
+			prev_np = find_patterns(sei_prev, c ? 1 : 0, prev_patterns);
+		// 2. Register the patterns (with correct order)
+		for (i=0; i<np; i++)
+		{
+			int16* coef = &cfg->comp_model_value[0][0][0] + patterns[i];
+
+			// Unchanged (made from the same model values)
+			if (i < prev_np && sei_prev->model_id == cfg->model_id && sei_prev->log2_scale_factor == cfg->log2_scale_factor &&
+			    !memcmp(&sei_prev->comp_model_value[0][0][0] + prev_patterns[i] + 1, coef + 1, (SEI_MAX_MODEL_VALUES - 1) * sizeof(int16)))
+				continue;
+			if (lazy)
+			{
+				memcpy(lazy_pattern[c?1:0][i].coef, coef, sizeof(lazy_pattern[0][0].coef));
+				lazy_pattern[c?1:0][i].pending = 1;
+				lazy_pending ++;
 			}
-			// 3. Fill up LUTs
-			for (int cc=min(c,1); cc<=c; cc++)
+			else
+				make_sei_pattern(c, i, cfg->model_id, cfg->log2_scale_factor, coef);
+		}
+		// 3. Fill up LUTs
+		for (int cc=min(c,1); cc<=c; cc++)
+		{
+			if (cfg->comp_model_present_flag[cc])
 			{
-				if (cfg->comp_model_present_flag[cc])
+				memset(plut, 255, sizeof(plut));
+				// 3a. Fill valid patterns
+				for (k=0; k<cfg->num_intensity_intervals[cc]; k++)
 				{
-					memset(plut, 255, sizeof(plut));
-					// 3a. Fill valid patterns
-					for (k=0; k<cfg->num_intensity_intervals[cc]; k++)
-					{
-						a = cfg->intensity_interval_lower_bound[cc][k];
-						b = cfg->intensity_interval_upper_bound[cc][k];
-						uint32 id = SEI_MAX_MODEL_VALUES*(k + 256*cc);
-
-						for (i=0; i<VFGS_MAX_PATTERNS; i++)
-							if (same_pattern(cfg, patterns[i], id))
-								break;
-						// Note: if not found, could try to find interpolation value
-
-						for (int l=a; l<=b; l++)
-						{
-							slut[l] = (uint8)cfg->comp_model_value[cc][k][0];
-							if (i<VFGS_MAX_PATTERNS)
-								plut[l] = i << 4;
-						}
-					}
-					// 3b. Fill holes (no interp. yet, just repeat last)
-					i = 0;
-					for (k=0; k<256; k++)
+					a = cfg->intensity_interval_lower_bound[cc][k];
+					b = cfg->intensity_interval_upper_bound[cc][k];
+					uint32 id = SEI_MAX_MODEL_VALUES*(k + 256*cc);
+
+					for (i=0; i<VFGS_MAX_PATTERNS; i++)
+						if (same_pattern(cfg, patterns[i], id))
+							break;
+					// Note: if not found, could try to find interpolation value
+
+					for (int l=a; l<=b; l++)
 					{
-						if (plut[k]==255)
-							plut[k] = i;
-						else
-							i = plut[k];
+						slut[l] = (uint8)cfg->comp_model_value[cc][k][0];
+						if (i<VFGS_MAX_PATTERNS)
+							plut[l] = i << 4;
 					}
 				}
-				else
+				// 3b. Fill holes (no interp. yet, just repeat last)
+				i = 0;
+				for (k=0; k<256; k++)
 				{
-					memset(plut, 0, sizeof(plut));
+					if (plut[k]==255)
+						plut[k] = i;
+					else
+						i = plut[k];
 				}
-				// 3c. Register LUTs
-				vfgs_set_scale_lut(cc, slut);
-				vfgs_set_pattern_lut(cc, plut);
 			}
+			else
+			{
+				memset(plut, 0, sizeof(plut));
+			}
+			// 3c. Register LUTs
+			set_scale_lut(cc, slut);
+			vfgs_set_pattern_lut(cc, plut);
+			memcpy(lazy_plut[cc], plut, sizeof(plut));
 		}
 	}
 
-	vfgs_set_scale_shift(cfg->log2_scale_factor - (cfg->model_id ? 1 : 0)); // -1 for grain shift in pattern generation (see above)
+	set_scale_shift(cfg->log2_scale_factor - (cfg->model_id ? 1 : 0)); // -1 for grain shift in pattern generation (see above)
+}
+
+/** Reprogram from FGC SEI message, the hardware holding the configuration
+ * programmed from prev (not in lazy mode): only patterns whose model values
+ * changed are made again, e.g. on an interval cutoff or gain change */
+void vfgs_update_sei(const fgs_sei* prev, fgs_sei* cfg)
+{
+	sei_prev = prev;
+	vfgs_init_sei(cfg);
+	sei_prev = NULL;
 }
 
 /* ****************************************************************************/
@@ -659,6 +767,12 @@ void vfgs_make_lut_piecewise_linear(uint8 lut[], const uint8 in[], const uint8 o
 	}
 }
 
+/** Reseed from AFGS1 grain_seed (e.g. new grain table entry with same parameters) */
+void vfgs_set_afgs1_seed(uint16 grain_seed)
+{
+	vfgs_set_seed(grain_seed | ((uint32)grain_seed << 16));
+}
+
 /** Initialize "hardware" interface from ITU-T T.35 AOM-registered metadata */
 void vfgs_init_afgs1(fgs_afgs1* cfg)
 {
@@ -668,18 +782,20 @@ void vfgs_init_afgs1(fgs_afgs1* cfg)
 	int8 Cbuf[38*44];
 	int n;
 
+	clear_pending_patterns(); // all patterns made below
+
 	// set seed
-	vfgs_set_seed(cfg->grain_seed | ((uint32)cfg->grain_seed << 16));
+	vfgs_set_afgs1_seed(cfg->grain_seed);
 
 	// make luts
 	vfgs_make_lut_piecewise_linear(lut, cfg->point_y_values, cfg->point_y_scaling, cfg->num_y_points);
-	vfgs_set_scale_lut(0, lut);
+	set_scale_lut(0, lut);
 	if (!cfg->chroma_scaling_from_luma)
 		vfgs_make_lut_piecewise_linear(lut, cfg->point_cb_values, cfg->point_cb_scaling, cfg->num_cb_points);
-	vfgs_set_scale_lut(1, lut);
+	set_scale_lut(1, lut);
 	if (!cfg->chroma_scaling_from_luma)
 		vfgs_make_lut_piecewise_linear(lut, cfg->point_cr_values, cfg->point_cr_scaling, cfg->num_cr_points);
-	vfgs_set_scale_lut(2, lut);
+	set_scale_lut(2, lut);
 
 	// make AR patterns
 	// note on grain_scale_shift:
@@ -700,10 +816,46 @@ void vfgs_init_afgs1(fgs_afgs1* cfg)
 	memset(lut, 1, sizeof(lut));
 	vfgs_set_pattern_lut(2, lut);
 
-	vfgs_set_scale_shift(cfg->grain_scaling - 6);
+	set_scale_shift(cfg->grain_scaling - 6);
 	vfgs_set_legal_range(cfg->clip_to_restricted_range);
 
 	// TODO: cb_mult/luma_mult/offset + same for cr
 	// TODO: overlap_flag (ignore ?)
 }
 
+/** Initialize "hardware" interface from a precompiled configuration (e.g. loaded state file) */
+void vfgs_init_cfg(const vfgs_hw_cfg* cfg)
+{
+	clear_pending_patterns();
+	memcpy(base_slut, cfg->sLUT, sizeof(base_slut));
+	base_shift = cfg->scale_shift + cfg->bs - 6;
+	vfgs_set_cfg(cfg);
+}
+
+
+/* ****************************************************************************/
+
+/** Apply a grain strength scale (in percent) on top of the current configuration
+ *
+ * Only the scale LUTs (and scale shift) are reprogrammed, from the values set by
+ * the last vfgs_init_xxx() call; grain patterns are left untouched. Same logic
+ * as the global gain: the shift absorbs powers of 2, to keep LUT precision.
+ */
+void vfgs_set_gain(unsigned gain)
+{
+	uint8 lut[256];
+	int shift = base_shift;
+
+	for(; gain>100 && shift>2; gain/=2)
+		shift --;
+	for(; gain && gain<50 && shift<7; gain*=2)
+		shift ++;
+
+	for (int c=0; c<3; c++)
+	{
+		for (int i=0; i<256; i++)
+			lut[i] = (uint8)min(255, (int)base_slut[c][i] * gain / 100);
+		vfgs_set_scale_lut(c, lut);
+	}
+	vfgs_set_scale_shift(shift);
+}
@@ -46,6 +46,8 @@
 #define uint8  unsigned char
 #endif
 
+#include "vfgs_hw.h"
+
 #define SEI_MAX_MODEL_VALUES 6
 
 typedef struct fgs_sei_s {
@@ -89,7 +91,13 @@ typedef struct fgs_afgs1_s {
 } fgs_afgs1;
 
 void vfgs_init_sei(fgs_sei* cfg);
+void vfgs_update_sei(const fgs_sei* prev, fgs_sei* cfg);
 void vfgs_init_afgs1(fgs_afgs1* cfg);
+void vfgs_set_afgs1_seed(uint16 grain_seed);
+void vfgs_init_cfg(const vfgs_hw_cfg* cfg);
+void vfgs_set_gain(unsigned gain);
+void vfgs_set_lazy_patterns(int enable);
+void vfgs_make_pending_patterns(const unsigned hist[3][256]);
 
 #endif  // _VFGS_FW_H_
 
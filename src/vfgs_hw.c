@@ -46,24 +46,30 @@
 
 // Note: declarations optimized for code readability; e.g. pattern storage in
 //       actual hardware implementation would differ significantly
-static int8 pattern[2][VFGS_MAX_PATTERNS+1][64][64] = {0, }; // +1 to simplify interpolation code
-static uint8 sLUT[3][256] = {0, };
-static uint8 pLUT[3][256] = {0, };
+static const vfgs_hw_cfg cfg_reset = { // power-on state
+	.scale_shift = 5+6,
+	.bs = 0,
+	.Y_min = 0,
+	.Y_max = 255,
+	.C_min = 0,
+	.C_max = 255,
+	.csubx = 2,
+	.csuby = 2,
+};
+static vfgs_hw_cfg cfg_mem;
+static const vfgs_hw_cfg* hw = &cfg_reset; // active configuration (external until modified, see vfgs_set_cfg)
 static uint32 rnd = 0xdeadbeef;
 static uint32 rnd_up = 0xdeadbeef;
 static uint32 line_rnd = 0xdeadbeef;
 static uint32 line_rnd_up = 0xdeadbeef;
-static uint8 scale_shift = 5+6;
-static uint8 bs = 0; // bitshift = bitdepth - 8
-static uint8 Y_min = 0;
-static uint8 Y_max = 255;
-static uint8 C_min = 0;
-static uint8 C_max = 255;
-static int csubx = 2;
-static int csuby = 2;
+
+// Frame buffer interface (sample layout, not part of the configuration memory)
+static uint8 cstep = 1; // chroma sample step (2: Cb/Cr interleaved)
+static uint8 sshift = 0; // 16-bit sample left shift (6: MSB-aligned 10-bit)
 
 
 // Processing pipeline (needs only 2 registers for each color actually, for horizontal deblocking)
+static int out_x0 = 0, out_x1 = 0; // columns output by add_grain_block() (whole blocks)
 static int16 grain[3][32]; // 9 bit needed because of overlap (has norm > 1)
 static uint8 scale[3][32];
 
@@ -78,6 +84,34 @@ static uint32 prng(uint32 x)
 	return x;
 }
 
+// prng() is linear over GF(2): n steps at once are a power of its 32x32 bit
+// matrix (m[i]: image of bit i)
+static uint32 prng_apply(const uint32 m[32], uint32 x)
+{
+	uint32 y = 0;
+	for (int i=0; x; i++, x>>=1)
+		if (x & 1)
+			y ^= m[i];
+	return y;
+}
+
+static uint32 prng_jump(uint32 x, unsigned n)
+{
+	uint32 m[32], t[32];
+
+	for (int i=0; i<32; i++)
+		m[i] = prng(1u << i);
+	for (; n; n>>=1)
+	{
+		if (n & 1)
+			x = prng_apply(m, x);
+		for (int i=0; i<32; i++)
+			t[i] = prng_apply(m, m[i]);
+		memcpy(m, t, sizeof(m));
+	}
+	return x;
+}
+
 /** Derive Y x/y offsets from (random) number
  *
  * Bit fields are designed to minimize overlaps across color channels, to
@@ -118,10 +152,10 @@ static void get_offset_u(uint32 val, int *s, uint8 *x, uint8 *y)
 	*s = ((val >> 2) & 1) ? -1 : 1;
 
 	bf = (val >> 10) & 0x3ff;
-	*x = ((bf * 13) >> 10) * (4/csubx);
+	*x = ((bf * 13) >> 10) * (4/hw->csubx);
 
 	bf = ((val >> 24) & 0x0ff) | ((val << 8) & 0x300);
-	*y = ((bf * 12) >> 10) * (4/csuby);
+	*y = ((bf * 12) >> 10) * (4/hw->csuby);
 }
 
 static void get_offset_v(uint32 val, int *s, uint8 *x, uint8 *y)
@@ -131,16 +165,21 @@ static void get_offset_v(uint32 val, int *s, uint8 *x, uint8 *y)
 	*s = ((val >> 15) & 1) ? -1 : 1;
 
 	bf = (val >> 20) & 0x3ff;
-	*x = ((bf * 13) >> 10) * (4/csubx);
+	*x = ((bf * 13) >> 10) * (4/hw->csubx);
 
 	bf = (val >> 4) & 0x3ff;
-	*y = ((bf * 12) >> 10) * (4/csuby);
+	*y = ((bf * 12) >> 10) * (4/hw->csuby);
 }
 
-static void add_grain_block(void* I, int c, int x, int y, int width)
+// Source samples S are read, and output to D (may be the same buffer); xs is
+// the first block of the line processed, and only blocks within [out_x0,
+// out_x1) are output
+static void add_grain_block(const void* S, void* D, int c, int x, int xs, int y, int width)
 {
-	uint8 *I8 = (uint8*)I;
-	uint16 *I16 = (uint16*)I;
+	const uint8 *S8 = (const uint8*)S;
+	const uint16 *S16 = (const uint16*)S;
+	uint8 *D8 = (uint8*)D;
+	uint16 *D16 = (uint16*)D;
 
 	int s, s_up;         // random sign flip (current + upper row)
 	uint8 ox, oy;        // random offset (current)
@@ -156,18 +195,19 @@ static void add_grain_block(void* I, int c, int x, int y, int width)
 
 	uint8 intensity;
 	int flush = 0;
-	int subx = c ? csubx : 1;
-	int suby = c ? csuby : 1;
-	uint8 I_min = c ? C_min : Y_min;
-	uint8 I_max = c ? C_max : Y_max;
+	int subx = c ? hw->csubx : 1;
+	int suby = c ? hw->csuby : 1;
+	int step = c ? cstep : 1;
+	uint8 I_min = c ? hw->C_min : hw->Y_min;
+	uint8 I_max = c ? hw->C_max : hw->Y_max;
 
 	if ((y & 1) && suby > 1)
 		return;
 
 	assert(!(x & 15));
 	assert(width > 128);
-	assert(bs == 0 || bs == 2);
-	assert(scale_shift + bs >= 8 && scale_shift + bs <= 13);
+	assert(hw->bs == 0 || hw->bs == 2);
+	assert(hw->scale_shift + hw->bs >= 8 && hw->scale_shift + hw->bs <= 13);
 	// TODO: assert subx, suby, Y/C min/max, max pLUT values, etc
 
 	j = y & 0xf;
@@ -208,23 +248,23 @@ static void add_grain_block(void* I, int c, int x, int y, int width)
 	// Make grain pattern
 	for (i=0; i<16/subx; i++)
 	{
-		intensity = bs ? I16[x/subx+i] >> bs : I8[x/subx+i];
-		pi = pLUT[c][intensity] >> 4; // pattern index (integer part)
+		intensity = hw->bs ? S16[(x/subx+i)*step] >> (hw->bs + sshift) : S8[(x/subx+i)*step];
+		pi = hw->pLUT[c][intensity] >> 4; // pattern index (integer part)
 #if PATTERN_INTERPOLATION
-		pf = pLUT[c][intensity] & 15; // fractional part (interpolate with next) -- could restrict to less bits (e.g. 2)
+		pf = hw->pLUT[c][intensity] & 15; // fractional part (interpolate with next) -- could restrict to less bits (e.g. 2)
 #endif
 
 		// Pattern
-		P  = pattern[c?1:0][pi  ][oy][ox + i] * s; // We could consider just XORing the sign bit
+		P  = hw->pattern[c?1:0][pi  ][oy][ox + i] * s; // We could consider just XORing the sign bit
 #if PATTERN_INTERPOLATION
-		Pn = pattern[c?1:0][pi+1][oy][ox + i] * s; // But there are equivalent hw tricks, e.g. storing values as sign + amplitude instead of two's complement
+		Pn = hw->pattern[c?1:0][pi+1][oy][ox + i] * s; // But there are equivalent hw tricks, e.g. storing values as sign + amplitude instead of two's complement
 #endif
 
 		if (oc1) // overlap
 		{
-			P  = round(P  * oc1 + pattern[c?1:0][pi  ][oy_up][ox_up + i] * oc2 * s_up, 5);
+			P  = round(P  * oc1 + hw->pattern[c?1:0][pi  ][oy_up][ox_up + i] * oc2 * s_up, 5);
 #if PATTERN_INTERPOLATION
-			Pn = round(Pn * oc1 + pattern[c?1:0][pi+1][oy_up][ox_up + i] * oc2 * s_up, 5);
+			Pn = round(Pn * oc1 + hw->pattern[c?1:0][pi+1][oy_up][ox_up + i] * oc2 * s_up, 5);
 #endif
 		}
 
@@ -236,13 +276,13 @@ static void add_grain_block(void* I, int c, int x, int y, int width)
 #endif
 
 		// Scale sign already integrated above because of overlap
-		scale[c][16/subx+i] = sLUT[c][intensity];
+		scale[c][16/subx+i] = hw->sLUT[c][intensity];
 	}
 
 	// Scale & output
 	do
 	{
-		if (x > 0)
+		if (x > xs)
 		{
 			int32 g;
 			int16 l1, l0, r0, r1;
@@ -257,14 +297,15 @@ static void add_grain_block(void* I, int c, int x, int y, int width)
 				grain[c][16/subx -1] = round(l1 + 3*l0 + r0, 2);
 				grain[c][16/subx +0] = round(l0 + 3*r0 + r1, 2);
 			}
-			for (i=0; i<16/subx; i++)
+			for (i=0; i<16/subx && x-16 >= out_x0 && x-16 < out_x1; i++)
 			{
 				// Output previous block (or flush current)
-				g = round(scale[c][i] * (int16)grain[c][i], scale_shift);
-				if (bs)
-					I16[(x-16)/subx+i] = max(I_min<<bs, min(I_max<<bs, I16[(x-16)/subx+i] + g));
+				int k = ((x-16)/subx+i)*step;
+				g = round(scale[c][i] * (int16)grain[c][i], hw->scale_shift);
+				if (hw->bs)
+					D16[k] = max(I_min<<hw->bs, min(I_max<<hw->bs, (S16[k] >> sshift) + g)) << sshift;
 				else
-					I8[(x-16)/subx+i] = max(I_min, min(I_max, I8[(x-16)/subx+i] + g));
+					D8[k] = max(I_min, min(I_max, S8[k] + g));
 			}
 		}
 
@@ -283,10 +324,77 @@ static void add_grain_block(void* I, int c, int x, int y, int width)
 	} while (flush == 1);
 }
 
+// Output the blocks within [out_x0, out_x1) of source samples S to D with no
+// grain (all scales are zero): samples are only clipped, as add_grain_block()
+// would
+static void clip_blocks(const void* S, void* D, int c, int y)
+{
+	const uint8 *S8 = (const uint8*)S;
+	const uint16 *S16 = (const uint16*)S;
+	uint8 *D8 = (uint8*)D;
+	uint16 *D16 = (uint16*)D;
+	int subx = c ? hw->csubx : 1;
+	int suby = c ? hw->csuby : 1;
+	int step = c ? cstep : 1;
+	int I_min = (c ? hw->C_min : hw->Y_min) << hw->bs;
+	int I_max = (c ? hw->C_max : hw->Y_max) << hw->bs;
+
+	if ((y & 1) && suby > 1)
+		return;
+
+	for (int x=out_x0; x<out_x1; x+=16)
+		for (int i=0; i<16/subx; i++)
+		{
+			int k = (x/subx+i)*step;
+			if (hw->bs)
+				D16[k] = max(I_min, min(I_max, S16[k] >> sshift)) << sshift;
+			else
+				D8[k] = max(I_min, min(I_max, S8[k]));
+		}
+}
+
+// Tell whether some scale is not zero (grain is made)
+static int grain_scaled()
+{
+	for (int c=0; c<3; c++)
+		for (int i=0; i<256; i++)
+			if (hw->sLUT[c][i])
+				return 1;
+	return 0;
+}
+
 /* Public interface ***********************************************************/
 
-void vfgs_add_grain_line(void* Y, void* U, void* V, int y, int width)
+/** Get writable configuration memory (copy external configuration first, if any) */
+static vfgs_hw_cfg* cfg()
 {
+	if (hw != &cfg_mem)
+	{
+		memcpy(&cfg_mem, hw, sizeof(cfg_mem));
+		hw = &cfg_mem;
+	}
+	return &cfg_mem;
+}
+
+/** Add grain to source rows sY, sU, sV of picture row y, output to rows Y, U,
+ * V (the source is left untouched, unless the same) */
+void vfgs_add_grain_line_from(void* Y, void* U, void* V, const void* sY, const void* sU, const void* sV, int y, int width)
+{
+	vfgs_add_grain_line_part(Y, U, V, sY, sU, sV, y, width, 0, width);
+}
+
+/** Same, only output to the blocks covering columns [x0, x0 + w): random
+ * generator is jumped to the block left of them (made for deblocking, as is
+ * the block right of them), so that samples are the same as with the whole
+ * row */
+void vfgs_add_grain_line_part(void* Y, void* U, void* V, const void* sY, const void* sU, const void* sV, int y, int width, int x0, int w)
+{
+	int xs = max(0, (x0 & ~15) - 16);                // first block made
+	int xe = min(width, ((x0 + w + 15) & ~15) + 16); // end of last one
+
+	out_x0 = x0 & ~15;
+	out_x1 = min(width, (x0 + w + 15) & ~15);
+
 	// Generate / backup / restore per-line random seeds (needed to make multi-line blocks)
 	if (y && (y & 0x0f) == 0)
 	{
@@ -296,44 +404,122 @@ void vfgs_add_grain_line(void* Y, void* U, void* V, int y, int width)
 	}
 	rnd_up = line_rnd_up;
 	rnd = line_rnd;
+	if (xs)
+	{
+		rnd = prng_jump(rnd, xs / 16);
+		rnd_up = prng_jump(rnd_up, xs / 16);
+	}
 
-	// Process line
-	for (int x=0; x<width; x+=16)
+	// Process line (no grain: only clip samples, and crank random generator
+	// past the blocks)
+	if (!grain_scaled())
+	{
+		clip_blocks(sY, Y, 0, y);
+		clip_blocks(sU, U, 1, y);
+		clip_blocks(sV, V, 2, y);
+		for (int x=xs; x<xe; x+=16)
+		{
+			rnd = prng(rnd);
+			rnd_up = prng(rnd_up);
+		}
+	}
+	else for (int x=xs; x<xe; x+=16)
 	{
 		// Process pixels for each color component
-		add_grain_block(Y, 0, x, y, width);
-		add_grain_block(U, 1, x, y, width);
-		add_grain_block(V, 2, x, y, width);
+		add_grain_block(sY, Y, 0, x, xs, y, width);
+		add_grain_block(sU, U, 1, x, xs, y, width);
+		add_grain_block(sV, V, 2, x, xs, y, width);
 
 		// Crank random generator
 		rnd = prng(rnd);
 		rnd_up = prng(rnd_up); // upper block (overlapping)
 	}
+
+	// End of line state, for the next line of blocks
+	if (xe < width && (y & 0x0f) == 0x0f)
+		rnd = prng_jump(line_rnd, (width + 15) / 16);
+}
+
+/** Add grain to rows Y, U, V of picture row y, in place */
+void vfgs_add_grain_line(void* Y, void* U, void* V, int y, int width)
+{
+	vfgs_add_grain_line_from(Y, U, V, Y, U, V, y, width);
+}
+
+/** Advance random generator past a frame, as vfgs_add_grain_line() would,
+ * without processing any sample */
+void vfgs_skip_frame(int width, int height)
+{
+	int n = (height - 1) / 16; // block rows after the first one
+	int steps = (width + 15) / 16; // per block row
+
+	if (n > 0)
+	{
+		line_rnd_up = prng_jump(line_rnd, steps * (n - 1));
+		line_rnd = prng_jump(line_rnd_up, steps);
+	}
+	rnd = line_rnd;
+	rnd_up = line_rnd_up;
+}
+
+/** Jump random generator from the start of a frame to picture row y, as if
+ * rows above had been processed */
+void vfgs_jump_rows(int y, int width)
+{
+	int n = y / 16; // block rows above
+	int steps = (width + 15) / 16; // per block row
+
+	if (y & 0x0f) // within block row n
+	{
+		if (n > 0)
+		{
+			line_rnd_up = prng_jump(line_rnd, steps * (n - 1));
+			line_rnd = prng_jump(line_rnd_up, steps);
+		}
+	}
+	else if (n > 0) // at end of row y - 1
+	{
+		if (n > 1)
+		{
+			line_rnd_up = prng_jump(line_rnd, steps * (n - 2));
+			line_rnd = prng_jump(line_rnd_up, steps);
+		}
+		rnd = prng_jump(line_rnd, steps);
+	}
+}
+
+/** Tell whether vfgs_add_grain_line() may change samples: some scale is not
+ * zero, or samples are clipped below full range (restricted range, or above
+ * 8 bits, where the upper bound is 255 << bs) */
+int vfgs_grain_active()
+{
+	return grain_scaled() || hw->bs || hw->Y_min > 0 || hw->Y_max < 255 || hw->C_min > 0 || hw->C_max < 255;
 }
 
 void vfgs_set_luma_pattern(int index, int8* P)
 {
 	assert(index >= 0 && index < 8);
-	memcpy(pattern[0][index], P, 64*64);
+	memcpy(cfg()->pattern[0][index], P, 64*64);
 }
 
 void vfgs_set_chroma_pattern(int index, int8 *P)
 {
+	vfgs_hw_cfg* c = cfg();
 	assert(index >= 0 && index < 8);
-	for (int i=0; i<64/csuby; i++)
-		memcpy(pattern[1][index][i], P + (64/csuby)*i, 64/csubx);
+	for (int i=0; i<64/c->csuby; i++)
+		memcpy(c->pattern[1][index][i], P + (64/c->csuby)*i, 64/c->csubx);
 }
 
 void vfgs_set_scale_lut(int c, uint8 lut[])
 {
 	assert(c>=0 && c<3);
-	memcpy(sLUT[c], lut, 256);
+	memcpy(cfg()->sLUT[c], lut, 256);
 }
 
 void vfgs_set_pattern_lut(int c, uint8 lut[])
 {
 	assert(c>=0 && c<3);
-	memcpy(pLUT[c], lut, 256);
+	memcpy(cfg()->pLUT[c], lut, 256);
 }
 
 void vfgs_set_seed(uint32 seed)
@@ -345,45 +531,97 @@ void vfgs_set_seed(uint32 seed)
 
 void vfgs_set_scale_shift(int shift)
 {
+	vfgs_hw_cfg* c = cfg();
 	assert(shift >= 2 && shift < 8);
-	scale_shift = shift + 6 - bs;
+	c->scale_shift = shift + 6 - c->bs;
 }
 
 void vfgs_set_depth(int depth)
 {
+	vfgs_hw_cfg* c = cfg();
 	assert(depth==8 || depth==10);
 
-	if (bs==0 && depth>8)
-		scale_shift -= 2;
-	if (bs==2 && depth==8)
-		scale_shift += 2;
+	if (c->bs==0 && depth>8)
+		c->scale_shift -= 2;
+	if (c->bs==2 && depth==8)
+		c->scale_shift += 2;
 
-	bs = depth - 8;
+	c->bs = depth - 8;
 }
 
 void vfgs_set_legal_range(int legal)
 {
+	vfgs_hw_cfg* c = cfg();
 	if (legal)
 	{
-		Y_min = 16;
-		Y_max = 235;
-		C_min = 16;
-		C_max = 240;
+		c->Y_min = 16;
+		c->Y_max = 235;
+		c->C_min = 16;
+		c->C_max = 240;
 	}
 	else
 	{
-		Y_min = 0;
-		Y_max = 255;
-		C_min = 0;
-		C_max = 255;
+		c->Y_min = 0;
+		c->Y_max = 255;
+		c->C_min = 0;
+		c->C_max = 255;
 	}
 }
 
 void vfgs_set_chroma_subsampling(int subx, int suby)
 {
+	vfgs_hw_cfg* c = cfg();
 	assert(subx==1 || subx==2);
 	assert(suby==1 || suby==2);
-	csubx = subx;
-	csuby = suby;
+	c->csubx = subx;
+	c->csuby = suby;
+}
+
+/** Set frame buffer sample layout: chroma sample step (1, or 2 for
+ * interleaved Cb/Cr, with V pointing to the first Cr sample), and left shift
+ * of 16-bit samples (0, or 6 for MSB-aligned 10-bit samples) */
+void vfgs_set_sample_layout(int chroma_step, int shift)
+{
+	assert(chroma_step==1 || chroma_step==2);
+	assert(shift==0 || shift==6);
+	cstep = chroma_step;
+	sshift = shift;
 }
 
+/** Use an external configuration memory (e.g. a memory-mapped file)
+ *
+ * The external memory is only read; subsequent vfgs_set_xxx calls first copy
+ * it to the internal configuration memory, and then modify that copy.
+ */
+void vfgs_set_cfg(const vfgs_hw_cfg* ext)
+{
+	hw = ext;
+}
+
+const vfgs_hw_cfg* vfgs_get_cfg()
+{
+	return hw;
+}
+
+/** Reset configuration memory, random generator and frame buffer interface
+ * to their power-on state */
+void vfgs_reset()
+{
+	hw = &cfg_reset;
+	rnd = rnd_up = line_rnd = line_rnd_up = 0xdeadbeef;
+	cstep = 1;
+	sshift = 0;
+}
+
+/** Save/restore random generator state (per-line seeds, current + upper row) */
+void vfgs_get_prng(uint32 state[2])
+{
+	state[0] = line_rnd;
+	state[1] = line_rnd_up;
+}
+
+void vfgs_set_prng(const uint32 state[2])
+{
+	rnd = line_rnd = state[0];
+	rnd_up = line_rnd_up = state[1];
+}
@@ -48,6 +48,21 @@
 
 #define VFGS_MAX_PATTERNS 8
 
+/** Configuration memories and registers, as programmed by the firmware */
+typedef struct vfgs_hw_cfg_s {
+	int8  pattern[2][VFGS_MAX_PATTERNS+1][64][64]; // +1 to simplify interpolation code
+	uint8 sLUT[3][256];
+	uint8 pLUT[3][256];
+	uint8 scale_shift;
+	uint8 bs; // bitshift = bitdepth - 8
+	uint8 Y_min;
+	uint8 Y_max;
+	uint8 C_min;
+	uint8 C_max;
+	uint8 csubx;
+	uint8 csuby;
+} vfgs_hw_cfg;
+
 void vfgs_set_luma_pattern(int index, int8* P);
 void vfgs_set_chroma_pattern(int index, int8 *P);
 void vfgs_set_scale_lut(int c, uint8 lut[]);
@@ -58,8 +73,20 @@ void vfgs_set_scale_shift(int shift);
 void vfgs_set_depth(int depth);
 void vfgs_set_legal_range(int legal);
 void vfgs_set_chroma_subsampling(int subx, int suby);
+void vfgs_set_sample_layout(int chroma_step, int shift);
+
+void vfgs_set_cfg(const vfgs_hw_cfg* ext);
+const vfgs_hw_cfg* vfgs_get_cfg();
+void vfgs_get_prng(uint32 state[2]);
+void vfgs_set_prng(const uint32 state[2]);
+void vfgs_reset();
 
 void vfgs_add_grain_line(void* Y, void* U, void* V, int y, int width);
+void vfgs_add_grain_line_from(void* Y, void* U, void* V, const void* sY, const void* sU, const void* sV, int y, int width);
+void vfgs_add_grain_line_part(void* Y, void* U, void* V, const void* sY, const void* sU, const void* sV, int y, int width, int x0, int w);
+void vfgs_skip_frame(int width, int height);
+void vfgs_jump_rows(int y, int width);
+int  vfgs_grain_active();
 
 #endif  // _VFGS_HW_H_
 
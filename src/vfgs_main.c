@@ -34,15 +34,25 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "vfgs.h"
+#include "vfgs_cfg.h"
 #include "vfgs_fw.h"
 #include "vfgs_hw.h"
+#include "vfgs_pipe.h"
+#include "vfgs_shm.h"
+#include "vfgs_serve.h"
+#include "vfgs_state.h"
 #include "yuv.h"
+#include "yuv_aio.h"
+#include "yuv_pool.h"
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <assert.h>
 
 #ifdef _MSC_VER
+#include <io.h>
+#include <fcntl.h>
 #define strcasecmp _stricmp
 #define strncasecmp _strnicmp
 #else
@@ -50,14 +60,16 @@
 #define max(a,b) ((a)>(b)?(a):(b))
 #endif
 
-#define DEFAULT_FREQ 8
 #define CHECK(cond, ...) { if (!(cond)) { fprintf(stderr, "Error: "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); return 1; } }
 
-#define MAX_CONFIGS 64
-
 // Program parameters
 static FILE* fsrc = NULL;
 static FILE* fdst = NULL;
+static const char* dst_name = NULL;
+static int y4m_in = 0; // input / output files are Y4M streams
+static int y4m_out = 0;
+static yuv_y4m y4m;    // input Y4M stream header
+static const char* index_file = NULL; // Y4M input frame offsets (--index)
 static int width = 1920;
 static int height = 1080;
 static int depth = 10;
@@ -65,629 +77,992 @@ static int odepth = 0;
 static int frames = 0;
 static int seek = 0;
 static int format = YUV_420;
-
-static fgs_sei sei = {
-	.model_id = 0,
-	.log2_scale_factor = 5,
-	.comp_model_present_flag = { 1, 1, 1 },
-	.num_intensity_intervals = { 8, 8, 8 },
-	.num_model_values = { 3, 3, 3 },
-	.intensity_interval_lower_bound = {
-		{  0, 40,  60,  80, 100, 120, 140, 160 },
-		{  0, 64,  96, 112, 128, 144, 160, 192 },
-		{  0, 64,  96, 112, 128, 144, 160, 192 }
-	},
-	.intensity_interval_upper_bound = {
-		{ 39, 59,  79,  99, 119, 139, 159, 255 },
-		{ 63, 95, 111, 127, 143, 159, 191, 255 },
-		{ 63, 95, 111, 127, 143, 159, 191, 255 }
-	},
-	.comp_model_value = {
-		// luma (scale / h / v)
-		{
-			{ 100,  7,  7 },
-			{ 100,  8,  8 },
-			{ 100,  9,  9 },
-			{ 110, 10, 10 },
-			{ 120, 11, 11 },
-			{ 135, 12, 12 },
-			{ 145, 13, 13 },
-			{ 180, 14, 14 },
-		},
-		// Cb
-		{
-			{ 128, 8, 8 },
-			{  96, 8, 8 },
-			{  64, 8, 8 },
-			{  64, 8, 8 },
-			{  64, 8, 8 },
-			{  64, 8, 8 },
-			{  96, 8, 8 },
-			{ 128, 8, 8 },
+static int layout = YUV_PLANAR;
+static int lazy = 0;
+static const char* state_in = NULL;
+static const char* state_out = NULL;
+static int fps_num = 24;
+static int fps_den = 1;
+static int fps_set = 0; // --fps given (else taken from Y4M input)
+static int pipeline = 0; // frame ring size in pipelined mode (0: serial)
+static int map_input = 0; // --mmap: frames are read-only views into input file mapping
+static int direct_io = 0; // --uring: asynchronous direct I/O
+static const char* shm_name = NULL; // --shm: frames exchanged through a shared-memory ring
+static int shm_slots = 4;
+static int strips = 0; // --strips: frames processed one block row at a time
+static int roi[4] = { 0, 0, 0, 0 }; // --roi: x, y, width, height (0 width: whole picture)
+static int cpus[64]; // --affinity: CPUs of pipeline stages (or of the serial loop)
+static int ncpus = 0;
+
+static fgs_params def = { // default configuration
+	.sei = {
+		.model_id = 0,
+		.log2_scale_factor = 5,
+		.comp_model_present_flag = { 1, 1, 1 },
+		.num_intensity_intervals = { 8, 8, 8 },
+		.num_model_values = { 3, 3, 3 },
+		.intensity_interval_lower_bound = {
+			{  0, 40,  60,  80, 100, 120, 140, 160 },
+			{  0, 64,  96, 112, 128, 144, 160, 192 },
+			{  0, 64,  96, 112, 128, 144, 160, 192 }
 		},
-		// Cr
-		{
-			{ 128, 8, 8 },
-			{  96, 8, 8 },
-			{  64, 8, 8 },
-			{  64, 8, 8 },
-			{  64, 8, 8 },
-			{  64, 8, 8 },
-			{  96, 8, 8 },
-			{ 128, 8, 8 },
+		.intensity_interval_upper_bound = {
+			{ 39, 59,  79,  99, 119, 139, 159, 255 },
+			{ 63, 95, 111, 127, 143, 159, 191, 255 },
+			{ 63, 95, 111, 127, 143, 159, 191, 255 }
 		},
+		.comp_model_value = {
+			// luma (scale / h / v)
+			{
+				{ 100,  7,  7 },
+				{ 100,  8,  8 },
+				{ 100,  9,  9 },
+				{ 110, 10, 10 },
+				{ 120, 11, 11 },
+				{ 135, 12, 12 },
+				{ 145, 13, 13 },
+				{ 180, 14, 14 },
+			},
+			// Cb
+			{
+				{ 128, 8, 8 },
+				{  96, 8, 8 },
+				{  64, 8, 8 },
+				{  64, 8, 8 },
+				{  64, 8, 8 },
+				{  64, 8, 8 },
+				{  96, 8, 8 },
+				{ 128, 8, 8 },
+			},
+			// Cr
+			{
+				{ 128, 8, 8 },
+				{  96, 8, 8 },
+				{  64, 8, 8 },
+				{  64, 8, 8 },
+				{  64, 8, 8 },
+				{  64, 8, 8 },
+				{  96, 8, 8 },
+				{ 128, 8, 8 },
+			},
+		}
+	},
+	.afgs1 = {
+		.num_y_points = 0,
+		// no other default values (default mode is SEI)
 	}
 };
 
-static fgs_afgs1 afgs1 = {
-	.num_y_points = 0,
-	// no other default values (default mode is SEI)
-};
+static fgs_params* par = &def; // active configuration
 
 static struct {
 	int poc;
-	const char* filename;
-} config[MAX_CONFIGS];
+	const char* filename; // configuration file, or NULL for inline parameters
+	char* text;           // inline parameters
+	fgs_params* par;      // parsed configuration
+} *config = NULL; // configuration schedule (sorted by POC once loaded)
 static int ncfg = 0;
 static int icfg = 0;
+static fgs_params** params = NULL; // distinct parsed configurations
+static int nparams = 0;
+static int itl = 0; // grain table / SEI dump entry of previous picture (-1: none)
+static int jtl = 0; // grain table / SEI dump entry currently programmed
+
+static struct {
+	int frame;
+	unsigned gain;
+} *curve = NULL; // gain automation keys
+static int ncurve = 0;
+static unsigned fgain = ~0u; // gain currently applied from curve (~0 = none)
+
+// Frame ring (single slot in serial mode)
+typedef struct frame_slot_s {
+	yuv buf;    // frame buffers (input bit depth)
+	yuv view;   // frame in input file mapping (--mmap, read-only)
+	yuv frame;  // current frame (buf or view)
+	yuv oframe; // output bit depth (same as frame if equal)
+	unsigned hist[3][256];
+	int poc;
+	long long ipos; // input file offset of a frame passed through (-1: none)
+} frame_slot;
+
+static frame_slot* slots = NULL;
+static int nslots = 0;
+static int nread = 0; // frames read so far
+static int read_err = 0;
+static yuv_map map; // mapped input file (--mmap)
+static yuv_aio* ain = NULL; // input / output streams (--uring)
+static yuv_aio* aout = NULL;
+static vfgs_shm* shm = NULL; // shared-memory frame ring (--shm)
+static int passthrough = 0; // grain-free frames may be copied from input to output file
+static int clipping = 0; // some AFGS1 configuration clips samples (also in later FGC SEI mode)
+static yuv whole;  // input / output frame geometry (--strips: slot buffers only hold a strip)
+static yuv owhole;
+static yuv_pool* pool = NULL; // slot frame buffers
+static yuv_pool* opool = NULL;
+static uint16* v210_line = NULL; // v210 row unpacked to planar lines (grain stage)
+
+// Extra renditions (--rendition): same source, patterns and random
+// generator as the output file, only another gain (scale LUTs) and bit depth
+#define MAX_RENDITIONS 16
+typedef struct rendition_s {
+	const char* name;
+	FILE* file;
+	unsigned gain; // percent, on top of --gain and --gain-curve
+	int odepth;
+	int y4m_out;
+} rendition;
+
+static rendition rends[MAX_RENDITIONS];
+static int nrends = 0;
+static yuv_pool* rpool = NULL; // rendition frame buffers
+static yuv_pool* ropool = NULL;
 
-static int read_array_i16(int16* x, char* s)
+static int read_format(const char* s)
 {
-	while (isdigit(*s) || *s=='-' || *s=='+')
-	{
-		*x++ = atoi(s);
-		while (isdigit(*s) || *s=='-' || *s=='+')
-			s++;
-		while (isblank(*s))
-			s++;
-	}
-	return 0;
+	if      (!strcasecmp(s, "444")) return YUV_444;
+	else if (!strcasecmp(s, "422")) return YUV_422;
+	else                            return YUV_420;
 }
 
-static int read_array_u8(uint8* x, char* s)
+static const char* format_str(int format)
 {
-	while (isdigit(*s))
-	{
-		*x++ = atoi(s);
-		while (isdigit(*s))
-			s++;
-		while (isblank(*s))
-			s++;
-	}
-	return 0;
+	if      (format == YUV_420) return "420";
+	else if (format == YUV_422) return "422";
+	else if (format == YUV_444) return "444";
+	else                        return "???";
 }
 
-/** Fill model array with default values when unspecified */
-static void fill_model_array(int16 *x, int n, int model_id)
+static int read_layout(const char* s)
 {
-	x += n;
-	if (n<2) { *x++ = model_id ? 0 : DEFAULT_FREQ; } // H high cutoff / 1st AR coef (left & top)
-	if (n<3) { x[0] = model_id ? 0 : x[-1]; x++;   } // V high cutoff / x-comp corr
-	if (n<4) { *x++ = 0;                           } // H low cutoff / 2nd AR coef (top-left, top-right)
-	if (n<5) { *x++ = model_id << sei.log2_scale_factor; } // V low cutoff / aspect ratio
-	if (n<6) { *x++ = 0;                           } // x-comp corr / 3rd AR coef (left-left, top-top)
+	if      (!strcasecmp(s, "planar")) { layout = YUV_PLANAR; }
+	else if (!strcasecmp(s, "nv12"))   { layout = YUV_SEMI; depth = 8; }
+	else if (!strcasecmp(s, "p010"))   { layout = YUV_SEMI; depth = 10; }
+	else if (!strcasecmp(s, "v210"))   { layout = YUV_V210; depth = 10; format = YUV_422; }
+	else
+		CHECK(0, "unknown frame layout %s", s);
+	return 0;
 }
 
-static int read_model_array(int16 *x, char* s, int n, int model_id)
+// Read CPU list: "0,2,4-7"
+static int read_cpus(const char* s)
 {
-	int i;
-
-	// Note: frequency cutoffs are included bounds (<=)
+	int a, b, n;
 
-	while (isdigit(*s) || *s=='-' || *s=='+')
+	for (ncpus = 0; *s; s += n + (s[n] == ','))
 	{
-		for (i=0; i<n; i++)
+		n = 0;
+		if (sscanf(s, "%d-%d%n", &a, &b, &n) < 2 || !n)
 		{
-			*x++ = atoi(s);
-			while (isdigit(*s) || *s=='-' || *s=='+')
-				s++;
-			while (isblank(*s))
-				s++;
+			n = 0;
+			CHECK(sscanf(s, "%d%n", &a, &n) == 1 && n, "invalid CPU list %s", s);
+			b = a;
 		}
-		fill_model_array(x-n, n, model_id);
-		x += SEI_MAX_MODEL_VALUES-n;
+		CHECK(a >= 0 && a <= b && (s[n] == ',' || !s[n]), "invalid CPU list %s", s);
+		for (; a <= b && ncpus < (int)(sizeof(cpus)/sizeof(cpus[0])); a++)
+			cpus[ncpus++] = a;
 	}
+	CHECK(ncpus > 0, "empty CPU list");
 	return 0;
 }
 
-static int read_format(const char* s)
+static const char* layout_str(int layout)
 {
-	if      (!strcasecmp(s, "444")) return YUV_444;
-	else if (!strcasecmp(s, "422")) return YUV_422;
-	else                            return YUV_420;
+	if      (layout == YUV_PLANAR) return "planar";
+	else if (layout == YUV_SEMI)   return depth > 8 ? "p010" : "nv12";
+	else if (layout == YUV_V210)   return "v210";
+	else                           return "???";
 }
 
-static const char* format_str(int format)
+static int read_rendition(const char* s)
 {
-	if      (format == YUV_420) return "420";
-	else if (format == YUV_422) return "422";
-	else if (format == YUV_444) return "444";
-	else                        return "???";
-}
+	rendition* r = &rends[nrends];
+	size_t len;
+	int n = 0;
 
-static int adjust_chroma_cfg()
-{
-	if (sei.model_id == 0)
+	CHECK(nrends < MAX_RENDITIONS, "too many renditions (%d at most)", MAX_RENDITIONS);
+	if (sscanf(s, "%u,%d,%n", &r->gain, &r->odepth, &n) != 2 || !n || !s[n] || (r->odepth != 8 && r->odepth != 10))
 	{
-		// Conversion of component model values for 4:2:2 and 4:2:0 chroma formats
-		for (int c=1; c<3; c++)
-			if (sei.comp_model_present_flag[c])
-				for (int k=0; k<sei.num_intensity_intervals[c]; k++)
-				{
-					if (format < YUV_444)
-						sei.comp_model_value[c][k][1] = max(2, min(14, sei.comp_model_value[c][k][1] << 1)); // Horizontal frequency
-					if (format < YUV_422)
-						sei.comp_model_value[c][k][2] = max(2, min(14, sei.comp_model_value[c][k][2] << 1)); // Vertical frequency
-
-					if (format == YUV_420)
-						sei.comp_model_value[c][k][0] >>= 1;
-					else if (format == YUV_422)
-						sei.comp_model_value[c][k][0] = (sei.comp_model_value[c][k][0] * 181 + 128) >> 8;
-				}
+		printf("Invalid rendition %s (gain,outdepth,filename expected)\n\n", s);
+		return 1;
 	}
-
+	r->name = s + n;
+	len = strlen(r->name);
+	r->y4m_out = len > 4 && !strcasecmp(r->name + len - 4, ".y4m");
+	r->file = fopen(r->name, "wb");
+	CHECK(r->file, "can not create file %s", r->name);
+	nrends++;
 	return 0;
 }
 
-static int check_cfg_sei()
+static int read_roi(const char* s)
 {
-	// Unsupported features
-	CHECK(format == YUV_420 || (!sei.comp_model_present_flag[1] && !sei.comp_model_present_flag[2]), "color grain currently not supported on yuv422 and yuv444 formats");
-	CHECK(sei.model_id==0 || (!sei.comp_model_present_flag[1] && !sei.comp_model_present_flag[2]), "color grain currently not supported in SEI.AR mode");
-
-	// Sanity checks
-	CHECK(sei.model_id <= 1, "SEIFGCModelId shall be 0 or 1");
-	for (int c = 0; c < 3; c++)
+	if (sscanf(s, "%d,%d,%d,%d", &roi[0], &roi[1], &roi[2], &roi[3]) != 4 || roi[0] < 0 || roi[1] < 0 || roi[2] <= 0 || roi[3] <= 0)
 	{
-		if (sei.comp_model_present_flag[c])
-		{
-			int rng = (1 << depth);
-			CHECK(sei.num_model_values[c] >= 1 && sei.num_model_values[c] <= 6, "SEIFGCNumModelValuesMinus1Comp%d out of 0..5 range", c);
-			for (int i = 0; i < sei.num_intensity_intervals[c]; i++)
-			{
-				CHECK(sei.intensity_interval_lower_bound[c][i] <= sei.intensity_interval_upper_bound[c][i], "inconsistent interval %d for component %d: upper bound should be larger or equal than lower bound", i, c);
-
-				CHECK(sei.comp_model_value[c][i][0] < rng, "scaling factor for component %d and interval %d is too large", c, i);
-				if (sei.model_id == 0) // Frequency-filtering mode
-				{
-					CHECK(sei.comp_model_value[c][i][1] >= 2 && sei.comp_model_value[c][i][1] <= 14,  "horizontal cutoff frequency for component %d and interval %d out of 2..14 range", c, i);
-					CHECK(sei.comp_model_value[c][i][1] >= 2 && sei.comp_model_value[c][i][2] <= 14,  "vertical cutoff frequency for component %d and interval %d out of 2..14 range", c, i);
-				}
-				else // Auto-regressive
-				{
-					CHECK(sei.comp_model_value[c][i][1] >= -rng/2 && sei.comp_model_value[c][i][1] < rng/2,  "first AR coefficient for component %d and interval %d is out of range", c, i);
-					CHECK(sei.comp_model_value[c][i][3] >= -rng/2 && sei.comp_model_value[c][i][3] < rng/2,  "second AR coefficient for component %d and interval %d is out of range", c, i);
-					CHECK(sei.comp_model_value[c][i][5] >= -rng/2 && sei.comp_model_value[c][i][5] < rng/2,  "third AR coefficient for component %d and interval %d is out of range", c, i);
-				}
-			}
-		}
+		printf("Invalid region %s (x,y,w,h expected)\n\n", s);
+		return 1;
 	}
-
 	return 0;
 }
 
-static int check_cfg_afgs1()
+// Read gain automation curve: one "frame:gain" key per line (gain in percent)
+static int read_gain_curve(const char* filename)
 {
-	int i, val;
-
-	// Unsupported features
-	CHECK(format == YUV_420 || (!afgs1.num_cb_points && !afgs1.num_cr_points), "color grain currently not supported on yuv422 and yuv444 formats");
-
-	// Check point_y_values are in increasing order
-	for (i=1, val=afgs1.point_y_values[0]; i < afgs1.num_y_points; i++)
-	{
-		CHECK(afgs1.point_y_values[i] > val, "afgs1.point_y_values shall be in increasing order");
-		val = afgs1.point_y_values[i];
-	}
+	FILE* f;
+	char line[256];
+	char *s;
+	int frame, gain;
 
-	// Check point_cb_values are in increasing order
-	for (i=1, val=afgs1.point_cb_values[0]; i < afgs1.num_cb_points; i++)
+	f = fopen(filename, "rt");
+	if (!f)
 	{
-		CHECK(afgs1.point_cb_values[i] > val, "afgs1.point_cb_values shall be in increasing order");
-		val = afgs1.point_cb_values[i];
+		printf("Can not open file %s\n\n", filename);
+		return 1;
 	}
 
-	// Check point_y_values are in increasing order
-	for (i=1, val=afgs1.point_cr_values[0]; i < afgs1.num_cr_points; i++)
+	while (fgets(line, sizeof(line), f))
 	{
-		CHECK(afgs1.point_cr_values[i] > val, "afgs1.point_cr_values shall be in increasing order");
-		val = afgs1.point_cr_values[i];
+		for (s = line; isspace(*s); s++); // skip whitespace
+		if (*s == '#' || *s == '\0') // skip comments and empty lines
+			continue;
+		CHECK(sscanf(s, "%d : %d", &frame, &gain) == 2, "invalid gain curve key: %s", s);
+		CHECK(frame >= 0 && gain >= 0, "gain curve frame and gain shall be positive");
+		CHECK(ncurve == 0 || frame > curve[ncurve-1].frame, "gain curve keys shall be in increasing frame order");
+
+		curve = realloc(curve, (ncurve + 1) * sizeof(*curve));
+		CHECK(curve, "out of memory");
+		curve[ncurve].frame = frame;
+		curve[ncurve].gain = gain;
+		ncurve ++;
 	}
+	fclose(f);
+	CHECK(ncurve > 0, "could not read anything from gain curve file");
 
 	return 0;
 }
 
-static int check_cfg()
+/** Gain at frame n, linearly interpolated between curve keys (held outside) */
+static unsigned curve_gain(int n)
 {
-	if (afgs1.num_y_points)
-		return check_cfg_afgs1();
-	else
-		return check_cfg_sei();
+	int k;
+
+	for (k=0; k<ncurve && curve[k].frame < n; k++)
+		;
+	if (k == 0)
+		return curve[0].gain;
+	if (k == ncurve)
+		return curve[ncurve-1].gain;
+
+	int d = curve[k].frame - curve[k-1].frame;
+	return (curve[k-1].gain * (curve[k].frame - n) + curve[k].gain * (n - curve[k-1].frame) + d/2) / d;
 }
 
-// Read AFGS1 parameters from "grain table" format as output by the grain analyzer in AOM reference software
-static int read_afgs1_tbl(FILE* cfg)
+static int add_cfg(int poc, const char* filename, char* text)
 {
-	char line[1024];
-	char *s;
-	const char* sep = " \t"; // separators (white space)
-	int ncoef;
-#   define AERR "AFGS1 table entry: "
-
-	// Header line
-	fgets(line, sizeof(line), cfg);
-	for (s = line; isblank(*s); s++); // skip whitespace
-	s = strtok(line, sep); CHECK(s && !strcmp(s,"E"), AERR "expecting header (E)");
-	s = strtok(NULL, sep); // ignore start time (applied immediately)
-	s = strtok(NULL, sep); // ignore end time (we never stop)
-	s = strtok(NULL, sep); // ignore apply_grain (we always apply)
-	s = strtok(NULL, sep); CHECK(s, AERR "missing grain_seed");
-	afgs1.grain_seed = atoi(s);
-	// ignore update_parameters (we always update)
-
-	// Parameters line
-	fgets(line, sizeof(line), cfg);
-	for (s = line; isblank(*s); s++); // skip whitespace
-	s = strtok(line, sep);             CHECK(s && !strcmp(s,"p"), AERR "expecting parameters (p)");
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing ar_coeff_lag");
-	afgs1.ar_coeff_lag = atoi(s);      CHECK(afgs1.ar_coeff_lag <= 3, "ar_coeff_lag higher than 3");
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing ar_coeff_shift");
-	afgs1.ar_coeff_shift = atoi(s);    CHECK(afgs1.ar_coeff_shift >= 6 && afgs1.ar_coeff_shift <= 9, "ar_coeff_shift out of 6..9 range");
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing grain_scale_shift");
-	afgs1.grain_scale_shift = atoi(s); CHECK(afgs1.grain_scale_shift <= 3, "grain_scale_shift higher than 3");
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing grain_scaling");
-	afgs1.grain_scaling = atoi(s);     CHECK(afgs1.grain_scaling >= 8 && afgs1.grain_scaling <= 11, "grain_scaling out of 8..11 range");
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing chroma_scaling_from_luma");
-	afgs1.chroma_scaling_from_luma = atoi(s);
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing overlap_flag");
-	afgs1.overlap_flag = atoi(s);
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing cb_mult");
-	afgs1.cb_mult = atoi(s);
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing cb_luma_mult");
-	afgs1.cb_luma_mult = atoi(s);
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing cb_offset");
-	afgs1.cb_offset = atoi(s);
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing cr_mult");
-	afgs1.cr_mult = atoi(s);
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing cr_luma_mult");
-	afgs1.cr_luma_mult = atoi(s);
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing cr_offset");
-	afgs1.cr_offset = atoi(s);
-
-	// Y scaling function line
-	fgets(line, sizeof(line), cfg);
-	for (s = line; isblank(*s); s++); // skip whitespace
-	s = strtok(line, sep);             CHECK(s && !strcmp(s,"sY"), AERR "expecting luma scaling function (sY)");
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing num_y_points");
-	afgs1.num_y_points = atoi(s);      CHECK(afgs1.num_y_points <= 14, "num_y_points higher than 14");
-	for (int k=0; k<afgs1.num_y_points; k++)
-	{
-		s = strtok(NULL, sep);         CHECK(s, AERR "missing luma scaling point (value)");
-		afgs1.point_y_values[k] = atoi(s);
-		s = strtok(NULL, sep);         CHECK(s, AERR "missing luma scaling point (scale)");
-		afgs1.point_y_scaling[k] = atoi(s);
-	}
-
-	// Cb scaling function line
-	fgets(line, sizeof(line), cfg);
-	for (s = line; isblank(*s); s++); // skip whitespace
-	s = strtok(line, sep);             CHECK(s && !strcmp(s,"sCb"), AERR "expecting Cb scaling function (sCb)");
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing num_cb_points");
-	afgs1.num_cb_points = atoi(s);     CHECK(afgs1.num_cb_points <= 10, "num_cb_points higher than 10");
-	for (int k=0; k<afgs1.num_cb_points; k++)
-	{
-		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cb scaling point (value)");
-		afgs1.point_cb_values[k] = atoi(s);
-		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cb scaling point (scale)");
-		afgs1.point_cb_scaling[k] = atoi(s);
-	}
-
-	// Cr scaling function line
-	fgets(line, sizeof(line), cfg);
-	for (s = line; isblank(*s); s++); // skip whitespace
-	s = strtok(line, sep);             CHECK(s && !strcmp(s,"sCr"), AERR "expecting Cr scaling function (sCr)");
-	s = strtok(NULL, sep);             CHECK(s, AERR "missing num_cr_points");
-	afgs1.num_cr_points = atoi(s);     CHECK(afgs1.num_cr_points <= 10, "num_cr_points higher than 10");
-	for (int k=0; k<afgs1.num_cr_points; k++)
-	{
-		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cr scaling point (value)");
-		afgs1.point_cr_values[k] = atoi(s);
-		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cr scaling point (scale)");
-		afgs1.point_cr_scaling[k] = atoi(s);
-	}
-
-	// Y coefficients line
-	fgets(line, sizeof(line), cfg);
-	for (s = line; isblank(*s); s++); // skip whitespace
-	s = strtok(line, sep);             CHECK(s && !strcmp(s,"cY"), AERR "expecting luma coefficients");
-	ncoef = 2 * afgs1.ar_coeff_lag * (afgs1.ar_coeff_lag + 1);
-	for (int k=0; k<ncoef; k++)
-	{
-		s = strtok(NULL, sep);         CHECK(s, AERR "missing luma AR coefficient");
-		afgs1.ar_coeffs_y[k] = atoi(s);
-	}
-
-	// Cb coefficients line
-	ncoef++;
-	fgets(line, sizeof(line), cfg);
-	for (s = line; isblank(*s); s++); // skip whitespace
-	s = strtok(line, sep);             CHECK(s && !strcmp(s,"cCb"), AERR "expecting Cb coefficients");
-	for (int k=0; k<ncoef; k++)
-	{
-		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cb AR coefficient");
-		afgs1.ar_coeffs_cb[k] = atoi(s);
-	}
-
-	// Cr coefficients line
-	fgets(line, sizeof(line), cfg);
-	for (s = line; isblank(*s); s++); // skip whitespace
-	s = strtok(line, sep);             CHECK(s && !strcmp(s,"cCr"), AERR "expecting Cr coefficients");
-	for (int k=0; k<ncoef; k++)
-	{
-		s = strtok(NULL, sep);         CHECK(s, AERR "missing Cr AR coefficient");
-		afgs1.ar_coeffs_cr[k] = atoi(s);
-	}
-
-	// Note: afgs1.clip_to_restricted_range is missing in .tbl files --> set it to a default value ?
+	config = realloc(config, (ncfg + 1) * sizeof(*config));
+	CHECK(config, "out of memory");
+	config[ncfg].poc = poc;
+	config[ncfg].filename = filename;
+	config[ncfg].text = text;
+	config[ncfg].par = NULL;
+	ncfg ++;
 
 	return 0;
 }
 
-static int read_cfg(const char* filename)
+static int push_cfg(const char* param)
 {
-	FILE* cfg;
-	char line[1024];
-	char *s, *v, *e;
-	int c=0, i=0, j=0;
-	int cnt1=0, cnt2=0;
+	unsigned poc = 0;
+	char s[16];
+	const char *filename;
+	int ok = 0;
+
+	// Parse poc from param (search for :)
+	filename = strchr(param, ':');
+	if (filename)
+	{
+		int n = filename - param;
+		ok = 1;
+		for (int i=0; i<n && ok; i++)
+			ok = ok && isdigit(param[i]);
+		if (ok)
+		{
+			CHECK(n < 16, "illegal configuration POC");
+			memcpy(s, param, n);
+			s[n] = '\0';
+			poc = atoi(s);
+			CHECK(poc >= 0, "illegal configuration POC (must be positive)");
+			filename ++; // skip ':'
+		}
+	}
+	if (!ok)
+	{
+		poc = 0;
+		filename = param;
+	}
 
-	cfg = fopen(filename, "rt");
-	if (!cfg)
+	return add_cfg(poc, filename, NULL);
+}
+
+// Read schedule file: "<poc>: <configuration file>" lines (path relative to the
+// schedule file), or "<poc>:" followed by indented inline parameters lines
+// (configuration file syntax)
+static int read_schedule(const char* filename)
+{
+	FILE* f;
+	char line[1024];
+	char path[1024];
+	char *s, *e;
+	int poc, n;
+	int inl = -1; // entry receiving inline parameters
+	const char* dir = strrchr(filename, '/');
+
+	f = fopen(filename, "rt");
+	if (!f)
 	{
 		printf("Can not open file %s\n\n", filename);
 		return 1;
 	}
 
-	afgs1.num_y_points = 0; // reset afgs1/sei detection
-	afgs1.num_cb_points = 0;
-	afgs1.num_cr_points = 0;
-
-	while (fgets(line, sizeof(line), cfg))
+	while (fgets(line, sizeof(line), f))
 	{
-		if (line[0] == '#') // remove comments (special case for 1st character)
+		for (s = line; isspace(*s); s++); // skip whitespace
+		if (*s == '#' || *s == '\0') // skip comments and empty lines
 			continue;
-		s = strtok(line, "#"); // remove comments
-		while (isblank(*s)) // skip leading whitespace
-			s++;
-		s = strtok(s, ":"); // get "name"
-		v = strtok(NULL, ":"); // get "value"
 
-		if (v == NULL)
+		if (isblank(line[0]))
 		{
-			if (!strncasecmp(s, "filmgrn1", 8))
-				return read_afgs1_tbl(cfg);
-			else
-				continue;
+			// Inline parameters
+			CHECK(inl >= 0, "unexpected indented line in schedule: %s", s);
+			n = strlen(config[inl].text);
+			config[inl].text = realloc(config[inl].text, n + strlen(s) + 1);
+			CHECK(config[inl].text, "out of memory");
+			strcpy(config[inl].text + n, s);
+			continue;
 		}
-		while (isblank(*v)) // skip leading whitespace of "value"
-			v++;
-		for (e=s; !isblank(*e) && *e; e++) // trim trailing whitespace of "name"
+
+		if ((e = strchr(s, '#'))) // remove comments
+			*e = '\0';
+		path[0] = '\0';
+		n = sscanf(s, "%d : %1023[^\n]", &poc, path);
+		CHECK(n >= 1 && poc >= 0, "invalid schedule entry: %s", s);
+		for (e = path + strlen(path); e > path && isspace(e[-1]); e--) // trim trailing whitespace
 			;
 		*e = '\0';
-		cnt1 ++;
-
-		// SEI
-		if      (!strcasecmp(s, "SEIFGCModelId"))                          { sei.model_id                   = atoi(v); }
-		else if (!strcasecmp(s, "SEIFGCLog2ScaleFactor"))                  { sei.log2_scale_factor          = atoi(v); }
-		else if (!strcasecmp(s, "SEIFGCCompModelPresentComp0"))            { sei.comp_model_present_flag[0] = atoi(v); }
-		else if (!strcasecmp(s, "SEIFGCCompModelPresentComp1"))            { sei.comp_model_present_flag[1] = atoi(v); }
-		else if (!strcasecmp(s, "SEIFGCCompModelPresentComp2"))            { sei.comp_model_present_flag[2] = atoi(v); }
-		else if (!strcasecmp(s, "SEIFGCNumIntensityIntervalMinus1Comp0"))  { sei.num_intensity_intervals[0] = atoi(v) + 1; }
-		else if (!strcasecmp(s, "SEIFGCNumIntensityIntervalMinus1Comp1"))  { sei.num_intensity_intervals[1] = atoi(v) + 1; }
-		else if (!strcasecmp(s, "SEIFGCNumIntensityIntervalMinus1Comp2"))  { sei.num_intensity_intervals[2] = atoi(v) + 1; }
-		else if (!strcasecmp(s, "SEIFGCNumModelValuesMinus1Comp0"))        { sei.num_model_values[0]        = atoi(v) + 1; }
-		else if (!strcasecmp(s, "SEIFGCNumModelValuesMinus1Comp1"))        { sei.num_model_values[1]        = atoi(v) + 1; }
-		else if (!strcasecmp(s, "SEIFGCNumModelValuesMinus1Comp2"))        { sei.num_model_values[2]        = atoi(v) + 1; }
-		else if (!strcasecmp(s, "SEIFGCIntensityIntervalLowerBoundComp0")) { read_array_u8(sei.intensity_interval_lower_bound[0], v); }
-		else if (!strcasecmp(s, "SEIFGCIntensityIntervalLowerBoundComp1")) { read_array_u8(sei.intensity_interval_lower_bound[1], v); }
-		else if (!strcasecmp(s, "SEIFGCIntensityIntervalLowerBoundComp2")) { read_array_u8(sei.intensity_interval_lower_bound[2], v); }
-		else if (!strcasecmp(s, "SEIFGCIntensityIntervalUpperBoundComp0")) { read_array_u8(sei.intensity_interval_upper_bound[0], v); }
-		else if (!strcasecmp(s, "SEIFGCIntensityIntervalUpperBoundComp1")) { read_array_u8(sei.intensity_interval_upper_bound[1], v); }
-		else if (!strcasecmp(s, "SEIFGCIntensityIntervalUpperBoundComp2")) { read_array_u8(sei.intensity_interval_upper_bound[2], v); }
-		else if (!strcasecmp(s, "SEIFGCCompModelValuesComp0")) { read_model_array(sei.comp_model_value[0][0], v, sei.num_model_values[0], sei.model_id); }
-		else if (!strcasecmp(s, "SEIFGCCompModelValuesComp1")) { read_model_array(sei.comp_model_value[1][0], v, sei.num_model_values[1], sei.model_id); }
-		else if (!strcasecmp(s, "SEIFGCCompModelValuesComp2")) { read_model_array(sei.comp_model_value[2][0], v, sei.num_model_values[2], sei.model_id); }
-
-		// SEI, dump style
-		else if (!strcasecmp(s, "fg_model_id"))                             { sei.model_id                   = atoi(v); }
-		else if (!strcasecmp(s, "fg_log2_scale_factor"))                    { sei.log2_scale_factor          = atoi(v); }
-		else if (!strcasecmp(s, "fg_comp_model_present_flag[c]"))           { sei.comp_model_present_flag[c] = atoi(v);     c = (c<2) ? c+1 : 0; }
-		else if (!strcasecmp(s, "fg_num_intensity_intervals_minus1[c]"))    { sei.num_intensity_intervals[c] = atoi(v) + 1; }
-		else if (!strcasecmp(s, "fg_num_model_values_minus1[c]"))           { sei.num_model_values[c]        = atoi(v) + 1; }
-		else if (!strcasecmp(s, "fg_intensity_interval_lower_bound[c][i]")) { sei.intensity_interval_lower_bound[c][i] = atoi(v); }
-		else if (!strcasecmp(s, "fg_intensity_interval_upper_bound[c][i]")) { sei.intensity_interval_upper_bound[c][i] = atoi(v); }
-		else if (!strcasecmp(s, "fg_comp_model_value[c][i]"))
+
+		if (path[0])
 		{
-			sei.comp_model_value[c][i][j++] = atoi(v);
-			if (j == sei.num_model_values[c])
-			{
-				fill_model_array(sei.comp_model_value[c][i], sei.num_model_values[c], sei.model_id);
-				i ++; // next intensity interval
-				j = 0;
-				if (i == sei.num_intensity_intervals[c])
-				{
-					c ++; // next color component
-					i = 0;
-				}
-			}
+			// Configuration file
+			int l = (dir && path[0] != '/') ? dir - filename + 1 : 0;
+			char* name = malloc(l + strlen(path) + 1);
+			CHECK(name, "out of memory");
+			memcpy(name, filename, l);
+			strcpy(name + l, path);
+			if (add_cfg(poc, name, NULL)) return 1;
+			inl = -1;
 		}
-		else if (!strcasecmp(s, "fg_characteristics_persistence_flag"))     { break; /* stop at the end of the first FGS SEI */ }
-
-		// AFGS1
-		else if (!strcasecmp(s, "AFGS1GrainSeed"))             { afgs1.grain_seed = atoi(v); }
-		else if (!strcasecmp(s, "AFGS1NumYPoints"))            { afgs1.num_y_points = atoi(v); CHECK(afgs1.num_y_points <= 14, "AFGS1NumYPoints higher than 14"); }
-		else if (!strcasecmp(s, "AFGS1PointYValues"))          { read_array_u8(afgs1.point_y_values, v); }
-		else if (!strcasecmp(s, "AFGS1PointYScaling"))         { read_array_u8(afgs1.point_y_scaling, v); }
-		else if (!strcasecmp(s, "AFGS1ChromaScalingFromLuma")) { afgs1.chroma_scaling_from_luma = atoi(v); }
-		else if (!strcasecmp(s, "AFGS1NumCbPoints"))           { afgs1.num_cb_points = atoi(v); CHECK(afgs1.num_cb_points <= 10, "AFGS1NumCbPoints higher than 10"); }
-		else if (!strcasecmp(s, "AFGS1PointCbValues"))         { read_array_u8(afgs1.point_cb_values, v); }
-		else if (!strcasecmp(s, "AFGS1PointCbScaling"))        { read_array_u8(afgs1.point_cb_scaling, v); }
-		else if (!strcasecmp(s, "AFGS1NumCrPoints"))           { afgs1.num_cr_points = atoi(v); CHECK(afgs1.num_cr_points <= 10, "AFGS1NumCrPoints higher than 10"); }
-		else if (!strcasecmp(s, "AFGS1PointCrValues"))         { read_array_u8(afgs1.point_cr_values, v); }
-		else if (!strcasecmp(s, "AFGS1PointCrScaling"))        { read_array_u8(afgs1.point_cr_scaling, v); }
-		else if (!strcasecmp(s, "AFGS1GrainScaling"))          { afgs1.grain_scaling = atoi(v); CHECK(afgs1.grain_scaling >= 8 && afgs1.grain_scaling <= 11, "AFGS1GrainScaling out of 8..11 range"); }
-		else if (!strcasecmp(s, "AFGS1ARCoeffLag"))            { afgs1.ar_coeff_lag = atoi(v); CHECK(afgs1.ar_coeff_lag <= 3, "AFGS1ARCoeffLag higher than 3"); }
-		else if (!strcasecmp(s, "AFGS1ARCoeffsY"))             { read_array_i16(afgs1.ar_coeffs_y, v); }
-		else if (!strcasecmp(s, "AFGS1ARCoeffsCb"))            { read_array_i16(afgs1.ar_coeffs_cb, v); }
-		else if (!strcasecmp(s, "AFGS1ARCoeffsCr"))            { read_array_i16(afgs1.ar_coeffs_cr, v); }
-		else if (!strcasecmp(s, "AFGS1ARCoeffShift"))          { afgs1.ar_coeff_shift = atoi(v); CHECK(afgs1.ar_coeff_shift >= 6 && afgs1.ar_coeff_shift <= 9, "AFGS1ARCoeffShift out of 6..9 range"); }
-		else if (!strcasecmp(s, "AFGS1GrainScaleShift"))       { afgs1.grain_scale_shift = atoi(v); CHECK(afgs1.grain_scale_shift <= 3, "AFGS1GrainScaleShift higher than 3"); }
-		else if (!strcasecmp(s, "AFGS1CbMult"))                { afgs1.cb_mult = atoi(v); }
-		else if (!strcasecmp(s, "AFGS1CbLumaMult"))            { afgs1.cb_luma_mult = atoi(v); }
-		else if (!strcasecmp(s, "AFGS1CbOffset"))              { afgs1.cb_offset = atoi(v); }
-		else if (!strcasecmp(s, "AFGS1CrMult"))                { afgs1.cr_mult = atoi(v); }
-		else if (!strcasecmp(s, "AFGS1CrLumaMult"))            { afgs1.cr_luma_mult = atoi(v); }
-		else if (!strcasecmp(s, "AFGS1CrOffset"))              { afgs1.cr_offset = atoi(v); }
-		else if (!strcasecmp(s, "AFGS1OverlapFlag"))           { afgs1.overlap_flag = atoi(v); }
-		else if (!strcasecmp(s, "AFGS1ClipToRestrictedRange")) { afgs1.clip_to_restricted_range = atoi(v); }
-
-		else cnt2 ++;
-	}
-	CHECK(cnt1 > cnt2, "could not ready anything from configuration file");
+		else
+		{
+			char* text = calloc(1, 1);
+			CHECK(text, "out of memory");
+			if (add_cfg(poc, NULL, text)) return 1;
+			inl = ncfg - 1;
+		}
+	}
+	fclose(f);
+	CHECK(ncfg > 0, "could not read anything from schedule file");
 
 	return 0;
 }
 
-static void apply_gain(unsigned gain)
+/** Parse and check all scheduled configurations, once (before processing any picture) */
+static int load_cfgs(unsigned gain)
 {
-	if (gain==100)
-		return;
+	fgs_params* p;
+	int k, l, err;
+	char tmp[sizeof(*config)];
+
+	// Sort by POC (stable, so that entries with the same POC keep their order)
+	for (k = 1; k < ncfg; k++)
+		for (l = k; l > 0 && config[l-1].poc > config[l].poc; l--)
+		{
+			memcpy(tmp, &config[l], sizeof(tmp));
+			memcpy(&config[l], &config[l-1], sizeof(tmp));
+			memcpy(&config[l-1], tmp, sizeof(tmp));
+		}
 
-	if (afgs1.num_y_points)
+	for (k = 0; k < ncfg; k++)
 	{
-		// AFGS1
-		for(;gain>100; gain/=2)
-			afgs1.grain_scaling --;
-		for(;gain && gain<50; gain*=2)
-			afgs1.grain_scaling ++;
+		// Same file as a previous entry: already parsed
+		for (l = 0; l < k && !config[k].par; l++)
+			if (config[k].filename && config[l].filename && !strcmp(config[k].filename, config[l].filename))
+				config[k].par = config[l].par;
+		if (config[k].par)
+			continue;
 
-		for (int i=0; i<afgs1.num_y_points; i++)
-			afgs1.point_y_scaling[i] = (uint8)((int)afgs1.point_y_scaling[i] * gain / 100);
-		for (int i=0; i<afgs1.num_cb_points; i++)
-			afgs1.point_cb_scaling[i] = (uint8)((int)afgs1.point_cb_scaling[i] * gain / 100);
-		for (int i=0; i<afgs1.num_cr_points; i++)
-			afgs1.point_cr_scaling[i] = (uint8)((int)afgs1.point_cr_scaling[i] * gain / 100);
+		p = malloc(sizeof(fgs_params));
+		CHECK(p, "out of memory");
+		memcpy(p, &def, sizeof(fgs_params));
+		if (config[k].filename)
+			err = vfgs_read_cfg(p, config[k].filename);
+		else
+			err = vfgs_read_cfg_text(p, config[k].text);
+		err = err || vfgs_check_cfg(p, depth, format);
+		CHECK(!err, "invalid configuration %s (scheduled at POC %d)", config[k].filename ? config[k].filename : "(inline)", config[k].poc);
+		vfgs_adjust_chroma_cfg(p, format);
+		vfgs_apply_gain(p, gain);
+
+		// Same content as a previous configuration: share it
+		for (l = 0; l < nparams; l++)
+			if (vfgs_same_cfg(params[l], p))
+				break;
+		if (l < nparams)
+		{
+			vfgs_free_cfg(p);
+			free(p);
+		}
+		else
+		{
+			params = realloc(params, (nparams + 1) * sizeof(fgs_params*));
+			CHECK(params, "out of memory");
+			params[nparams++] = p;
+		}
+		config[k].par = params[l];
 	}
-	else
+
+	return 0;
+}
+
+/** Apply configurations scheduled up to picture poc; returns 1 if any was applied */
+static int update_cfg(int poc)
+{
+	int updated = 0;
+
+	while (icfg < ncfg && poc >= config[icfg].poc)
 	{
-		// FGC SEI
-		for(;gain>100; gain/=2)
-			sei.log2_scale_factor --;
-		for(;gain && gain<50; gain*=2)
-			sei.log2_scale_factor ++;
+		par = config[icfg++].par;
+		vfgs_init_params(par);
+		itl = jtl = 0; // init from 1st grain table / SEI dump entry, if any
+		updated = 1;
+	}
+	return updated;
+}
 
-		for (int c=0; c<3; c++)
-			for (int i=0; sei.comp_model_present_flag[c] && i<sei.num_intensity_intervals[c]; i++)
-				sei.comp_model_value[c][i][0] = (int16)((int)sei.comp_model_value[c][i][0] * gain / 100);
+static int read_fps(const char* s)
+{
+	if (strchr(s, '/'))
+	{
+		CHECK(sscanf(s, "%d/%d", &fps_num, &fps_den) == 2, "invalid frame rate %s", s);
+	}
+	else
+	{
+		fps_num = (int)(atof(s) * 1000 + 0.5);
+		fps_den = 1000;
 	}
+	CHECK(fps_num > 0 && fps_den > 0, "invalid frame rate %s", s);
+	return 0;
 }
 
-static int push_cfg(const char* param)
+static int same_afgs1(const fgs_afgs1* a, const fgs_afgs1* b)
 {
-	unsigned poc = 0;
-	char s[16];
-	const char *filename;
-	int ok = 0;
+	fgs_afgs1 tmp;
+
+	memcpy(&tmp, b, sizeof(tmp));
+	tmp.grain_seed = a->grain_seed;
+	return !memcmp(a, &tmp, sizeof(tmp));
+}
 
-	CHECK(ncfg < MAX_CONFIGS, "too many configurations (maximum is %d)", MAX_CONFIGS);
+/** Follow grain table for picture poc; returns 0 when no grain shall be applied
+ *
+ * The entry covering the picture mid-time is used (robust to time stamp
+ * rounding), or the picture index for frame-indexed tables (AV1 bitstreams). Entries with the same parameters as the programmed ones only
+ * reseed; pictures not covered by any entry are left untouched.
+ */
+static int tbl_entry(const fgs_params* p, int poc)
+{
+	long long ts = p->tbl_frames ? poc : ((2LL*poc + 1) * 10000000LL * fps_den) / (2LL * fps_num);
+	int k;
+
+	for (k = p->ntbl-1; k >= 0 && p->tbl[k].start > ts; k--)
+		;
+	if (k >= 0 && ts >= p->tbl[k].end)
+		k = -1;
+	return k;
+}
 
-	// Parse poc from param (search for :)
-	filename = strchr(param, ':');
-	if (filename)
+static int update_tbl(int poc, unsigned* fgain)
+{
+	int k = tbl_entry(par, poc);
+
+	if (k != itl && k >= 0)
 	{
-		int n = filename - param;
-		ok = 1;
-		for (int i=0; i<n && ok; i++)
-			ok = ok && isdigit(param[i]);
-		if (ok)
+		if (same_afgs1(&par->tbl[k].afgs1, &par->tbl[jtl].afgs1))
+			vfgs_set_afgs1_seed(par->tbl[k].afgs1.grain_seed);
+		else
 		{
-			CHECK(n < 16, "illegal configuration POC");
-			strncpy(s, param, n);
-			poc = atoi(s);
-			CHECK(poc >= 0, "illegal configuration POC (must be positive)");
-			filename ++; // skip ':'
+			vfgs_init_afgs1(&par->tbl[k].afgs1);
+			jtl = k;
+			*fgain = ~0u;
 		}
 	}
-	if (!ok)
+	itl = k;
+
+	return k >= 0 && par->tbl[k].apply;
+}
+
+/** Follow SEI dump for picture poc; returns 0 when no grain shall be applied */
+static int dump_entry(const fgs_params* p, int poc)
+{
+	int k;
+
+	for (k = p->nsei-1; k >= 0 && p->seis[k].poc > poc; k--)
+		;
+	if (k >= 0 && !p->seis[k].persist && poc > p->seis[k].poc)
+		k = -1; // non-persistent SEI, applied to a single picture
+	return k;
+}
+
+static int update_dump(int poc, unsigned* fgain)
+{
+	int k = dump_entry(par, poc);
+
+	if (k != itl && k >= 0 && par->seis[k].apply && memcmp(&par->seis[k].sei, &par->seis[jtl].sei, sizeof(fgs_sei)))
 	{
-		poc = 0;
-		filename = param;
+		vfgs_init_sei(&par->seis[k].sei);
+		jtl = k;
+		*fgain = ~0u;
 	}
+	itl = k;
 
-	// Store at current location
-	config[ncfg].poc = poc;
-	config[ncfg].filename = filename;
-	ncfg ++;
+	return k >= 0 && par->seis[k].apply;
+}
 
-	return 0;
+/** Follow in-configuration timeline (grain table or SEI dump), if any */
+static int update_timeline(int poc, unsigned* fgain)
+{
+	if (par->ntbl)
+		return update_tbl(poc, fgain);
+	if (par->nsei)
+		return update_dump(poc, fgain);
+	return 1;
 }
 
-static int pop_cfg(unsigned gain)
+/** Tell from the schedule alone (no side effect, so that input can be
+ * passed through before the grain stage gets to the picture) whether picture
+ * poc is surely left unchanged: no grain in the timeline, or an FGC SEI with no
+ * component model (and no sample clipping: 8-bit only, as the kernel clamps
+ * samples to 255 << 2 at 10 bits) */
+static int grain_free(int poc)
 {
-	CHECK(icfg < ncfg, "No configuration to pop");
-	if (read_cfg(config[icfg].filename)) return 1;
-    if (check_cfg()) return 1;
-    if (adjust_chroma_cfg()) return 1;
-    apply_gain(gain);
-	icfg ++;
-    return 0;
+	const fgs_params* p = &def;
+	const fgs_sei* sei;
+	int k;
+
+	for (k = ncfg-1; k >= 0 && config[k].poc > poc; k--)
+		;
+	if (k >= 0)
+		p = config[k].par;
+	if (p->ntbl)
+		return (k = tbl_entry(p, poc)) < 0 || !p->tbl[k].apply;
+	if (p->nsei && ((k = dump_entry(p, poc)) < 0 || !p->seis[k].apply))
+		return 1;
+	if (p->afgs1.num_y_points)
+		return 0;
+	sei = p->nsei ? &p->seis[k].sei : &p->sei;
+	return depth == 8 && !clipping && !sei->comp_model_present_flag[0] && !sei->comp_model_present_flag[1] && !sei->comp_model_present_flag[2];
 }
 
 static int help(const char* name)
 {
-	printf("Usage: %s [options] <input.yuv> <output.yuv>\n\n", name);
+	printf("Usage: %s [options] <input.yuv|y4m> <output.yuv|y4m>\n\n", name);
+	printf("   (- for stdin / stdout; Y4M input is detected, and sets picture size, bit depth and\n");
+	printf("   chroma format; output is Y4M with a .y4m extension, or on stdout for a Y4M input)\n\n");
 	printf("   -w,--width    <value>           Picture width [%d]\n", width);
 	printf("   -h,--height   <value>           Picture height [%d]\n", height);
 	printf("   -b,--bitdepth <value>           Input bit depth [%d]\n", depth);
 	printf("      --outdepth <value>           Output bit depth (<= input depth) [same as input]\n");
 	printf("   -f,--format   <value>           Chroma format (420/422/444) [%s]\n", format_str(format));
+	printf("      --layout   <value>           Frame layout: planar, nv12 (8-bit) or p010 (10-bit, MSB-aligned)\n");
+	printf("                                   semi-planar, or v210 (10-bit 4:2:2 packed) [%s]\n", layout_str(layout));
 	printf("   -n,--frames   <value>           Number of frames to process (0=all) [%d]\n", frames);
 	printf("   -s,--seek     <value>           Picture start index within input file [%d]\n", seek);
 	printf("   -r,--seed     <value>           Random seed (non-zero 31-bits number)\n");
 	printf("   -c,--cfg      [<x>:]<filename>  Read film grain configuration file, to be applied\n");
 	printf("                                   from frame x (defaults to 0). Multiple -c are allowed.\n");
+	printf("      --schedule <filename>        Read configuration schedule (\"x: filename\" lines, or \"x:\"\n");
+	printf("                                   followed by indented configuration lines)\n");
 	printf("   -g,--gain     <value>           Apply a global scale (in percent) to grain strength\n");
+	printf("      --fps      <value>           Frame rate, to follow AFGS1 grain table time stamps [%g]\n", (double)fps_num / fps_den);
+	printf("      --gain-curve <filename>      Per-frame gain (in percent, on top of --gain), read from\n");
+	printf("                                   \"frame:gain\" lines and linearly interpolated\n");
+	printf("      --lazy                       Make FGC SEI grain patterns only once used by a picture\n");
+	printf("      --compile-state <filename>   Save hardware state (at first frame) to binary file, and exit\n");
+	printf("      --state  <filename>          Load hardware state from binary file (instead of -c)\n");
+	printf("      --index    <filename>        Frame offset index of Y4M input, for direct seeking (made\n");
+	printf("                                   from input file if not found)\n");
+	printf("      --mmap                       Memory-map input file (grain written out of place to frame buffers)\n");
+	printf("      --uring                      Read and write with io_uring and direct I/O (bypassing the\n");
+	printf("                                   page cache)\n");
+	printf("      --pipeline <value>           Read, add grain and write in separate threads, over a ring\n");
+	printf("                                   of <value> frames (0=off) [%d]\n", pipeline);
+	printf("      --shm      <name>            Exchange frames with a producer and a consumer process through\n");
+	printf("                                   a shared-memory ring (instead of input and output files)\n");
+	printf("      --shm-slots <value>          Frames in shared-memory ring [%d]\n", shm_slots);
+	printf("      --strips                     Read, add grain and write one 16-row strip at a time (bounded\n");
+	printf("                                   memory for very large frames; regular files only)\n");
+	printf("      --affinity <list>            Pin threads to CPUs (e.g. 0,2,4-7): pipeline stages in turn\n");
+	printf("                                   (frames on the NUMA node of the grain stage), or serial loop\n");
+	printf("      --rendition <g>,<d>,<file>   Also write source grained at gain <g> (percent, grain scale\n");
+	printf("                                   only) and output bit depth <d> to file (several allowed)\n");
+	printf("      --roi      <x,y,w,h>         Add grain to a region only (its rows, over the 16-sample block\n");
+	printf("                                   columns covering it; same samples as whole picture, rest as input)\n");
+	printf("      --serve    <socket>          Run as preview server on Unix-domain socket (no input or\n");
+	printf("                                   output file; see vfgs_serve.h)\n");
 	printf("   --help                          Display this page\n\n");
 	return 0;
 }
 
-static void vfgs_add_grain(yuv* frame)
+/** Add grain to source frame src, output to frame (in place if the same),
+ * or to a strip of the picture starting at row y0 (a multiple of 16);
+ * with --roi, only to the rows of the region, over the block columns covering it */
+static void vfgs_add_grain(yuv* frame, const yuv* src, int y0)
 {
+	int sz = depth > 8 ? 2 : 1;
 	uint8 *Y = frame->Y;
 	uint8 *U = frame->U;
-	uint8 *V = frame->V;
+	uint8 *V = frame->layout == YUV_SEMI ? U + sz : frame->V;
 
-	assert(depth == frame->depth);
+	assert(depth == (int)frame->depth && depth == (int)src->depth && frame->layout == src->layout);
 
-	for (int y=0; y<frame->height; y++)
+	if (frame->layout == YUV_V210)
 	{
-		vfgs_add_grain_line(Y, U, V, y, frame->width);
-		Y += frame->stride * (depth > 8 ? 2 : 1);
-		if ((y & 1) || (frame->height == frame->cheight))
+		// Unpack each row to planar lines; the kernel works on 16-sample blocks
+		int w = (frame->width + 15) & ~15;
+		uint16 *lY, *lU, *lV;
+		lY = v210_line;
+		lU = lY + w;
+		lV = lU + w / 2;
+		if (roi[2]) // (4:2:2: no chroma row subsampling)
 		{
-			U += frame->cstride * (depth > 8 ? 2 : 1);
-			V += frame->cstride * (depth > 8 ? 2 : 1);
+			uint32 prng[2];
+			vfgs_get_prng(prng);
+			vfgs_jump_rows(roi[1], frame->width);
+			for (int y=roi[1]; y<roi[1]+roi[3]; y++)
+			{
+				yuv_v210_unpack(src, y, lY, lU, lV);
+				vfgs_add_grain_line_part(lY, lU, lV, lY, lU, lV, y, frame->width, roi[0], roi[2]);
+				yuv_v210_pack(frame, y, lY, lU, lV);
+			}
+			vfgs_set_prng(prng);
+			vfgs_skip_frame(frame->width, frame->height);
+			return;
+		}
+		for (int y=0; y<frame->height; y++)
+		{
+			yuv_v210_unpack(src, y, lY, lU, lV);
+			vfgs_add_grain_line(lY, lU, lV, y0 + y, frame->width);
+			yuv_v210_pack(frame, y, lY, lU, lV);
 		}
+		return;
+	}
+
+	void* plane[3] = { Y, U, V };
+	int stride[3] = { frame->stride * sz, frame->cstride * sz, frame->cstride * sz };
+	const void* splane[3] = { src->Y, src->U, src->layout == YUV_SEMI ? (const uint8*)src->U + sz : src->V };
+	int sstride[3] = { src->stride * sz, src->cstride * sz, src->cstride * sz };
+	if (roi[2])
+		vfgs_add_grain_region(plane, stride, splane, sstride, frame->width, frame->height, roi[0], roi[1], roi[2], roi[3]);
+	else
+		vfgs_add_grain_planes_from(plane, stride, splane, sstride, frame->width, frame->height, y0);
+}
+
+/** Read next frame; ends the run at end of input (or of --frames) */
+static int stage_read(int k)
+{
+	frame_slot* s = &slots[k];
+
+	int pass = passthrough && grain_free(nread + seek);
+
+	if (frames && nread >= frames)
+		return 1;
+	s->ipos = -1;
+	if (shm)
+	{
+		if (vfgs_shm_acquire(shm, &s->frame))
+			return 1;
+		if (lazy)
+			yuv_hist(&s->frame, s->hist);
+	}
+	else if (strips) // (left in input file, read strip by strip)
+	{
+		int r = y4m_in ? yuv_y4m_read_marker(fsrc) : 1;
+		if (r <= 0 || (s->ipos = yuv_pass(&whole, fsrc)) < 0)
+		{
+			if (r < 0)
+				fprintf(stderr, "Error: invalid Y4M frame header in input file\n");
+			read_err = r < 0;
+			return 1;
+		}
+	}
+	else if (map_input)
+	{
+		int r = yuv_map_read(&map, &s->view, (lazy && !pass) ? s->hist : NULL);
+		if (r)
+		{
+			if (r < 0)
+				fprintf(stderr, "Error: invalid Y4M frame header in input file\n");
+			read_err = r < 0;
+			return 1;
+		}
+		s->frame = s->view;
+		if (pass)
+			s->ipos = (unsigned char*)s->view.Y - map.base;
+	}
+	else
+	{
+		long long size = yuv_size(&s->frame);
+		int r = (y4m_in && !direct_io) ? yuv_y4m_read_marker(fsrc) : 1;
+		long long n;
+		if (r > 0 && pass && (s->ipos = yuv_pass(&s->frame, fsrc)) >= 0)
+			n = size; // left in input file
+		else
+			n = (r <= 0) ? r : direct_io ? yuv_aio_read(ain, &s->frame, lazy ? s->hist : NULL)
+			  : lazy ? yuv_read_hist(&s->frame, fsrc, s->hist) : yuv_read(&s->frame, fsrc);
+		if (n != size)
+		{
+			if (r < 0)
+				fprintf(stderr, "Error: invalid Y4M frame header in input file\n");
+			else if (n < 0)
+				fprintf(stderr, "Error: can not read input file\n");
+			else if (n > 0)
+				fprintf(stderr, "Warning: incomplete last frame ignored (%lld of %lld bytes)\n", n, size);
+			read_err = n < 0;
+			return 1;
+		}
+	}
+	if (odepth == depth)
+		s->oframe = s->frame;
+	s->poc = nread++ + seek;
+	return 0;
+}
+
+/** Follow configurations, timeline and gain curve for picture poc; returns 1
+ * if grain shall be applied */
+static int update_grain(int poc)
+{
+	int apply;
+
+	if (update_cfg(poc))
+		fgain = ~0u;
+	apply = update_timeline(poc, &fgain);
+	if (ncurve && curve_gain(poc) != fgain)
+	{
+		fgain = curve_gain(poc);
+		vfgs_set_gain(fgain);
+	}
+	if (apply && !vfgs_grain_active()) // no sample would change
+	{
+		vfgs_skip_frame(width, height);
+		apply = 0;
+	}
+	return apply;
+}
+
+/** Write extra renditions of source frame src (grain applied if apply):
+ * each one from the same random generator state, only the scale LUTs
+ * (gain) are reprogrammed in between */
+static int write_renditions(const yuv* src, int apply)
+{
+	unsigned base = ncurve ? fgain : 100; // gain of output file
+	uint32 prng[2];
+	yuv frame, oframe;
+
+	yuv_pool_frame(rpool, 0, &frame);
+	if (ropool)
+		yuv_pool_frame(ropool, 0, &oframe);
+	vfgs_get_prng(prng);
+	for (int i=0; i<nrends; i++)
+	{
+		const rendition* r = &rends[i];
+		yuv out = *src;
+		if (apply)
+		{
+			vfgs_set_gain(base * r->gain / 100);
+			vfgs_set_prng(prng);
+			if (roi[2])
+				yuv_copy(&frame, src);
+			vfgs_add_grain(&frame, src, 0);
+			out = frame;
+		}
+		if (r->odepth < depth)
+		{
+			yuv_to_8bit(&oframe, &out);
+			out = oframe;
+		}
+		CHECK(!(r->y4m_out && yuv_y4m_write_marker(r->file)) && !yuv_write(&out, r->file), "can not write file %s", r->name);
+	}
+	if (apply)
+	{
+		vfgs_set_gain(base);
+		vfgs_set_prng(prng);
+	}
+	return 0;
+}
+
+/** Follow configurations, timeline and gain curve, then add grain */
+static int stage_grain(int k)
+{
+	frame_slot* s = &slots[k];
+	int apply = update_grain(s->poc); // grain applied to current picture
+	yuv src = s->frame;
+
+	assert(!apply || s->ipos < 0);
+	if (lazy && apply)
+		vfgs_make_pending_patterns(s->hist);
+	if (apply && map_input) // add grain out of place, from the mapping to a frame buffer
+	{
+		// The kernel reads whole 16-sample blocks: unless rows are made of
+		// these, copy first (not to read past the end of the mapping); also
+		// with --roi, for the rest of the picture
+		if ((width & 15) || roi[2])
+		{
+			yuv_copy(&s->buf, &s->frame);
+			src = s->buf;
+		}
+		s->frame = s->buf;
+		if (odepth == depth)
+			s->oframe = s->frame;
+	}
+	if (nrends && write_renditions(&src, apply))
+		return 1;
+	//yuv_pad(&s->frame);
+	if (apply)
+		vfgs_add_grain(&s->frame, &src, 0);
+	return 0;
+}
+
+/** Add grain to the frame left in input file (--strips): each strip is read,
+ * grained, converted and written to its place in output file in turn */
+static int stage_strips(int k)
+{
+	frame_slot* s = &slots[k];
+	int apply = update_grain(s->poc);
+	long long opos;
+
+	CHECK(!(y4m_out && yuv_y4m_write_marker(fdst)), "can not write output file");
+	if (!apply && odepth == depth)
+	{
+		CHECK(!yuv_transfer(fdst, fsrc, s->ipos, yuv_size(&whole)), "can not write output file");
+		return 0;
+	}
+	opos = yuv_tell(fdst);
+	for (int y=0; y<height; y+=16)
+	{
+		yuv_strip_rows(&s->frame, min(16, height - y));
+		yuv_strip_rows(&s->oframe, min(16, height - y));
+		CHECK(!yuv_read_strip(&s->frame, &whole, y, fsrc, s->ipos), "can not read input file");
+		if (apply && lazy)
+		{
+			yuv_hist(&s->frame, s->hist);
+			vfgs_make_pending_patterns(s->hist);
+		}
+		if (apply)
+			vfgs_add_grain(&s->frame, &s->frame, y);
+		if (odepth < depth)
+			yuv_to_8bit(&s->oframe, &s->frame);
+		CHECK(!yuv_write_strip(&s->oframe, &owhole, y, fdst, opos), "can not write output file");
 	}
+	CHECK(!yuv_set_pos(fdst, opos + yuv_size(&owhole)), "can not write output file");
+	return 0;
+}
+
+static int stage_convert(int k)
+{
+	yuv_to_8bit(&slots[k].oframe, &slots[k].frame);
+	return 0;
+}
+
+static int stage_write(int k)
+{
+	if (shm)
+		vfgs_shm_release(shm);
+	else if (slots[k].ipos >= 0)
+		CHECK(!(y4m_out && yuv_y4m_write_marker(fdst)) && !yuv_transfer(fdst, fsrc, slots[k].ipos, yuv_size(&slots[k].oframe)), "can not write output file")
+	else if (direct_io)
+		CHECK(!yuv_aio_write(aout, &slots[k].oframe), "can not write output file")
+	else
+		CHECK(!(y4m_out && yuv_y4m_write_marker(fdst)) && !yuv_write(&slots[k].oframe, fdst), "can not write output file");
+	if (map_input)
+		yuv_map_release(&map, &slots[k].view);
+	return 0;
+}
+
+/** Make output Y4M stream header, for bit depth od */
+static void output_header(yuv_y4m* hdr, int od)
+{
+	*hdr = y4m; // keep input tags
+	if (!y4m_in)
+		memset(hdr, 0, sizeof(*hdr));
+	if (od != depth)
+		hdr->chroma[0] = 0;
+	hdr->width = width;
+	hdr->height = height;
+	hdr->depth = od;
+	hdr->format = format;
+	hdr->fps_num = fps_num;
+	hdr->fps_den = fps_den;
+}
+
+/** Move Y4M input to frame seek through frame offset index (made from input
+ * file and saved, if the index file does not exist yet) */
+static int seek_index(yuv* frame)
+{
+	long long* offsets = NULL;
+	long long off;
+	int n = 0;
+	FILE* f = fopen(index_file, "rt");
+
+	if (f)
+	{
+		for (int size = 0; fscanf(f, "%lld", &off) == 1; offsets[n++] = off)
+			if (n == size)
+			{
+				long long* tmp = realloc(offsets, (size = size ? 2*size : 1024) * sizeof(long long));
+				CHECK(tmp, "out of memory");
+				offsets = tmp;
+			}
+		fclose(f);
+	}
+	else
+	{
+		offsets = yuv_y4m_scan(frame, fsrc, &n);
+		CHECK(offsets || yuv_tell(fsrc) < 0, "can not index input file (invalid Y4M frame header)");
+		CHECK(offsets, "can not index input file (--index needs a regular file)");
+		f = fopen(index_file, "wt");
+		CHECK(f, "can not create index file %s", index_file);
+		for (int k=0; k<n; k++)
+			fprintf(f, "%lld\n", offsets[k]);
+		CHECK(!fclose(f), "can not write index file %s", index_file);
+	}
+
+	if (seek < n)
+		CHECK(!yuv_y4m_seek(fsrc, offsets[seek]), "index file %s does not match input file (remove it to rebuild it)", index_file)
+	else
+		yuv_y4m_skip(frame, seek, fsrc); // beyond last frame
+	free(offsets);
+	return 0;
 }
 
 int main(int argc, const char **argv)
 {
 	int i;
 	int err=0;
-	yuv frame, oframe;
+	const char* serve_path = NULL;
 	unsigned gain = 100;
 	unsigned seed = 0;
+	int def_used;         // default configuration applies to the first picture(s)
+	yuv_y4m ohdr;         // output Y4M stream header
+	char header[512] = "";
 
 	// Parse parameters
 	for (i=1; i<argc && !err; i++)
@@ -698,17 +1073,35 @@ int main(int argc, const char **argv)
 		else if (!strcasecmp(param, "-b") || !strcasecmp(param, "--bitdepth"))    { if (i+1 < argc) depth  = atoi(argv[++i]); else err = 1; }
 		else if (                            !strcasecmp(param, "--outdepth"))    { if (i+1 < argc) odepth = atoi(argv[++i]); else err = 1; }
 		else if (!strcasecmp(param, "-f") || !strcasecmp(param, "--format"))      { if (i+1 < argc) format = read_format(argv[++i]); else err = 1; }
+		else if (                            !strcasecmp(param, "--layout"))      { if (i+1 < argc) err = read_layout(argv[++i]); else err = 1; }
 		else if (!strcasecmp(param, "-n") || !strcasecmp(param, "--frames"))      { if (i+1 < argc) frames = atoi(argv[++i]); else err = 1; }
 		else if (!strcasecmp(param, "-s") || !strcasecmp(param, "--seek"))        { if (i+1 < argc) seek   = atoi(argv[++i]); else err = 1; }
 		else if (!strcasecmp(param, "-r") || !strcasecmp(param, "--seed"))        { if (i+1 < argc) seed   = atoi(argv[++i]); else err = 1; }
 		else if (!strcasecmp(param, "-c") || !strcasecmp(param, "--cfg"))         { if (i+1 < argc) err = push_cfg(argv[++i]); else err = 1; }
+		else if (                            !strcasecmp(param, "--schedule"))    { if (i+1 < argc) err = read_schedule(argv[++i]); else err = 1; }
 		else if (!strcasecmp(param, "-g") || !strcasecmp(param, "--gain"))        { if (i+1 < argc) gain   = atoi(argv[++i]); else err = 1; }
+		else if (                            !strcasecmp(param, "--fps"))         { if (i+1 < argc) err = read_fps(argv[++i]); else err = 1; fps_set = 1; }
+		else if (                            !strcasecmp(param, "--gain-curve"))  { if (i+1 < argc) err = read_gain_curve(argv[++i]); else err = 1; }
+		else if (                            !strcasecmp(param, "--lazy"))        { lazy = 1; }
+		else if (                            !strcasecmp(param, "--compile-state")) { if (i+1 < argc) state_out = argv[++i]; else err = 1; }
+		else if (                            !strcasecmp(param, "--state"))       { if (i+1 < argc) state_in = argv[++i]; else err = 1; }
+		else if (                            !strcasecmp(param, "--index"))       { if (i+1 < argc) index_file = argv[++i]; else err = 1; }
+		else if (                            !strcasecmp(param, "--mmap"))        { map_input = 1; }
+		else if (                            !strcasecmp(param, "--uring"))       { direct_io = 1; }
+		else if (                            !strcasecmp(param, "--pipeline"))    { if (i+1 < argc) pipeline = atoi(argv[++i]); else err = 1; }
+		else if (                            !strcasecmp(param, "--shm"))         { if (i+1 < argc) shm_name = argv[++i]; else err = 1; }
+		else if (                            !strcasecmp(param, "--shm-slots"))   { if (i+1 < argc) shm_slots = atoi(argv[++i]); else err = 1; }
+		else if (                            !strcasecmp(param, "--strips"))      { strips = 1; }
+		else if (                            !strcasecmp(param, "--affinity"))    { if (i+1 < argc) err = read_cpus(argv[++i]); else err = 1; }
+		else if (                            !strcasecmp(param, "--rendition"))   { if (i+1 < argc) err = read_rendition(argv[++i]); else err = 1; }
+		else if (                            !strcasecmp(param, "--roi"))         { if (i+1 < argc) err = read_roi(argv[++i]); else err = 1; }
+		else if (                            !strcasecmp(param, "--serve"))       { if (i+1 < argc) serve_path = argv[++i]; else err = 1; }
 		else if (!strcasecmp(param, "-h") || !strcasecmp(param, "--help"))        { help(argv[0]); return 1; }
-		else if (param[0]!='-')
+		else if (param[0]!='-' || !param[1])
 		{
 			if (!fsrc)
 			{
-				fsrc = fopen(param, "rb");
+				fsrc = strcmp(param, "-") ? fopen(param, "rb") : stdin;
 				if (!fsrc)
 				{
 					printf("Can not open file %s\n\n", param);
@@ -717,7 +1110,8 @@ int main(int argc, const char **argv)
 			}
 			else if (!fdst)
 			{
-				fdst = fopen(param, "wb");
+				dst_name = param;
+				fdst = strcmp(param, "-") ? fopen(param, "wb") : stdout;
 				if (!fdst)
 				{
 					printf("Can not create file %s\n\n", param);
@@ -731,68 +1125,265 @@ int main(int argc, const char **argv)
 			err = 1;
 		}
 	}
-	if (!fsrc || !fdst || err)
+	if (serve_path && !err)
+	{
+		CHECK(vfgs_serve_supported(), "--serve is not supported in this build");
+		CHECK(!fsrc, "--serve takes no input or output file");
+		return vfgs_serve(serve_path);
+	}
+	if (((!fsrc || !fdst) && !state_out && !shm_name) || err)
 	{
 		help(argv[0]);
 		return 1;
 	}
-	if (check_cfg())
+#ifdef _MSC_VER
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	y4m_in = fsrc && yuv_y4m_probe(fsrc);
+	if (y4m_in)
+	{
+		CHECK(!yuv_y4m_read_header(fsrc, &y4m), "invalid or unsupported Y4M input (8 or 10-bit 4:2:0, 4:2:2 or 4:4:4 only)");
+		width = y4m.width;
+		height = y4m.height;
+		depth = y4m.depth;
+		format = y4m.format;
+		if (!fps_set && y4m.fps_num > 0 && y4m.fps_den > 0)
+		{
+			fps_num = y4m.fps_num;
+			fps_den = y4m.fps_den;
+		}
+	}
+	if (dst_name)
+	{
+		size_t len = strlen(dst_name);
+		y4m_out = (len > 4 && !strcasecmp(dst_name + len - 4, ".y4m")) || (!strcmp(dst_name, "-") && y4m_in);
+	}
+	if (load_cfgs(gain))
+	{
+		return 1;
+	}
+	// Default configuration: only for pictures before the first scheduled one
+	def_used = !state_in && (ncfg == 0 || config[0].poc > seek);
+	if (def_used && vfgs_check_cfg(&def, depth, format))
 	{
 		return 1;
 	}
 	odepth = odepth ? odepth : depth;
+	CHECK(pipeline >= 0, "invalid frame ring size %d", pipeline);
+	CHECK(!pipeline || vfgs_pipe_supported(), "--pipeline is not supported in this build");
+	CHECK(!direct_io || yuv_aio_supported(), "--uring is not supported in this build");
+	CHECK(!(direct_io && map_input), "--uring can not be combined with --mmap");
+	CHECK(!index_file || y4m_in, "--index needs a Y4M input");
+	CHECK(layout == YUV_PLANAR || (!y4m_in && !y4m_out), "Y4M files are planar (--layout planar)");
+	CHECK(layout != YUV_V210 || (depth == 10 && format == YUV_422 && odepth == 10), "v210 frames are 10-bit 4:2:2");
+	CHECK(!shm_name || vfgs_shm_supported(), "--shm is not supported in this build");
+	CHECK(!shm_name || (!fsrc && !fdst), "--shm replaces input and output files");
+	CHECK(!shm_name || (!map_input && !direct_io && !pipeline && !seek && odepth == depth),
+	      "--shm can not be combined with --mmap, --uring, --pipeline, --seek or --outdepth");
+	CHECK(shm_slots > 0, "invalid shared-memory ring size %d", shm_slots);
+	CHECK(!strips || (!map_input && !direct_io && !pipeline && !shm_name),
+	      "--strips can not be combined with --mmap, --uring, --pipeline or --shm");
+	CHECK(!strips || state_out || (yuv_tell(fsrc) >= 0 && yuv_tell(fdst) >= 0), "--strips needs regular input and output files");
+	CHECK(!roi[2] || (roi[0] + roi[2] <= width && roi[1] + roi[3] <= height), "region %dx%d at %d,%d out of picture", roi[2], roi[3], roi[0], roi[1]);
+	CHECK(!roi[2] || !strips, "--roi can not be combined with --strips");
+	CHECK(!nrends || (!direct_io && !pipeline && !shm_name && !strips),
+	      "--rendition can not be combined with --uring, --pipeline, --shm or --strips");
+	for (int k=0; k<nrends; k++)
+	{
+		CHECK(rends[k].odepth <= depth, "rendition %s: output bit depth %d above input one", rends[k].name, rends[k].odepth);
+		CHECK(layout != YUV_V210 || rends[k].odepth == 10, "v210 frames are 10-bit 4:2:2");
+		CHECK(layout == YUV_PLANAR || !rends[k].y4m_out, "Y4M files are planar (--layout planar)");
+	}
+	CHECK(!ncpus || !vfgs_pipe_pin(cpus[0]), "can not run on CPU %d (--affinity)", cpus[0]);
 
 	assert(depth==8 || depth==10);
 	assert((odepth==8 || odepth==10) && (odepth <= depth));
 	assert(width>=128);
 	assert(height>=128);
 
-	vfgs_set_depth(depth);
-	vfgs_set_chroma_subsampling((format < YUV_444)?2:1, (format < YUV_422)?2:1);
-	adjust_chroma_cfg();
-	apply_gain(gain);
-
-	if (afgs1.num_y_points)
-		vfgs_init_afgs1(&afgs1);
+	if (state_in)
+	{
+		const vfgs_hw_cfg* cfg;
+
+		// (the random generator state is in the file: -r is given when compiling)
+		CHECK(ncfg == 0 && !state_out && !seed, "--state can not be combined with -c, -r or --compile-state");
+		if (vfgs_state_load(state_in))
+			return 1;
+		cfg = vfgs_get_cfg();
+		CHECK(cfg->bs == depth - 8, "state file %s was compiled for a different bit depth", state_in);
+		CHECK(cfg->csubx == ((format < YUV_444)?2:1) && cfg->csuby == ((format < YUV_422)?2:1),
+		      "state file %s was compiled for a different chroma format", state_in);
+	}
 	else
-		vfgs_init_sei(&sei);
+	{
+		vfgs_set_depth(depth);
+		vfgs_set_chroma_subsampling((format < YUV_444)?2:1, (format < YUV_422)?2:1);
+		vfgs_set_lazy_patterns(lazy && !state_out); // a state file needs all patterns
+		if (def_used)
+		{
+			vfgs_adjust_chroma_cfg(par, format);
+			vfgs_apply_gain(par, gain);
+
+			vfgs_init_params(par);
+		}
+	}
+	vfgs_set_sample_layout(layout == YUV_SEMI ? 2 : 1, (layout == YUV_SEMI && depth > 8) ? 6 : 0);
 	if (seed)
 		vfgs_set_seed(seed);
 
-	yuv_alloc(width, height, depth, format, &frame);
-	if (odepth < depth)
-		yuv_alloc(width, height, odepth, format, &oframe);
+	if (state_out)
+	{
+		// Same state as when processing the first frame
+		update_cfg(seek);
+		update_timeline(seek, &fgain);
+		if (ncurve)
+			vfgs_set_gain(curve_gain(seek));
+		return vfgs_state_save(state_out);
+	}
+
+	// Frames on the NUMA node of the grain stage (that of the serial loop is
+	// pinned already)
+	nslots = pipeline ? pipeline : 1;
+	slots = calloc(nslots, sizeof(frame_slot));
+	CHECK(slots, "out of memory");
+	{
+		int rows = strips ? 16 : height;
+		int node = ncpus ? yuv_pool_cpu_node(cpus[pipeline ? 1 % ncpus : 0]) : -1;
+		if (!shm_name) // (else frames are ring slots)
+			CHECK(pool = yuv_pool_create(nslots, width, rows, depth, format, layout, node), "out of memory");
+		if (odepth < depth)
+			CHECK(opool = yuv_pool_create(nslots, width, rows, odepth, format, layout, node), "out of memory");
+		if (node >= 0 && ((pool && !(yuv_pool_flags(pool) & YUV_POOL_NUMA)) || (opool && !(yuv_pool_flags(opool) & YUV_POOL_NUMA))))
+			fprintf(stderr, "Warning: can not bind frames to NUMA node %d\n", node);
+	}
+	vfgs_pipe_affinity(cpus, ncpus);
+	for (int k=0; k<nslots; k++)
+	{
+		if (pool)
+			yuv_pool_frame(pool, k, &slots[k].buf);
+		slots[k].frame = slots[k].buf;
+		slots[k].oframe = slots[k].frame;
+		if (opool)
+			yuv_pool_frame(opool, k, &slots[k].oframe);
+	}
+	if (layout == YUV_V210)
+		CHECK(v210_line = malloc(((width + 15) & ~15) * 2 * sizeof(uint16)), "out of memory");
+	yuv_geometry(&whole, width, height, depth, format, layout, 0);
+	yuv_geometry(&owhole, width, height, odepth, format, layout, 0);
+
+	// Move to first frame
+	if (shm_name)
+	{
+		shm = vfgs_shm_create(shm_name, shm_slots, width, height, depth, format, layout);
+		CHECK(shm, "can not create shared-memory frame ring %s", shm_name);
+	}
+	else if (index_file)
+	{
+		if (seek_index(&whole))
+			return 1;
+	}
+	else if (y4m_in)
+		yuv_y4m_skip(&whole, seek, fsrc);
 	else
-		oframe = frame;
+		yuv_skip(&whole, seek, fsrc);
+
+	if (y4m_out)
+	{
+		output_header(&ohdr, odepth);
+		yuv_y4m_format_header(&ohdr, header, sizeof(header));
+	}
+	for (int k=0; k<nrends; k++)
+	{
+		yuv_y4m rhdr;
+		output_header(&rhdr, rends[k].odepth);
+		CHECK(!rends[k].y4m_out || !yuv_y4m_write_header(rends[k].file, &rhdr), "can not write file %s", rends[k].name);
+	}
+	for (int k=0; k<nrends; k++)
+	{
+		if (!rpool)
+			CHECK(rpool = yuv_pool_create(1, width, height, depth, format, layout, -1), "out of memory");
+		if (!ropool && rends[k].odepth < depth)
+			CHECK(ropool = yuv_pool_create(1, width, height, 8, format, layout, -1), "out of memory");
+	}
 
-	yuv_skip(&frame, seek, fsrc);
+	if (map_input)
+	{
+		CHECK(!yuv_map_open(&map, width, height, depth, format, layout, y4m_in, fsrc), "can not map input file (--mmap needs a regular file)");
+	}
+	else if (direct_io)
+	{
+		long long pos = yuv_tell(fsrc);
+		long long isize = yuv_size(&whole) + (y4m_in ? 6 : 0);
+		long long osize = yuv_size(&owhole) + (y4m_out ? 6 : 0);
+		long long n; // frames to write, if known
+
+		ain = yuv_aio_open_read(fsrc, pos, isize, y4m_in);
+		CHECK(ain, "can not open input file for --uring (needs a regular file)");
+		n = max((yuv_aio_file_size(ain) - pos) / isize, 0);
+		n = frames ? min(n, frames) : n;
+		aout = yuv_aio_open_write(fdst, osize * n + (long long)strlen(header), osize, y4m_out ? header : NULL);
+		CHECK(aout, "can not open output file for --uring (needs a regular file)");
+		if (!(yuv_aio_flags(ain) & yuv_aio_flags(aout) & YUV_AIO_DIRECT))
+			fprintf(stderr, "Warning: direct I/O not supported by file system, page cache is used\n");
+		if (!(yuv_aio_flags(ain) & yuv_aio_flags(aout) & YUV_AIO_ASYNC))
+			fprintf(stderr, "Warning: io_uring not available, I/O is synchronous\n");
+	}
+	if (y4m_out && !direct_io)
+		CHECK(!yuv_y4m_write_header(fdst, &ohdr), "can not write output file");
+
+	// Grain-free frames are copied from input to output file, unless converted
+	// (or streamed with --uring, or programmed from a state file)
+	passthrough = odepth == depth && !direct_io && !state_in && !shm && !nrends;
+	clipping = def.afgs1.clip_to_restricted_range;
+	for (int k=0; k<nparams; k++)
+	{
+		clipping |= params[k]->afgs1.clip_to_restricted_range;
+		for (int l=0; l<params[k]->ntbl; l++)
+			clipping |= params[k]->tbl[l].afgs1.clip_to_restricted_range;
+	}
 
 	// Process frames
-	for (int n = 0; ((frames == 0) || (n < frames)) && !ferror(fsrc); n++)
+	if (pipeline)
 	{
-		while (icfg < ncfg && (n + seek) >= config[icfg].poc)
+		vfgs_stage stages[4] = { stage_read, stage_grain, stage_write };
+		int nstages = 3;
+		if (odepth < depth)
 		{
-			if (pop_cfg(gain))
-				break;
-			if (afgs1.num_y_points)
-				vfgs_init_afgs1(&afgs1);
-			else
-				vfgs_init_sei(&sei);
+			stages[2] = stage_convert;
+			stages[3] = stage_write;
+			nstages = 4;
 		}
-		yuv_read(&frame, fsrc);
-		if (feof(fsrc))
-			break;
-		//yuv_pad(&frame);
-		vfgs_add_grain(&frame);
-		if (odepth < depth)
-			yuv_to_8bit(&oframe, &frame);
-		yuv_write(&oframe, fdst);
+		err = vfgs_pipe_run(stages, nstages, nslots);
 	}
+	else if (strips)
+		while (!stage_read(0) && !(err = stage_strips(0)))
+			;
+	else
+		while (!stage_read(0) && !(err = stage_grain(0)) && (odepth == depth || !stage_convert(0)) && !(err = stage_write(0)))
+			;
 
-	yuv_free(&frame);
-	if (odepth < depth)
-		yuv_free(&oframe);
+	yuv_pool_free(pool);
+	yuv_pool_free(opool);
+	yuv_pool_free(rpool);
+	yuv_pool_free(ropool);
+	free(v210_line);
+	for (int k=0; k<nrends; k++)
+		if (fclose(rends[k].file) && !err)
+		{
+			fprintf(stderr, "Error: can not write file %s\n", rends[k].name);
+			err = 1;
+		}
+	free(slots);
+	yuv_map_close(&map);
+	vfgs_shm_close(shm);
+	yuv_aio_close(ain);
+	if (yuv_aio_close(aout) && !err)
+	{
+		fprintf(stderr, "Error: can not write output file\n");
+		err = 1;
+	}
 
-	return 0;
+	return err || read_err;
 }
 
@@ -0,0 +1,664 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "vfgs_nal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) { if (!(cond)) { fprintf(stderr, "Error: "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); return 1; } }
+
+#define VCL_HEADER_BYTES 256 // bytes kept from slice NAL units (enough to reach the picture order count)
+#define SEI_FGC 19           // film grain characteristics SEI payload type (HEVC and VVC)
+
+enum { HEVC, VVC };
+
+// Annex B byte stream reader: NAL units, with emulation prevention bytes removed
+typedef struct nal_reader_s {
+	FILE* f;
+	int codec; // -1 until first NAL unit
+	uint8 buf[1<<16];
+	int pos, len;
+	uint8* nal; // current NAL unit (header included)
+	int size;
+	int cap;
+} nal_reader;
+
+// Bitstream (RBSP) reader; reads zeros past the end
+typedef struct bits_s {
+	const uint8* p;
+	int size; // bytes
+	int pos;  // bits
+} bits;
+
+typedef struct sps_info_s {
+	uint8 valid;
+	uint8 log2_max_poc_lsb;
+	uint8 separate_colour_plane; // HEVC
+} sps_info;
+
+typedef struct pps_info_s {
+	uint8 valid;
+	uint8 sps_id;
+	uint8 output_flag_present; // HEVC
+	uint8 extra_bits;          // HEVC
+} pps_info;
+
+// Picture, in decoding order
+typedef struct pic_info_s {
+	int cvs;    // coded video sequence index
+	int poc;
+	int output; // 0: not output (pic_output_flag, or RASL of a starting CRA)
+	int sei;    // FGC SEI index, or -1
+} pic_info;
+
+typedef struct annexb_s {
+	sps_info sps[16];
+	pps_info pps[64];
+	pic_info* pics;
+	int npics;
+	fgs_sei_entry* seis; // distinct FGC SEIs, in decoding order (poc: unused)
+	int nsei;
+	int pending;    // FGC SEI of the access unit in progress, or -1
+	int cvs;
+	int start;      // next IRAP starts a coded video sequence (start of stream, or after end of sequence)
+	int skip_rasl;  // associated IRAP started a coded video sequence
+	int prev_poc;   // prevTid0Pic picture order count
+	struct { int valid, poc_lsb, non_ref; unsigned pps_id; } ph; // VVC picture header, waiting for its first slice
+} annexb;
+
+static int next_byte(nal_reader* r)
+{
+	if (r->pos == r->len)
+	{
+		r->len = (int)fread(r->buf, 1, sizeof(r->buf), r->f);
+		r->pos = 0;
+		if (!r->len)
+			return -1;
+	}
+	return r->buf[r->pos++];
+}
+
+static int is_vcl(int codec, const uint8* h)
+{
+	return codec == HEVC ? (h[0] >> 1) < 32 : (h[1] >> 3) < 12;
+}
+
+static void skip_to_start_code(nal_reader* r)
+{
+	int b, zeros = 0;
+
+	while ((b = next_byte(r)) >= 0 && !(zeros >= 2 && b == 1))
+		zeros = b ? 0 : zeros + 1;
+}
+
+// Read up to next start code; returns 0 at end of stream, -1 if out of memory
+static int read_nal(nal_reader* r)
+{
+	int b, zeros = 0, n = 0, max = 0x7fffffff;
+
+	while ((b = next_byte(r)) >= 0)
+	{
+		if (zeros >= 2 && b == 1) // start code
+			break;
+		if (zeros >= 2 && b == 3) // emulation prevention byte
+		{
+			zeros = 0;
+			continue;
+		}
+		zeros = b ? 0 : zeros + 1;
+		if (n == max)
+			continue;
+		if (n == r->cap)
+		{
+			r->cap = r->cap ? 2*r->cap : 4096;
+			r->nal = realloc(r->nal, r->cap);
+			if (!r->nal)
+				return -1;
+		}
+		r->nal[n++] = (uint8)b;
+		if (n == 2)
+		{
+			if (r->codec < 0) // HEVC NAL unit header starts with its type, VVC one with nuh_layer_id (0 for base layer)
+				r->codec = r->nal[0] ? HEVC : VVC;
+			if (is_vcl(r->codec, r->nal))
+				max = VCL_HEADER_BYTES; // slice data is not needed
+		}
+	}
+	while (n && !r->nal[n-1]) // trailing zero bytes (part of next start code, or cabac_zero_words)
+		n --;
+	r->size = n;
+
+	return b >= 0 || n;
+}
+
+static unsigned u(bits* b, int n)
+{
+	unsigned v = 0;
+	for (; n > 0; n--, b->pos++)
+		v = (v << 1) | ((b->pos >> 3) < b->size ? (b->p[b->pos >> 3] >> (7 - (b->pos & 7))) & 1 : 0);
+	return v;
+}
+
+static void skip(bits* b, int n)
+{
+	b->pos += n;
+}
+
+static unsigned ue(bits* b)
+{
+	int lz = 0;
+	while (!u(b, 1) && lz < 32)
+		lz ++;
+	return lz < 32 ? (1u << lz) - 1 + u(b, lz) : 0;
+}
+
+static int se(bits* b)
+{
+	unsigned k = ue(b);
+	return (k & 1) ? (int)((k + 1) >> 1) : -(int)(k >> 1);
+}
+
+static int overrun(const bits* b)
+{
+	return b->pos > 8 * b->size;
+}
+
+static int ceil_log2(int x)
+{
+	int n = 0;
+	while ((1 << n) < x)
+		n ++;
+	return n;
+}
+
+// Film grain characteristics SEI payload (same syntax in HEVC and VVC)
+static int read_fgc(bits* b, fgs_sei_entry* e)
+{
+	fgs_sei* sei = &e->sei;
+
+	memset(e, 0, sizeof(*e));
+	if (u(b, 1)) // fg_characteristics_cancel_flag
+		return 0;
+	sei->model_id = u(b, 2);
+	if (u(b, 1)) // fg_separate_colour_description_present_flag
+		skip(b, 3+3+1+8+8+8);
+	skip(b, 2); // fg_blending_mode_id (additive assumed)
+	sei->log2_scale_factor = u(b, 4);
+	for (int c=0; c<3; c++)
+		sei->comp_model_present_flag[c] = u(b, 1);
+	for (int c=0; c<3; c++)
+		if (sei->comp_model_present_flag[c])
+		{
+			sei->num_intensity_intervals[c] = u(b, 8) + 1;
+			sei->num_model_values[c] = u(b, 3) + 1;
+			CHECK(sei->num_model_values[c] <= SEI_MAX_MODEL_VALUES, "fg_num_model_values_minus1 higher than %d", SEI_MAX_MODEL_VALUES-1);
+			for (int i=0; i<sei->num_intensity_intervals[c]; i++)
+			{
+				sei->intensity_interval_lower_bound[c][i] = u(b, 8);
+				sei->intensity_interval_upper_bound[c][i] = u(b, 8);
+				for (int j=0; j<sei->num_model_values[c]; j++)
+					sei->comp_model_value[c][i][j] = se(b);
+				vfgs_fill_model_array(sei->comp_model_value[c][i], sei->num_model_values[c], sei->model_id, sei->log2_scale_factor);
+			}
+		}
+	e->persist = u(b, 1);
+	e->apply = 1;
+	CHECK(!overrun(b), "truncated film grain characteristics SEI");
+
+	return 0;
+}
+
+// Prefix SEI NAL unit: keep FGC SEI for the next picture
+static int read_sei(annexb* x, bits* b)
+{
+	int type, size, v;
+
+	while ((b->pos >> 3) < b->size - 1) // more_rbsp_data()
+	{
+		type = size = 0;
+		do { v = u(b, 8); type += v; } while (v == 0xFF);
+		do { v = u(b, 8); size += v; } while (v == 0xFF);
+		CHECK((b->pos >> 3) + size <= b->size, "truncated SEI message");
+		if (type == SEI_FGC) // if several in the access unit, last one wins
+		{
+			bits p = { b->p + (b->pos >> 3), size, 0 };
+			fgs_sei_entry e;
+			if (read_fgc(&p, &e))
+				return 1;
+			if (x->nsei && !memcmp(&e, &x->seis[x->nsei-1], sizeof(e)))
+				x->pending = x->nsei-1; // repeated SEI (e.g. at each picture): shared
+			else
+			{
+				if ((x->nsei & (x->nsei - 1)) == 0) // grow at powers of 2
+				{
+					fgs_sei_entry* s = realloc(x->seis, (x->nsei ? 2*x->nsei : 1) * sizeof(fgs_sei_entry));
+					CHECK(s, "out of memory");
+					x->seis = s;
+				}
+				memcpy(&x->seis[x->nsei], &e, sizeof(e));
+				x->pending = x->nsei++;
+			}
+		}
+		b->pos += 8 * size;
+	}
+	return 0;
+}
+
+// New picture: picture order count (8.3.1 in both HEVC and VVC), and pending FGC SEI
+static int add_pic(annexb* x, int irap, int norasl, int rasl, int tid0, int poc_lsb, int log2_max_poc_lsb, int output)
+{
+	int poc, max = 1 << log2_max_poc_lsb;
+	pic_info* p;
+
+	if (irap && (norasl || x->start))
+	{
+		// NoRaslOutputFlag (HEVC) / NoOutputBeforeRecoveryFlag (VVC)
+		x->cvs ++;
+		x->start = 0;
+		x->skip_rasl = 1;
+		poc = poc_lsb;
+	}
+	else
+	{
+		int prev_lsb = x->prev_poc & (max - 1);
+		int msb = x->prev_poc - prev_lsb;
+		if (poc_lsb < prev_lsb && prev_lsb - poc_lsb >= max / 2)
+			msb += max;
+		else if (poc_lsb > prev_lsb && poc_lsb - prev_lsb > max / 2)
+			msb -= max;
+		poc = msb + poc_lsb;
+		if (irap)
+			x->skip_rasl = 0;
+	}
+	if (tid0)
+		x->prev_poc = poc;
+
+	if ((x->npics & (x->npics - 1)) == 0) // grow at powers of 2
+	{
+		p = realloc(x->pics, (x->npics ? 2*x->npics : 1) * sizeof(pic_info));
+		CHECK(p, "out of memory");
+		x->pics = p;
+	}
+	p = &x->pics[x->npics++];
+	p->cvs = x->cvs;
+	p->poc = poc;
+	p->output = output && !(rasl && x->skip_rasl);
+	p->sei = x->pending;
+	x->pending = -1;
+
+	return 0;
+}
+
+static void hevc_ptl(bits* b, int max_sub_layers_minus1)
+{
+	int profile[8], level[8];
+
+	skip(b, 88 + 8); // general profile, general_level_idc
+	for (int i=0; i<max_sub_layers_minus1; i++)
+	{
+		profile[i] = u(b, 1);
+		level[i] = u(b, 1);
+	}
+	if (max_sub_layers_minus1 > 0)
+		skip(b, 2 * (8 - max_sub_layers_minus1)); // reserved_zero_2bits
+	for (int i=0; i<max_sub_layers_minus1; i++)
+		skip(b, (profile[i] ? 88 : 0) + (level[i] ? 8 : 0));
+}
+
+static int hevc_sps(annexb* x, bits* b)
+{
+	unsigned id;
+	int max_sub_layers_minus1, sep = 0;
+
+	skip(b, 4); // sps_video_parameter_set_id
+	max_sub_layers_minus1 = u(b, 3);
+	skip(b, 1); // sps_temporal_id_nesting_flag
+	hevc_ptl(b, max_sub_layers_minus1);
+	id = ue(b);
+	CHECK(id < 16, "invalid sps_seq_parameter_set_id");
+	if (ue(b) == 3) // chroma_format_idc
+		sep = u(b, 1);
+	ue(b); ue(b); // pic_width/height_in_luma_samples
+	if (u(b, 1)) // conformance_window_flag
+		{ ue(b); ue(b); ue(b); ue(b); }
+	ue(b); ue(b); // bit_depth_luma/chroma_minus8
+	x->sps[id].log2_max_poc_lsb = ue(b) + 4;
+	x->sps[id].separate_colour_plane = sep;
+	x->sps[id].valid = 1;
+	CHECK(!overrun(b) && x->sps[id].log2_max_poc_lsb <= 16, "invalid sequence parameter set");
+
+	return 0;
+}
+
+static int hevc_pps(annexb* x, bits* b)
+{
+	unsigned id = ue(b), sps_id = ue(b);
+
+	CHECK(id < 64, "invalid pps_pic_parameter_set_id");
+	CHECK(sps_id < 16, "invalid pps_seq_parameter_set_id");
+	x->pps[id].sps_id = sps_id;
+	skip(b, 1); // dependent_slice_segments_enabled_flag
+	x->pps[id].output_flag_present = u(b, 1);
+	x->pps[id].extra_bits = u(b, 3);
+	x->pps[id].valid = 1;
+
+	return 0;
+}
+
+static int hevc_slice(annexb* x, bits* b, int type, int tid)
+{
+	int irap = type >= 16 && type <= 23;
+	int idr = type == 19 || type == 20;
+	int bla = type >= 16 && type <= 18;
+	int rasl = type == 8 || type == 9;
+	int radl = type == 6 || type == 7;
+	int slnr = type <= 14 && !(type & 1); // sub-layer non-reference
+	int output = 1, poc_lsb = 0;
+	unsigned id;
+	const pps_info* pps;
+	const sps_info* sps;
+
+	if (!u(b, 1)) // first_slice_segment_in_pic_flag
+		return 0;
+	if (irap)
+		skip(b, 1); // no_output_of_prior_pics_flag
+	id = ue(b);
+	CHECK(id < 64 && x->pps[id].valid, "slice refers to missing picture parameter set");
+	pps = &x->pps[id];
+	sps = &x->sps[pps->sps_id];
+	CHECK(sps->valid, "slice refers to missing sequence parameter set");
+	skip(b, pps->extra_bits); // slice_reserved_flag
+	ue(b); // slice_type
+	if (pps->output_flag_present)
+		output = u(b, 1);
+	if (sps->separate_colour_plane)
+		skip(b, 2); // colour_plane_id
+	if (!idr)
+		poc_lsb = u(b, sps->log2_max_poc_lsb);
+	CHECK(!overrun(b), "truncated slice header");
+
+	return add_pic(x, irap, idr || bla, rasl, tid == 0 && !rasl && !radl && !slnr, poc_lsb, sps->log2_max_poc_lsb, output);
+}
+
+static void vvc_ptl(bits* b, int max_sublayers_minus1)
+{
+	int level[8];
+
+	skip(b, 7 + 1 + 8 + 1 + 1); // general_profile_idc, general_tier_flag, general_level_idc, ptl_frame_only_constraint_flag, ptl_multilayer_enabled_flag
+	if (u(b, 1)) // gci_present_flag
+	{
+		skip(b, 71); // general constraint flags
+		skip(b, u(b, 8)); // gci_num_additional_bits
+	}
+	skip(b, -b->pos & 7); // gci_alignment_zero_bit
+	for (int i=max_sublayers_minus1-1; i>=0; i--)
+		level[i] = u(b, 1);
+	skip(b, -b->pos & 7); // ptl_reserved_zero_bit
+	for (int i=max_sublayers_minus1-1; i>=0; i--)
+		if (level[i])
+			skip(b, 8);
+	skip(b, 32 * u(b, 8)); // ptl_num_sub_profiles, general_sub_profile_idc
+}
+
+static int vvc_sps(annexb* x, bits* b)
+{
+	int id, max_sublayers_minus1, ctb_log2;
+	unsigned w, h;
+
+	id = u(b, 4);
+	skip(b, 4); // sps_video_parameter_set_id
+	max_sublayers_minus1 = u(b, 3);
+	skip(b, 2); // sps_chroma_format_idc
+	ctb_log2 = u(b, 2) + 5;
+	if (u(b, 1)) // sps_ptl_dpb_hrd_params_present_flag
+		vvc_ptl(b, max_sublayers_minus1);
+	skip(b, 1); // sps_gdr_enabled_flag
+	if (u(b, 1)) // sps_ref_pic_resampling_enabled_flag
+		skip(b, 1); // sps_res_change_in_clvs_allowed_flag
+	w = ue(b);
+	h = ue(b);
+	if (u(b, 1)) // sps_conformance_window_flag
+		{ ue(b); ue(b); ue(b); ue(b); }
+	if (u(b, 1)) // sps_subpic_info_present_flag
+	{
+		unsigned n = ue(b) + 1;
+		unsigned len;
+		int indep = 1, same = 0;
+		int wbits = ceil_log2((w + (1u << ctb_log2) - 1) >> ctb_log2);
+		int hbits = ceil_log2((h + (1u << ctb_log2) - 1) >> ctb_log2);
+		CHECK(n <= 600, "invalid sps_num_subpics_minus1");
+		if (n > 1)
+		{
+			indep = u(b, 1);
+			same = u(b, 1);
+		}
+		for (int i=0; n > 1 && i < (int)n; i++)
+		{
+			if (!same || i == 0)
+			{
+				if (i > 0 && w > (1u << ctb_log2))        skip(b, wbits);
+				if (i > 0 && h > (1u << ctb_log2))        skip(b, hbits);
+				if (i < (int)n-1 && w > (1u << ctb_log2)) skip(b, wbits);
+				if (i < (int)n-1 && h > (1u << ctb_log2)) skip(b, hbits);
+			}
+			if (!indep)
+				skip(b, 2); // sps_subpic_treated_as_pic_flag, sps_loop_filter_across_subpic_enabled_flag
+		}
+		len = ue(b) + 1; // sps_subpic_id_len_minus1
+		CHECK(len <= 16, "invalid sps_subpic_id_len_minus1");
+		if (u(b, 1) && u(b, 1)) // sps_subpic_id_mapping_explicitly_signalled_flag, sps_subpic_id_mapping_present_flag
+			skip(b, n * len);
+	}
+	ue(b); // sps_bitdepth_minus8
+	skip(b, 2); // sps_entropy_coding_sync_enabled_flag, sps_entry_point_offsets_present_flag
+	x->sps[id].log2_max_poc_lsb = u(b, 4) + 4;
+	x->sps[id].valid = 1;
+	CHECK(!overrun(b) && x->sps[id].log2_max_poc_lsb <= 16, "invalid sequence parameter set");
+
+	return 0;
+}
+
+static int vvc_pps(annexb* x, bits* b)
+{
+	int id = u(b, 6);
+
+	x->pps[id].sps_id = u(b, 4);
+	x->pps[id].valid = 1;
+	CHECK(!overrun(b), "invalid picture parameter set");
+
+	return 0;
+}
+
+// Picture header (PH NAL unit, or in slice header)
+static int vvc_ph(annexb* x, bits* b)
+{
+	const sps_info* sps;
+	int gdr_or_irap = u(b, 1);
+
+	x->ph.non_ref = u(b, 1);
+	if (gdr_or_irap)
+		skip(b, 1); // ph_gdr_pic_flag
+	if (u(b, 1)) // ph_inter_slice_allowed_flag
+		skip(b, 1); // ph_intra_slice_allowed_flag
+	x->ph.pps_id = ue(b);
+	CHECK(x->ph.pps_id < 64 && x->pps[x->ph.pps_id].valid, "picture header refers to missing picture parameter set");
+	sps = &x->sps[x->pps[x->ph.pps_id].sps_id];
+	CHECK(sps->valid, "picture header refers to missing sequence parameter set");
+	x->ph.poc_lsb = u(b, sps->log2_max_poc_lsb);
+	x->ph.valid = 1;
+	CHECK(!overrun(b), "truncated picture header");
+
+	return 0;
+}
+
+static int vvc_slice(annexb* x, bits* b, int type, int tid)
+{
+	int irap = type >= 7 && type <= 10; // IDR, CRA, GDR
+	int idr = type == 7 || type == 8;
+	int rasl = type == 3;
+	int radl = type == 2;
+
+	if (u(b, 1)) // sh_picture_header_in_slice_header_flag
+	{
+		if (vvc_ph(x, b))
+			return 1;
+	}
+	else if (!x->ph.valid) // not the first slice of the picture
+		return 0;
+	x->ph.valid = 0;
+
+	return add_pic(x, irap, idr, rasl, tid == 0 && !rasl && !radl && !x->ph.non_ref, x->ph.poc_lsb,
+	               x->sps[x->pps[x->ph.pps_id].sps_id].log2_max_poc_lsb, 1);
+}
+
+static int read_nal_unit(annexb* x, int codec, const uint8* nal, int size)
+{
+	bits b = { nal + 2, size - 2, 0 };
+	int type, layer, tid;
+
+	if (size < 2)
+		return 0;
+	if (codec == HEVC)
+	{
+		type = nal[0] >> 1;
+		layer = ((nal[0] & 1) << 5) | (nal[1] >> 3);
+	}
+	else
+	{
+		type = nal[1] >> 3;
+		layer = nal[0] & 0x3F;
+	}
+	tid = (nal[1] & 7) - 1;
+	if (layer) // base layer only
+		return 0;
+
+	if (codec == HEVC)
+		switch (type)
+		{
+			case 33: return hevc_sps(x, &b);
+			case 34: return hevc_pps(x, &b);
+			case 36: x->start = 1; return 0; // end of sequence
+			case 39: return read_sei(x, &b);
+			default: return type < 32 ? hevc_slice(x, &b, type, tid) : 0;
+		}
+	else
+		switch (type)
+		{
+			case 15: return vvc_sps(x, &b);
+			case 16: return vvc_pps(x, &b);
+			case 19: return vvc_ph(x, &b);
+			case 21: x->start = 1; return 0; // end of sequence
+			case 23: return read_sei(x, &b);
+			default: return type < 12 ? vvc_slice(x, &b, type, tid) : 0;
+		}
+}
+
+static int cmp_pic(const void* a, const void* b)
+{
+	const pic_info* p = a;
+	const pic_info* q = b;
+	return p->cvs != q->cvs ? p->cvs - q->cvs : p->poc - q->poc;
+}
+
+/** Check for an Annex B start code at the start of file (file position is kept) */
+int vfgs_is_annexb(FILE* f)
+{
+	uint8 s[4] = {0};
+	long pos = ftell(f);
+	size_t n = fread(s, 1, 4, f);
+
+	fseek(f, pos, SEEK_SET);
+	return n >= 3 && !s[0] && !s[1] && (s[2] == 1 || (n == 4 && !s[2] && s[3] == 1));
+}
+
+/** Read all FGC SEIs of an HEVC or VVC Annex B bitstream */
+int vfgs_read_annexb(fgs_params* par, FILE* f, const char* filename)
+{
+	nal_reader r;
+	annexb x;
+	int err = 0, n = 0, frame = 0, cvs = -1;
+
+	par->afgs1.num_y_points = 0; // FGC SEI mode
+	par->afgs1.num_cb_points = 0;
+	par->afgs1.num_cr_points = 0;
+	vfgs_free_cfg(par);
+
+	memset(&r, 0, sizeof(r));
+	memset(&x, 0, sizeof(x));
+	r.f = f;
+	r.codec = -1;
+	x.pending = -1;
+	x.cvs = -1;
+	x.start = 1;
+
+	skip_to_start_code(&r);
+	while (!err && (n = read_nal(&r)) > 0)
+		err = read_nal_unit(&x, r.codec, r.nal, r.size);
+	if (n < 0)
+	{
+		fprintf(stderr, "Error: out of memory\n");
+		err = 1;
+	}
+	free(r.nal);
+
+	// Output order: by coded video sequence, then picture order count
+	if (x.npics)
+		qsort(x.pics, x.npics, sizeof(pic_info), cmp_pic);
+	for (int k=0; !err && k<x.npics; k++)
+	{
+		const pic_info* p = &x.pics[k];
+		if (!p->output)
+			continue;
+		if (p->sei >= 0)
+		{
+			memcpy(&par->sei, &x.seis[p->sei].sei, sizeof(fgs_sei));
+			err = vfgs_push_sei(par, frame, x.seis[p->sei].apply, x.seis[p->sei].persist);
+		}
+		else if (p->cvs != cvs && par->nsei && par->seis[par->nsei-1].persist)
+			err = vfgs_push_sei(par, frame, 0, 0); // persistence ends with the coded video sequence
+		cvs = p->cvs;
+		frame ++;
+	}
+	free(x.pics);
+	free(x.seis);
+	if (err)
+		return 1;
+
+	CHECK(par->nsei, "no film grain characteristics SEI found in %s", filename);
+	memcpy(&par->sei, &par->seis[0].sei, sizeof(fgs_sei));
+
+	return 0;
+}
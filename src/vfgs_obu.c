@@ -0,0 +1,1043 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "vfgs_obu.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) { if (!(cond)) { fprintf(stderr, "Error: "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); return 1; } }
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+
+enum { OBU_SEQUENCE_HEADER = 1, OBU_FRAME_HEADER = 3, OBU_FRAME = 6 };
+enum { KEY_FRAME, INTER_FRAME, INTRA_ONLY_FRAME, SWITCH_FRAME };
+enum { IDENTITY, TRANSLATION, ROTZOOM, AFFINE };
+
+#define NUM_REF_FRAMES     8
+#define REFS_PER_FRAME     7
+#define PRIMARY_REF_NONE   7
+#define ALL_FRAMES         0xFF
+
+// Bitstream reader (AV1 descriptors); reads zeros past the end
+typedef struct bits_s {
+	const uint8* p;
+	int size; // bytes
+	int pos;  // bits
+} bits;
+
+// Reference frame state, as far as header parsing depends on it
+typedef struct ref_frame_s {
+	uint8 valid;
+	uint8 frame_type;
+	int upscaled_width, frame_width, frame_height, render_width, render_height;
+	int order_hint;
+	uint8 alt_q_enabled[8]; // segmentation quantizer feature (for CodedLossless)
+	int alt_q[8];
+	uint8 apply_grain;
+	fgs_afgs1 grain;
+} ref_frame;
+
+typedef struct av1_s {
+	// Sequence header
+	int seen;
+	int reduced_still_picture_header;
+	int decoder_model_info_present, equal_picture_interval;
+	int buffer_removal_time_length, frame_presentation_time_length;
+	int op_cnt;
+	int op_idc[32];
+	uint8 decoder_model_present[32];
+	int frame_width_bits, frame_height_bits, max_frame_width, max_frame_height;
+	int frame_id_numbers_present, delta_frame_id_length, id_len;
+	int use_128x128_superblock;
+	int enable_warped_motion, enable_order_hint, enable_ref_frame_mvs, order_hint_bits;
+	int seq_force_screen_content_tools, seq_force_integer_mv;
+	int enable_superres, enable_cdef, enable_restoration;
+	int mono_chrome, subsampling_x, subsampling_y, separate_uv_delta_q;
+	int film_grain_params_present;
+
+	ref_frame ref[NUM_REF_FRAMES];
+	int frames; // shown frames so far
+} av1;
+
+static unsigned f(bits* b, int n)
+{
+	unsigned v = 0;
+	for (; n > 0; n--, b->pos++)
+		v = (v << 1) | ((b->pos >> 3) < b->size ? (b->p[b->pos >> 3] >> (7 - (b->pos & 7))) & 1 : 0);
+	return v;
+}
+
+static void skip(bits* b, int n)
+{
+	b->pos += n;
+}
+
+static int su(bits* b, int n)
+{
+	int v = f(b, n);
+	return (v & (1 << (n-1))) ? v - (1 << n) : v;
+}
+
+static unsigned ns(bits* b, unsigned n)
+{
+	int w = 0;
+	unsigned m, v;
+
+	while ((n >> w) > 1) // FloorLog2(n)
+		w ++;
+	w ++;
+	m = (1u << w) - n;
+	v = f(b, w-1);
+	return v < m ? v : (v << 1) - m + f(b, 1);
+}
+
+static unsigned uvlc(bits* b)
+{
+	int lz = 0;
+	while (!f(b, 1) && lz < 32)
+		lz ++;
+	return lz < 32 ? (1u << lz) - 1 + f(b, lz) : 0;
+}
+
+static int overrun(const bits* b)
+{
+	return b->pos > 8 * b->size;
+}
+
+// Read leb128() from buffer; returns bytes read, 0 if invalid
+static int leb128(const uint8* p, int size, unsigned long long* v)
+{
+	*v = 0;
+	for (int i=0; i<8 && i<size; i++)
+	{
+		*v |= (unsigned long long)(p[i] & 0x7f) << (7*i);
+		if (!(p[i] & 0x80))
+			return i+1;
+	}
+	return 0;
+}
+
+static int tile_log2(int blk, int target)
+{
+	int k;
+	for (k = 0; (blk << k) < target; k++)
+		;
+	return k;
+}
+
+static int get_relative_dist(const av1* s, int a, int b)
+{
+	int diff, m;
+
+	if (!s->enable_order_hint)
+		return 0;
+	diff = a - b;
+	m = 1 << (s->order_hint_bits - 1);
+	return (diff & (m - 1)) - (diff & m);
+}
+
+static void color_config(av1* s, bits* b, int seq_profile)
+{
+	int bit_depth = 8, cp = 2, tc = 2, mc = 2;
+
+	if (f(b, 1)) // high_bitdepth
+		bit_depth = (seq_profile == 2 && f(b, 1)) ? 12 : 10;
+	s->mono_chrome = seq_profile == 1 ? 0 : f(b, 1);
+	if (f(b, 1)) // color_description_present_flag
+	{
+		cp = f(b, 8);
+		tc = f(b, 8);
+		mc = f(b, 8);
+	}
+	if (s->mono_chrome)
+	{
+		skip(b, 1); // color_range
+		s->subsampling_x = s->subsampling_y = 1;
+		s->separate_uv_delta_q = 0;
+		return;
+	}
+	else if (cp == 1 && tc == 13 && mc == 0) // sRGB
+		s->subsampling_x = s->subsampling_y = 0;
+	else
+	{
+		skip(b, 1); // color_range
+		if (seq_profile == 0)
+			s->subsampling_x = s->subsampling_y = 1;
+		else if (seq_profile == 1)
+			s->subsampling_x = s->subsampling_y = 0;
+		else if (bit_depth == 12)
+		{
+			s->subsampling_x = f(b, 1);
+			s->subsampling_y = s->subsampling_x ? f(b, 1) : 0;
+		}
+		else
+		{
+			s->subsampling_x = 1;
+			s->subsampling_y = 0;
+		}
+		if (s->subsampling_x && s->subsampling_y)
+			skip(b, 2); // chroma_sample_position
+	}
+	s->separate_uv_delta_q = f(b, 1);
+}
+
+static int sequence_header(av1* s, bits* b)
+{
+	int seq_profile = f(b, 3);
+
+	skip(b, 1); // still_picture
+	s->reduced_still_picture_header = f(b, 1);
+	s->decoder_model_info_present = 0;
+	s->equal_picture_interval = 0;
+	s->op_cnt = 1;
+	s->op_idc[0] = 0;
+	s->decoder_model_present[0] = 0;
+	if (s->reduced_still_picture_header)
+		skip(b, 5); // seq_level_idx[0]
+	else
+	{
+		int buffer_delay_length = 0, initial_display_delay_present;
+		if (f(b, 1)) // timing_info_present_flag
+		{
+			skip(b, 32 + 32); // num_units_in_display_tick, time_scale
+			s->equal_picture_interval = f(b, 1);
+			if (s->equal_picture_interval)
+				uvlc(b); // num_ticks_per_picture_minus_1
+			s->decoder_model_info_present = f(b, 1);
+			if (s->decoder_model_info_present)
+			{
+				buffer_delay_length = f(b, 5) + 1;
+				skip(b, 32); // num_units_in_decoding_tick
+				s->buffer_removal_time_length = f(b, 5) + 1;
+				s->frame_presentation_time_length = f(b, 5) + 1;
+			}
+		}
+		initial_display_delay_present = f(b, 1);
+		s->op_cnt = f(b, 5) + 1;
+		for (int i=0; i<s->op_cnt; i++)
+		{
+			s->op_idc[i] = f(b, 12);
+			if (f(b, 5) > 7) // seq_level_idx
+				skip(b, 1); // seq_tier
+			s->decoder_model_present[i] = s->decoder_model_info_present ? f(b, 1) : 0;
+			if (s->decoder_model_present[i])
+				skip(b, 2 * buffer_delay_length + 1); // decoder/encoder_buffer_delay, low_delay_mode_flag
+			if (initial_display_delay_present && f(b, 1))
+				skip(b, 4); // initial_display_delay_minus_1
+		}
+	}
+	s->frame_width_bits = f(b, 4) + 1;
+	s->frame_height_bits = f(b, 4) + 1;
+	s->max_frame_width = f(b, s->frame_width_bits) + 1;
+	s->max_frame_height = f(b, s->frame_height_bits) + 1;
+	s->frame_id_numbers_present = s->reduced_still_picture_header ? 0 : f(b, 1);
+	if (s->frame_id_numbers_present)
+	{
+		s->delta_frame_id_length = f(b, 4) + 2;
+		s->id_len = f(b, 3) + 1 + s->delta_frame_id_length;
+	}
+	s->use_128x128_superblock = f(b, 1);
+	skip(b, 2); // enable_filter_intra, enable_intra_edge_filter
+	s->enable_warped_motion = 0;
+	s->enable_order_hint = 0;
+	s->enable_ref_frame_mvs = 0;
+	s->seq_force_screen_content_tools = 2; // SELECT_SCREEN_CONTENT_TOOLS
+	s->seq_force_integer_mv = 2;           // SELECT_INTEGER_MV
+	s->order_hint_bits = 0;
+	if (!s->reduced_still_picture_header)
+	{
+		skip(b, 2); // enable_interintra_compound, enable_masked_compound
+		s->enable_warped_motion = f(b, 1);
+		skip(b, 1); // enable_dual_filter
+		s->enable_order_hint = f(b, 1);
+		if (s->enable_order_hint)
+		{
+			skip(b, 1); // enable_jnt_comp
+			s->enable_ref_frame_mvs = f(b, 1);
+		}
+		if (!f(b, 1)) // seq_choose_screen_content_tools
+			s->seq_force_screen_content_tools = f(b, 1);
+		if (s->seq_force_screen_content_tools > 0)
+		{
+			if (!f(b, 1)) // seq_choose_integer_mv
+				s->seq_force_integer_mv = f(b, 1);
+		}
+		if (s->enable_order_hint)
+			s->order_hint_bits = f(b, 3) + 1;
+	}
+	s->enable_superres = f(b, 1);
+	s->enable_cdef = f(b, 1);
+	s->enable_restoration = f(b, 1);
+	color_config(s, b, seq_profile);
+	s->film_grain_params_present = f(b, 1);
+	s->seen = 1;
+	CHECK(!overrun(b), "truncated sequence header");
+
+	return 0;
+}
+
+// Frame size state of the frame being parsed
+typedef struct frame_size_s {
+	int upscaled_width, frame_width, frame_height, render_width, render_height;
+	int mi_cols, mi_rows;
+} frame_size;
+
+static void superres_params(const av1* s, bits* b, frame_size* fs)
+{
+	int denom = 8;
+
+	if (s->enable_superres && f(b, 1)) // use_superres
+		denom = f(b, 3) + 9;
+	fs->upscaled_width = fs->frame_width;
+	fs->frame_width = (fs->upscaled_width * 8 + denom / 2) / denom;
+	fs->mi_cols = 2 * ((fs->frame_width + 7) >> 3);
+	fs->mi_rows = 2 * ((fs->frame_height + 7) >> 3);
+}
+
+static void frame_size_render_size(const av1* s, bits* b, frame_size* fs, int frame_size_override_flag)
+{
+	if (frame_size_override_flag)
+	{
+		fs->frame_width = f(b, s->frame_width_bits) + 1;
+		fs->frame_height = f(b, s->frame_height_bits) + 1;
+	}
+	else
+	{
+		fs->frame_width = s->max_frame_width;
+		fs->frame_height = s->max_frame_height;
+	}
+	superres_params(s, b, fs);
+	if (f(b, 1)) // render_and_frame_size_different
+	{
+		fs->render_width = f(b, 16) + 1;
+		fs->render_height = f(b, 16) + 1;
+	}
+	else
+	{
+		fs->render_width = fs->upscaled_width;
+		fs->render_height = fs->frame_height;
+	}
+}
+
+// Reference frames from last / golden ones (7.8)
+static void set_frame_refs(const av1* s, int order_hint, int last_frame_idx, int gold_frame_idx, int ref_frame_idx[REFS_PER_FRAME])
+{
+	static const int ref_frame_list[REFS_PER_FRAME-2] = { 1, 2, 4, 5, 6 }; // LAST2, LAST3, BWDREF, ALTREF2, ALTREF (minus LAST)
+	int used[NUM_REF_FRAMES] = {0};
+	int hints[NUM_REF_FRAMES];
+	int cur = 1 << (s->order_hint_bits - 1);
+	int ref, hint = 0;
+
+	for (int i=0; i<REFS_PER_FRAME; i++)
+		ref_frame_idx[i] = -1;
+	ref_frame_idx[0] = last_frame_idx;
+	ref_frame_idx[3] = gold_frame_idx;
+	used[last_frame_idx] = used[gold_frame_idx] = 1;
+	for (int i=0; i<NUM_REF_FRAMES; i++)
+		hints[i] = cur + get_relative_dist(s, s->ref[i].order_hint, order_hint);
+
+	// ALTREF: latest backward; BWDREF, ALTREF2: earliest backward
+	for (int k=0; k<3; k++)
+	{
+		ref = -1;
+		for (int i=0; i<NUM_REF_FRAMES; i++)
+			if (!used[i] && hints[i] >= cur && (ref < 0 || (k ? hints[i] < hint : hints[i] >= hint)))
+			{
+				ref = i;
+				hint = hints[i];
+			}
+		if (ref >= 0)
+		{
+			ref_frame_idx[k ? k+3 : 6] = ref;
+			used[ref] = 1;
+		}
+	}
+	// Remaining ones: latest forward
+	for (int k=0; k<REFS_PER_FRAME-2; k++)
+		if (ref_frame_idx[ref_frame_list[k]] < 0)
+		{
+			ref = -1;
+			for (int i=0; i<NUM_REF_FRAMES; i++)
+				if (!used[i] && hints[i] < cur && (ref < 0 || hints[i] >= hint))
+				{
+					ref = i;
+					hint = hints[i];
+				}
+			if (ref >= 0)
+			{
+				ref_frame_idx[ref_frame_list[k]] = ref;
+				used[ref] = 1;
+			}
+		}
+	// Others: earliest
+	ref = -1;
+	for (int i=0; i<NUM_REF_FRAMES; i++)
+		if (ref < 0 || hints[i] < hint)
+		{
+			ref = i;
+			hint = hints[i];
+		}
+	for (int i=0; i<REFS_PER_FRAME; i++)
+		if (ref_frame_idx[i] < 0)
+			ref_frame_idx[i] = ref;
+}
+
+static void tile_info(const av1* s, bits* b, const frame_size* fs)
+{
+	int sb_cols = s->use_128x128_superblock ? (fs->mi_cols + 31) >> 5 : (fs->mi_cols + 15) >> 4;
+	int sb_rows = s->use_128x128_superblock ? (fs->mi_rows + 31) >> 5 : (fs->mi_rows + 15) >> 4;
+	int sb_size = s->use_128x128_superblock ? 7 : 6;
+	int max_tile_width_sb = 4096 >> sb_size;
+	int max_tile_area_sb = (4096 * 2304) >> (2 * sb_size);
+	int min_log2_tile_cols = tile_log2(max_tile_width_sb, sb_cols);
+	int max_log2_tile_cols = tile_log2(1, min(sb_cols, 64));
+	int max_log2_tile_rows = tile_log2(1, min(sb_rows, 64));
+	int min_log2_tiles = max(min_log2_tile_cols, tile_log2(max_tile_area_sb, sb_rows * sb_cols));
+	int cols_log2, rows_log2, start, size, i;
+
+	if (f(b, 1)) // uniform_tile_spacing_flag
+	{
+		for (cols_log2 = min_log2_tile_cols; cols_log2 < max_log2_tile_cols && f(b, 1); cols_log2++) // increment_tile_cols_log2
+			;
+		for (rows_log2 = max(min_log2_tiles - cols_log2, 0); rows_log2 < max_log2_tile_rows && f(b, 1); rows_log2++) // increment_tile_rows_log2
+			;
+	}
+	else
+	{
+		int widest = 0;
+		for (i = 0, start = 0; start < sb_cols; i++)
+		{
+			size = ns(b, min(sb_cols - start, max_tile_width_sb)) + 1; // width_in_sbs_minus_1
+			widest = max(widest, size);
+			start += size;
+		}
+		cols_log2 = tile_log2(1, i);
+		max_tile_area_sb = min_log2_tiles > 0 ? (sb_rows * sb_cols) >> (min_log2_tiles + 1) : sb_rows * sb_cols;
+		for (i = 0, start = 0; start < sb_rows; i++)
+			start += ns(b, min(sb_rows - start, max(max_tile_area_sb / widest, 1))) + 1; // height_in_sbs_minus_1
+		rows_log2 = tile_log2(1, i);
+	}
+	if (cols_log2 > 0 || rows_log2 > 0)
+		skip(b, rows_log2 + cols_log2 + 2); // context_update_tile_id, tile_size_bytes_minus_1
+}
+
+static int read_delta_q(bits* b)
+{
+	return f(b, 1) ? su(b, 7) : 0;
+}
+
+// Decode subexponential code (only bits matter here, not the value)
+static void decode_subexp(bits* b, int num_syms)
+{
+	int i = 0, mk = 0, k = 3;
+
+	for (;;)
+	{
+		int b2 = i ? k + i - 1 : k;
+		int a = 1 << b2;
+		if (num_syms <= mk + 3 * a)
+		{
+			ns(b, num_syms - mk);
+			return;
+		}
+		if (!f(b, 1)) // subexp_more_bits
+		{
+			skip(b, b2);
+			return;
+		}
+		i ++;
+		mk += a;
+	}
+}
+
+static void global_motion_params(bits* b, int allow_high_precision_mv)
+{
+	for (int ref=1; ref<=7; ref++)
+	{
+		int type = IDENTITY;
+		if (f(b, 1)) // is_global
+			type = f(b, 1) ? ROTZOOM : f(b, 1) ? TRANSLATION : AFFINE;
+		for (int idx = type >= ROTZOOM ? (type == AFFINE ? 6 : 4) : (type == TRANSLATION ? 2 : 0); idx > 0; idx--)
+		{
+			int abs_bits = 12; // GM_ABS_ALPHA_BITS
+			if (idx <= 2) // translation parameters
+				abs_bits = type == TRANSLATION ? 9 - !allow_high_precision_mv : 12;
+			decode_subexp(b, 2 * (1 << abs_bits) + 1);
+		}
+	}
+}
+
+// film_grain_params(), in AFGS1 form
+static int film_grain_params(av1* s, bits* b, int frame_type, ref_frame* cur)
+{
+	fgs_afgs1* g = &cur->grain;
+	int npos;
+
+	memset(g, 0, sizeof(*g));
+	cur->apply_grain = f(b, 1);
+	if (!cur->apply_grain)
+		return 0;
+	g->grain_seed = f(b, 16);
+	if (frame_type == INTER_FRAME && !f(b, 1)) // update_grain
+	{
+		const ref_frame* r = &s->ref[f(b, 3)]; // film_grain_params_ref_idx
+		uint16 grain_seed = g->grain_seed;
+		memcpy(g, &r->grain, sizeof(*g));
+		g->grain_seed = grain_seed;
+		cur->apply_grain = r->apply_grain;
+		return 0;
+	}
+	g->num_y_points = f(b, 4);
+	CHECK(g->num_y_points <= 14, "num_y_points higher than 14");
+	for (int i=0; i<g->num_y_points; i++)
+	{
+		g->point_y_values[i] = f(b, 8);
+		g->point_y_scaling[i] = f(b, 8);
+	}
+	g->chroma_scaling_from_luma = s->mono_chrome ? 0 : f(b, 1);
+	if (!s->mono_chrome && !g->chroma_scaling_from_luma && !(s->subsampling_x && s->subsampling_y && !g->num_y_points))
+	{
+		g->num_cb_points = f(b, 4);
+		CHECK(g->num_cb_points <= 10, "num_cb_points higher than 10");
+		for (int i=0; i<g->num_cb_points; i++)
+		{
+			g->point_cb_values[i] = f(b, 8);
+			g->point_cb_scaling[i] = f(b, 8);
+		}
+		g->num_cr_points = f(b, 4);
+		CHECK(g->num_cr_points <= 10, "num_cr_points higher than 10");
+		for (int i=0; i<g->num_cr_points; i++)
+		{
+			g->point_cr_values[i] = f(b, 8);
+			g->point_cr_scaling[i] = f(b, 8);
+		}
+	}
+	g->grain_scaling = f(b, 2) + 8;
+	g->ar_coeff_lag = f(b, 2);
+	npos = 2 * g->ar_coeff_lag * (g->ar_coeff_lag + 1);
+	if (g->num_y_points)
+		for (int i=0; i<npos; i++)
+			g->ar_coeffs_y[i] = (int)f(b, 8) - 128;
+	npos += g->num_y_points ? 1 : 0; // luma injection coefficient
+	if (g->chroma_scaling_from_luma || g->num_cb_points)
+		for (int i=0; i<npos; i++)
+			g->ar_coeffs_cb[i] = (int)f(b, 8) - 128;
+	if (g->chroma_scaling_from_luma || g->num_cr_points)
+		for (int i=0; i<npos; i++)
+			g->ar_coeffs_cr[i] = (int)f(b, 8) - 128;
+	g->ar_coeff_shift = f(b, 2) + 6;
+	g->grain_scale_shift = f(b, 2);
+	if (g->num_cb_points)
+	{
+		g->cb_mult = f(b, 8);
+		g->cb_luma_mult = f(b, 8);
+		g->cb_offset = f(b, 9);
+	}
+	if (g->num_cr_points)
+	{
+		g->cr_mult = f(b, 8);
+		g->cr_luma_mult = f(b, 8);
+		g->cr_offset = f(b, 9);
+	}
+	g->overlap_flag = f(b, 1);
+	g->clip_to_restricted_range = f(b, 1);
+
+	return 0;
+}
+
+// Record shown frame as a grain table entry (frames without grain are left out)
+static int push_frame(fgs_params* par, int frame, const ref_frame* r)
+{
+	fgs_tbl_entry* e = par->ntbl ? &par->tbl[par->ntbl-1] : NULL;
+	fgs_afgs1 tmp;
+
+	if (!r->apply_grain)
+		return 0;
+	if (e && e->end == frame && !memcmp(&e->afgs1, &r->grain, sizeof(fgs_afgs1)))
+	{
+		e->end ++; // same parameters and seed: extend previous entry
+		return 0;
+	}
+	if ((par->ntbl & (par->ntbl - 1)) == 0) // grow at powers of 2
+	{
+		e = realloc(par->tbl, (par->ntbl ? 2*par->ntbl : 1) * sizeof(fgs_tbl_entry));
+		CHECK(e, "out of memory");
+		par->tbl = e;
+	}
+	e = &par->tbl[par->ntbl++];
+	memset(e, 0, sizeof(*e));
+	e->start = frame;
+	e->end = frame + 1;
+	e->apply = 1;
+	memcpy(&e->afgs1, &r->grain, sizeof(fgs_afgs1));
+	memcpy(&tmp, &r->grain, sizeof(fgs_afgs1));
+	if (par->ntbl > 1)
+		tmp.grain_seed = e[-1].afgs1.grain_seed;
+	e->update = par->ntbl == 1 || memcmp(&tmp, &e[-1].afgs1, sizeof(fgs_afgs1));
+
+	return 0;
+}
+
+static int frame_header(av1* s, bits* b, int temporal_id, int spatial_id, fgs_params* par)
+{
+	int frame_type = KEY_FRAME, show_frame = 1, showable_frame = 0, error_resilient_mode = 1;
+	int frame_is_intra, allow_screen_content_tools, force_integer_mv, frame_size_override_flag;
+	int order_hint, primary_ref_frame, refresh_frame_flags;
+	int allow_intrabc = 0, allow_high_precision_mv = 0, base_q_idx, coded_lossless, num_planes = s->mono_chrome ? 1 : 3;
+	int delta_q[5] = {0}; // Y DC, U DC, U AC, V DC, V AC
+	int ref_frame_idx[REFS_PER_FRAME] = {0};
+	int disable_cdf_update, segmentation_enabled, reference_select;
+	frame_size fs;
+	ref_frame cur;
+
+	CHECK(s->seen, "frame header before sequence header");
+	memset(&cur, 0, sizeof(cur));
+
+	if (!s->reduced_still_picture_header)
+	{
+		if (f(b, 1)) // show_existing_frame
+		{
+			int idx = f(b, 3); // frame_to_show_map_idx
+			if (s->decoder_model_info_present && !s->equal_picture_interval)
+				skip(b, s->frame_presentation_time_length); // frame_presentation_time
+			if (s->frame_id_numbers_present)
+				skip(b, s->id_len); // display_frame_id
+			CHECK(!overrun(b), "truncated frame header");
+			memcpy(&cur, &s->ref[idx], sizeof(cur));
+			if (cur.frame_type == KEY_FRAME) // refresh all frames
+				for (int i=0; i<NUM_REF_FRAMES; i++)
+					memcpy(&s->ref[i], &cur, sizeof(cur));
+			if (!s->film_grain_params_present)
+				cur.apply_grain = 0;
+			return push_frame(par, s->frames++, &cur);
+		}
+		frame_type = f(b, 2);
+		show_frame = f(b, 1);
+		if (show_frame && s->decoder_model_info_present && !s->equal_picture_interval)
+			skip(b, s->frame_presentation_time_length); // frame_presentation_time
+		showable_frame = show_frame ? frame_type != KEY_FRAME : f(b, 1);
+		error_resilient_mode = (frame_type == SWITCH_FRAME || (frame_type == KEY_FRAME && show_frame)) ? 1 : f(b, 1);
+	}
+	frame_is_intra = frame_type == INTRA_ONLY_FRAME || frame_type == KEY_FRAME;
+	if (frame_type == KEY_FRAME && show_frame)
+		for (int i=0; i<NUM_REF_FRAMES; i++)
+		{
+			s->ref[i].valid = 0;
+			s->ref[i].order_hint = 0;
+		}
+
+	disable_cdf_update = f(b, 1);
+	allow_screen_content_tools = s->seq_force_screen_content_tools == 2 ? (int)f(b, 1) : s->seq_force_screen_content_tools;
+	force_integer_mv = 0;
+	if (allow_screen_content_tools)
+		force_integer_mv = s->seq_force_integer_mv == 2 ? (int)f(b, 1) : s->seq_force_integer_mv;
+	if (frame_is_intra)
+		force_integer_mv = 1;
+	if (s->frame_id_numbers_present)
+		skip(b, s->id_len); // current_frame_id
+	if (frame_type == SWITCH_FRAME)
+		frame_size_override_flag = 1;
+	else
+		frame_size_override_flag = s->reduced_still_picture_header ? 0 : f(b, 1);
+	order_hint = f(b, s->order_hint_bits);
+	primary_ref_frame = (frame_is_intra || error_resilient_mode) ? PRIMARY_REF_NONE : (int)f(b, 3);
+	if (s->decoder_model_info_present && f(b, 1)) // buffer_removal_time_present_flag
+		for (int op=0; op<s->op_cnt; op++)
+			if (s->decoder_model_present[op])
+			{
+				int idc = s->op_idc[op];
+				if (!idc || (((idc >> temporal_id) & 1) && ((idc >> (spatial_id + 8)) & 1)))
+					skip(b, s->buffer_removal_time_length); // buffer_removal_time
+			}
+	refresh_frame_flags = (frame_type == SWITCH_FRAME || (frame_type == KEY_FRAME && show_frame)) ? ALL_FRAMES : (int)f(b, 8);
+	if ((!frame_is_intra || refresh_frame_flags != ALL_FRAMES) && error_resilient_mode && s->enable_order_hint)
+		for (int i=0; i<NUM_REF_FRAMES; i++)
+		{
+			int hint = f(b, s->order_hint_bits); // ref_order_hint
+			if (hint != s->ref[i].order_hint)
+			{
+				s->ref[i].valid = 0;
+				s->ref[i].order_hint = hint;
+			}
+		}
+
+	if (frame_is_intra)
+	{
+		frame_size_render_size(s, b, &fs, frame_size_override_flag);
+		if (allow_screen_content_tools && fs.upscaled_width == fs.frame_width)
+			allow_intrabc = f(b, 1);
+	}
+	else
+	{
+		int found_ref = 0;
+		if (s->enable_order_hint && f(b, 1)) // frame_refs_short_signaling
+		{
+			int last_frame_idx = f(b, 3);
+			int gold_frame_idx = f(b, 3);
+			set_frame_refs(s, order_hint, last_frame_idx, gold_frame_idx, ref_frame_idx);
+			if (s->frame_id_numbers_present)
+				skip(b, REFS_PER_FRAME * s->delta_frame_id_length); // delta_frame_id_minus_1
+		}
+		else
+			for (int i=0; i<REFS_PER_FRAME; i++)
+			{
+				ref_frame_idx[i] = f(b, 3);
+				if (s->frame_id_numbers_present)
+					skip(b, s->delta_frame_id_length); // delta_frame_id_minus_1
+			}
+		if (frame_size_override_flag && !error_resilient_mode)
+			for (int i=0; i<REFS_PER_FRAME && !found_ref; i++)
+				if ((found_ref = f(b, 1)))
+				{
+					const ref_frame* r = &s->ref[ref_frame_idx[i]];
+					fs.frame_width = r->upscaled_width;
+					fs.frame_height = r->frame_height;
+					fs.render_width = r->render_width;
+					fs.render_height = r->render_height;
+					superres_params(s, b, &fs);
+				}
+		if (!found_ref)
+			frame_size_render_size(s, b, &fs, frame_size_override_flag);
+		allow_high_precision_mv = force_integer_mv ? 0 : f(b, 1);
+		if (!f(b, 1)) // is_filter_switchable
+			skip(b, 2); // interpolation_filter
+		skip(b, 1); // is_motion_mode_switchable
+		if (!error_resilient_mode && s->enable_ref_frame_mvs)
+			skip(b, 1); // use_ref_frame_mvs
+	}
+	if (!s->reduced_still_picture_header && !disable_cdf_update)
+		skip(b, 1); // disable_frame_end_update_cdf
+	if (primary_ref_frame != PRIMARY_REF_NONE) // load_previous()
+	{
+		const ref_frame* r = &s->ref[ref_frame_idx[primary_ref_frame]];
+		memcpy(cur.alt_q_enabled, r->alt_q_enabled, sizeof(cur.alt_q_enabled));
+		memcpy(cur.alt_q, r->alt_q, sizeof(cur.alt_q));
+	}
+	tile_info(s, b, &fs);
+
+	// quantization_params()
+	base_q_idx = f(b, 8);
+	delta_q[0] = read_delta_q(b);
+	if (num_planes > 1)
+	{
+		int diff_uv_delta = s->separate_uv_delta_q ? f(b, 1) : 0;
+		delta_q[1] = read_delta_q(b);
+		delta_q[2] = read_delta_q(b);
+		delta_q[3] = diff_uv_delta ? read_delta_q(b) : delta_q[1];
+		delta_q[4] = diff_uv_delta ? read_delta_q(b) : delta_q[2];
+	}
+	if (f(b, 1)) // using_qmatrix
+		skip(b, s->separate_uv_delta_q ? 12 : 8); // qm_y, qm_u, qm_v
+
+	// segmentation_params(): only the quantizer feature is kept
+	segmentation_enabled = f(b, 1);
+	if (segmentation_enabled)
+	{
+		static const int feature_bits[8]   = { 8, 6, 6, 6, 6, 3, 0, 0 };
+		static const int feature_signed[8] = { 1, 1, 1, 1, 1, 0, 0, 0 };
+		int update_data = 1;
+		if (primary_ref_frame != PRIMARY_REF_NONE)
+		{
+			if (f(b, 1)) // segmentation_update_map
+				skip(b, 1); // segmentation_temporal_update
+			update_data = f(b, 1);
+		}
+		if (update_data)
+			for (int i=0; i<8; i++)
+			{
+				int alt_q;
+				cur.alt_q_enabled[i] = f(b, 1);
+				alt_q = cur.alt_q_enabled[i] ? su(b, 1 + 8) : 0;
+				cur.alt_q[i] = max(alt_q, -255);
+				for (int j=1; j<8; j++)
+					if (f(b, 1)) // feature_enabled
+						skip(b, feature_bits[j] + feature_signed[j]);
+			}
+	}
+	else
+	{
+		memset(cur.alt_q_enabled, 0, sizeof(cur.alt_q_enabled));
+		memset(cur.alt_q, 0, sizeof(cur.alt_q));
+	}
+
+	// delta_q_params(), delta_lf_params()
+	if (base_q_idx > 0 && f(b, 1)) // delta_q_present
+	{
+		skip(b, 2); // delta_q_res
+		if (!allow_intrabc && f(b, 1)) // delta_lf_present
+			skip(b, 3); // delta_lf_res, delta_lf_multi
+	}
+
+	coded_lossless = 1;
+	for (int i=0; i<8; i++)
+	{
+		int qindex = cur.alt_q_enabled[i] ? max(0, min(255, base_q_idx + cur.alt_q[i])) : base_q_idx;
+		if (qindex || delta_q[0] || delta_q[1] || delta_q[2] || delta_q[3] || delta_q[4])
+			coded_lossless = 0;
+	}
+
+	// loop_filter_params()
+	if (!coded_lossless && !allow_intrabc)
+	{
+		int l0 = f(b, 6);
+		int l1 = f(b, 6);
+		if (num_planes > 1 && (l0 || l1))
+			skip(b, 12); // loop_filter_level[2..3]
+		skip(b, 3); // loop_filter_sharpness
+		if (f(b, 1) && f(b, 1)) // loop_filter_delta_enabled, loop_filter_delta_update
+			for (int i=0; i<8+2; i++)
+				if (f(b, 1)) // update_ref_delta, update_mode_delta
+					skip(b, 7);
+	}
+
+	// cdef_params()
+	if (!coded_lossless && !allow_intrabc && s->enable_cdef)
+	{
+		skip(b, 2); // cdef_damping_minus_3
+		skip(b, (1 << f(b, 2)) * (num_planes > 1 ? 12 : 6)); // cdef_bits, strengths
+	}
+
+	// lr_params()
+	if (!(coded_lossless && fs.frame_width == fs.upscaled_width) && !allow_intrabc && s->enable_restoration)
+	{
+		int uses_lr = 0, uses_chroma_lr = 0;
+		for (int i=0; i<num_planes; i++)
+			if (f(b, 2)) // lr_type
+			{
+				uses_lr = 1;
+				uses_chroma_lr |= i > 0;
+			}
+		if (uses_lr)
+		{
+			if (s->use_128x128_superblock)
+				skip(b, 1); // lr_unit_shift
+			else if (f(b, 1)) // lr_unit_shift
+				skip(b, 1); // lr_unit_extra_shift
+			if (s->subsampling_x && s->subsampling_y && uses_chroma_lr)
+				skip(b, 1); // lr_uv_shift
+		}
+	}
+
+	if (!coded_lossless)
+		skip(b, 1); // tx_mode_select
+	reference_select = frame_is_intra ? 0 : f(b, 1);
+
+	// skip_mode_params()
+	if (!frame_is_intra && reference_select && s->enable_order_hint)
+	{
+		int fwd = -1, bwd = -1, fwd2 = -1, fwd_hint = 0, bwd_hint = 0, fwd2_hint = 0;
+		for (int i=0; i<REFS_PER_FRAME; i++)
+		{
+			int hint = s->ref[ref_frame_idx[i]].order_hint;
+			if (get_relative_dist(s, hint, order_hint) < 0)
+			{
+				if (fwd < 0 || get_relative_dist(s, hint, fwd_hint) > 0)
+				{
+					fwd = i;
+					fwd_hint = hint;
+				}
+			}
+			else if (get_relative_dist(s, hint, order_hint) > 0)
+			{
+				if (bwd < 0 || get_relative_dist(s, hint, bwd_hint) < 0)
+				{
+					bwd = i;
+					bwd_hint = hint;
+				}
+			}
+		}
+		for (int i=0; fwd >= 0 && bwd < 0 && i<REFS_PER_FRAME; i++)
+		{
+			int hint = s->ref[ref_frame_idx[i]].order_hint;
+			if (get_relative_dist(s, hint, fwd_hint) < 0 && (fwd2 < 0 || get_relative_dist(s, hint, fwd2_hint) > 0))
+			{
+				fwd2 = i;
+				fwd2_hint = hint;
+			}
+		}
+		if (fwd >= 0 && (bwd >= 0 || fwd2 >= 0))
+			skip(b, 1); // skip_mode_present
+	}
+
+	if (!frame_is_intra && !error_resilient_mode && s->enable_warped_motion)
+		skip(b, 1); // allow_warped_motion
+	skip(b, 1); // reduced_tx_set
+	if (!frame_is_intra)
+		global_motion_params(b, allow_high_precision_mv);
+	if (s->film_grain_params_present && (show_frame || showable_frame))
+		if (film_grain_params(s, b, frame_type, &cur))
+			return 1;
+	CHECK(!overrun(b), "truncated frame header");
+
+	// Reference frame update
+	cur.valid = 1;
+	cur.frame_type = frame_type;
+	cur.upscaled_width = fs.upscaled_width;
+	cur.frame_width = fs.frame_width;
+	cur.frame_height = fs.frame_height;
+	cur.render_width = fs.render_width;
+	cur.render_height = fs.render_height;
+	cur.order_hint = order_hint;
+	for (int i=0; i<NUM_REF_FRAMES; i++)
+		if ((refresh_frame_flags >> i) & 1)
+			memcpy(&s->ref[i], &cur, sizeof(cur));
+
+	return show_frame ? push_frame(par, s->frames++, &cur) : 0;
+}
+
+/** Check for an IVF signature at the start of file (file position is kept) */
+int vfgs_is_ivf(FILE* f)
+{
+	char s[4] = {0};
+	long pos = ftell(f);
+	size_t n = fread(s, 1, 4, f);
+
+	fseek(f, pos, SEEK_SET);
+	return n == 4 && !memcmp(s, "DKIF", 4);
+}
+
+static unsigned read_le(const uint8* p, int n)
+{
+	unsigned v = 0;
+	while (n--)
+		v = (v << 8) | p[n];
+	return v;
+}
+
+/** Walk the OBUs of an IVF frame */
+static int read_obus(av1* s, const uint8* p, int size, fgs_params* par)
+{
+	while (size > 0)
+	{
+		int type = (p[0] >> 3) & 15;
+		int ext = (p[0] >> 2) & 1;
+		int has_size = (p[0] >> 1) & 1;
+		int temporal_id = 0, spatial_id = 0, hdr = 1 + ext;
+		unsigned long long len;
+		bits b;
+
+		CHECK(size >= hdr, "truncated OBU header");
+		if (ext)
+		{
+			temporal_id = p[1] >> 5;
+			spatial_id = (p[1] >> 3) & 3;
+		}
+		if (has_size)
+		{
+			int n = leb128(p + hdr, size - hdr, &len);
+			CHECK(n > 0, "truncated OBU size");
+			hdr += n;
+		}
+		else
+			len = size - hdr;
+		CHECK(len <= (unsigned long long)(size - hdr), "truncated OBU");
+
+		b.p = p + hdr;
+		b.size = (int)len;
+		b.pos = 0;
+		if (type == OBU_SEQUENCE_HEADER)
+		{
+			if (sequence_header(s, &b))
+				return 1;
+		}
+		else if ((type == OBU_FRAME_HEADER || type == OBU_FRAME) && s->seen)
+		{
+			int idc = s->op_idc[0]; // operating point 0
+			if (!ext || !idc || (((idc >> temporal_id) & 1) && ((idc >> (spatial_id + 8)) & 1)))
+				if (frame_header(s, &b, temporal_id, spatial_id, par))
+					return 1;
+		}
+		p += hdr + len;
+		size -= hdr + (int)len;
+	}
+	return 0;
+}
+
+/** Read film grain parameters of all shown frames of an AV1 IVF file */
+int vfgs_read_ivf(fgs_params* par, FILE* f, const char* filename)
+{
+	uint8 hdr[32];
+	uint8* buf = NULL;
+	unsigned bufsize = 0;
+	int err = 0;
+	av1* s;
+
+	par->afgs1.num_y_points = 0;
+	par->afgs1.num_cb_points = 0;
+	par->afgs1.num_cr_points = 0;
+	vfgs_free_cfg(par);
+
+	CHECK(fread(hdr, 1, 32, f) == 32, "truncated IVF header in %s", filename);
+	CHECK(!memcmp(hdr + 8, "AV01", 4), "%s is not an AV1 IVF file", filename);
+	CHECK(read_le(hdr + 6, 2) >= 32 && !fseek(f, (long)read_le(hdr + 6, 2), SEEK_SET), "bad IVF header in %s", filename);
+	s = calloc(1, sizeof(av1));
+	CHECK(s, "out of memory");
+
+	while (!err && fread(hdr, 1, 12, f) == 12) // frame size, time stamp
+	{
+		unsigned size = read_le(hdr, 4);
+		if (size > bufsize)
+		{
+			uint8* p = size > (1u << 30) ? NULL : realloc(buf, size);
+			if (!p)
+			{
+				fprintf(stderr, "Error: bad IVF frame size in %s\n", filename);
+				err = 1;
+				break;
+			}
+			buf = p;
+			bufsize = size;
+		}
+		if (fread(buf, 1, size, f) != size)
+		{
+			fprintf(stderr, "Error: truncated IVF frame in %s\n", filename);
+			err = 1;
+		}
+		else
+			err = read_obus(s, buf, (int)size, par);
+	}
+	free(buf);
+	free(s);
+	if (err)
+		return 1;
+
+	CHECK(par->ntbl, "no film grain parameters found in %s", filename);
+	par->tbl_frames = 1;
+	memcpy(&par->afgs1, &par->tbl[0].afgs1, sizeof(fgs_afgs1));
+
+	return 0;
+}
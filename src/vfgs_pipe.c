@@ -0,0 +1,233 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE // pthread_setaffinity_np()
+#include "vfgs_pipe.h"
+#include <stdio.h>
+
+#ifdef VFGS_THREADS
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#define CHECK(cond, ...) { if (!(cond)) { fprintf(stderr, "Error: "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); return 1; } }
+
+#define END (-1) // end of run marker (one per queue at most)
+
+// Single-producer / single-consumer queue of slot indices. It holds at most
+// all slots plus an END marker, so pushing never blocks; the semaphore only
+// puts the consumer to sleep on an empty queue.
+typedef struct queue_s {
+	int* ring;
+	int size;
+	unsigned head;    // consumer side
+	atomic_uint tail; // producer side
+	sem_t items;
+} queue;
+
+typedef struct pipeline_s pipeline;
+
+typedef struct stage_s {
+	vfgs_stage fn;
+	queue* in;
+	queue* out;
+	int first;
+	int cpu; // -1: any
+	pipeline* pipe;
+} stage;
+
+struct pipeline_s {
+	queue* q; // q[i] feeds stage i; q[0] gets slots back from last stage
+	stage* st;
+	atomic_int failed;
+};
+
+static const int* affinity = NULL; // CPUs of stage threads
+static int naffinity = 0;
+
+static int queue_init(queue* q, int size)
+{
+	q->ring = malloc(size * sizeof(int));
+	q->size = size;
+	q->head = 0;
+	atomic_init(&q->tail, 0);
+	return !q->ring || sem_init(&q->items, 0, 0);
+}
+
+static void queue_push(queue* q, int v)
+{
+	unsigned t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	q->ring[t % q->size] = v;
+	atomic_store_explicit(&q->tail, t + 1, memory_order_release);
+	sem_post(&q->items);
+}
+
+static int queue_pop(queue* q)
+{
+	while (sem_wait(&q->items) && errno == EINTR)
+		;
+	(void)atomic_load_explicit(&q->tail, memory_order_acquire); // published before sem_post()
+	return q->ring[q->head++ % q->size];
+}
+
+static void* run_stage(void* arg)
+{
+	stage* s = arg;
+	int k;
+
+	if (s->cpu >= 0 && vfgs_pipe_pin(s->cpu))
+		fprintf(stderr, "Warning: can not run thread on CPU %d\n", s->cpu);
+	while ((k = queue_pop(s->in)) != END && !atomic_load(&s->pipe->failed))
+	{
+		if (s->fn(k))
+		{
+			if (!s->first)
+				atomic_store(&s->pipe->failed, 1);
+			break;
+		}
+		queue_push(s->out, k);
+	}
+	queue_push(s->out, END); // downstream stages finish; last one wakes up first one (on error)
+	return NULL;
+}
+
+int vfgs_pipe_supported(void)
+{
+	return 1;
+}
+
+/** Run calling thread on a CPU only; returns 1 on error (or if not supported) */
+int vfgs_pipe_pin(int cpu)
+{
+#ifdef __linux__
+	cpu_set_t set;
+
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+		return 1;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0;
+#else
+	(void)cpu;
+	return 1;
+#endif
+}
+
+/** Pin stage threads of next runs: stage i to cpus[i % ncpus] (kept by reference) */
+void vfgs_pipe_affinity(const int* cpus, int ncpus)
+{
+	affinity = cpus;
+	naffinity = ncpus;
+}
+
+/** Run stages over a ring of nslots frames, until first stage stops */
+int vfgs_pipe_run(const vfgs_stage* stages, int nstages, int nslots)
+{
+	pthread_t* th;
+	pipeline p;
+	int n = 0, err = 0;
+
+	p.q = calloc(nstages, sizeof(queue));
+	p.st = calloc(nstages, sizeof(stage));
+	th = calloc(nstages, sizeof(pthread_t));
+	atomic_init(&p.failed, 0);
+	CHECK(p.q && p.st && th, "out of memory");
+	for (int i=0; i<nstages; i++)
+	{
+		CHECK(!queue_init(&p.q[i], nslots + 1), "can not create frame queue");
+		p.st[i].fn = stages[i];
+		p.st[i].in = &p.q[i];
+		p.st[i].out = &p.q[(i + 1) % nstages];
+		p.st[i].first = i == 0;
+		p.st[i].cpu = naffinity ? affinity[i % naffinity] : -1;
+		p.st[i].pipe = &p;
+	}
+	for (int k=0; k<nslots; k++)
+		queue_push(&p.q[0], k);
+
+	for (n=0; n<nstages; n++)
+		if (pthread_create(&th[n], NULL, run_stage, &p.st[n]))
+		{
+			fprintf(stderr, "Error: can not create thread\n");
+			atomic_store(&p.failed, 1);
+			err = 1;
+			queue_push(&p.q[0], END); // stop first stage (missing stages never return slots)
+			break;
+		}
+	for (int i=0; i<n; i++)
+		pthread_join(th[i], NULL);
+
+	for (int i=0; i<nstages; i++)
+	{
+		sem_destroy(&p.q[i].items);
+		free(p.q[i].ring);
+	}
+	free(th);
+	free(p.st);
+	free(p.q);
+
+	return err || atomic_load(&p.failed);
+}
+
+#else
+
+int vfgs_pipe_supported(void)
+{
+	return 0;
+}
+
+int vfgs_pipe_run(const vfgs_stage* stages, int nstages, int nslots)
+{
+	(void)stages; (void)nstages; (void)nslots;
+	fprintf(stderr, "Error: pipelined mode is not supported in this build\n");
+	return 1;
+}
+
+int vfgs_pipe_pin(int cpu)
+{
+	(void)cpu;
+	return 1;
+}
+
+void vfgs_pipe_affinity(const int* cpus, int ncpus)
+{
+	(void)cpus; (void)ncpus;
+}
+
+#endif
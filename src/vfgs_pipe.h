@@ -0,0 +1,60 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VFGS_PIPE_H_
+#define _VFGS_PIPE_H_
+
+/** Pipelined frame processing
+ *
+ * Each stage (e.g. read, add grain, write) runs in its own thread, and works
+ * on one slot of a ring of preallocated frames at a time. Slots go through
+ * the stages in order, handed over by single-producer / single-consumer
+ * lock-free queues, then back to the first stage: the ring size bounds the
+ * number of frames in flight.
+ *
+ * A stage returns non-zero to end the run: the first stage at end of input
+ * (frames in flight are completed), any other one on error (frames in
+ * flight are dropped).
+ */
+
+typedef int (*vfgs_stage)(int slot);
+
+int vfgs_pipe_supported(void);
+int vfgs_pipe_run(const vfgs_stage* stages, int nstages, int nslots); // returns 1 on error
+int vfgs_pipe_pin(int cpu); // run calling thread on a CPU only; returns 1 on error
+void vfgs_pipe_affinity(const int* cpus, int ncpus); // stage i threads run on cpus[i % ncpus] (ncpus 0: any)
+
+#endif  // _VFGS_PIPE_H_
@@ -0,0 +1,486 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "vfgs_serve.h"
+
+#ifdef __linux__
+
+#include "vfgs.h"
+#include "vfgs_cfg.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) { if (!(cond)) { fprintf(stderr, "Error: "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); return 1; } }
+
+#define MAX_CLIENTS 64
+#define MAX_REQUEST (1 << 20) // bytes (configuration text included)
+
+typedef struct session_s {
+	int fd;
+	char* in;           // bytes received, not processed yet
+	int len;
+	// Source
+	FILE* src;
+	int width, height, depth, format;
+	long long frame_size; // packed planar frame (bytes)
+	int nframes;
+	uint8** frames;     // resident source frames (NULL: not read yet)
+	int cur;            // selected frame (-1: none)
+	// Grain
+	vfgs_ctx* ctx;
+	fgs_params par;     // configuration, as parsed
+	int sei;            // configuration is an FGC SEI (deltas apply)
+	unsigned seed;
+	// Result
+	char shm_name[64];
+	uint8* out;
+} session;
+
+static session sessions[MAX_CLIENTS];
+static int nsessions = 0;
+static unsigned nresults = 0; // shared-memory objects made so far (names)
+static volatile sig_atomic_t quit = 0;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	quit = 1;
+}
+
+static int reply(session* s, const char* fmt, ...)
+{
+	char buf[256];
+	va_list args;
+	int n;
+
+	va_start(args, fmt);
+	n = vsnprintf(buf, sizeof(buf) - 1, fmt, args);
+	va_end(args);
+	if (n < 0 || n > (int)sizeof(buf) - 2)
+		n = n < 0 ? 0 : (int)sizeof(buf) - 2;
+	buf[n++] = '\n';
+	return send(s->fd, buf, n, MSG_NOSIGNAL) != n;
+}
+
+static void init_params(fgs_params* par)
+{
+	memset(par, 0, sizeof(*par));
+	par->sei.log2_scale_factor = 5; // (no component model: no grain)
+}
+
+/** Release source, context and result of a session */
+static void close_source(session* s)
+{
+	for (int k=0; k<s->nframes && s->frames; k++)
+		free(s->frames[k]);
+	free(s->frames);
+	s->frames = NULL;
+	s->nframes = 0;
+	if (s->src)
+		fclose(s->src);
+	s->src = NULL;
+	vfgs_destroy(s->ctx);
+	s->ctx = NULL;
+	vfgs_free_cfg(&s->par);
+	init_params(&s->par);
+	s->sei = 0;
+	if (s->out)
+	{
+		munmap(s->out, s->frame_size);
+		shm_unlink(s->shm_name);
+	}
+	s->out = NULL;
+}
+
+static void close_session(int k)
+{
+	session* s = &sessions[k];
+
+	close_source(s);
+	close(s->fd);
+	free(s->in);
+	sessions[k] = sessions[--nsessions];
+}
+
+static int cmd_open(session* s, const char* args)
+{
+	int width, height, depth, format, n = 0;
+	int fmt;
+	long long size;
+	int fd;
+
+	if (sscanf(args, "%d %d %d %d %n", &width, &height, &depth, &format, &n) < 4 || !args[n])
+		return reply(s, "error usage: open <width> <height> <depth> <format> <file>");
+	fmt = format == 420 ? VFGS_420 : format == 422 ? VFGS_422 : format == 444 ? VFGS_444 : -1;
+	if (width <= 128 || height <= 0 || (fmt < VFGS_444 && (width & 1)) || (fmt == VFGS_420 && (height & 1)))
+		return reply(s, "error unsupported picture size %dx%d", width, height);
+
+	close_source(s);
+	s->ctx = vfgs_create(depth, fmt, VFGS_PLANAR);
+	if (!s->ctx)
+		return reply(s, "error unsupported bit depth or chroma format");
+	s->width = width;
+	s->height = height;
+	s->depth = depth;
+	s->format = fmt;
+	s->frame_size = (long long)width * height * (fmt == VFGS_420 ? 3 : fmt == VFGS_422 ? 4 : 6) / 2 * (depth > 8 ? 2 : 1);
+	s->seed = 1;
+	s->cur = -1;
+
+	s->src = fopen(args + n, "rb");
+	if (!s->src || fseeko(s->src, 0, SEEK_END) || (size = ftello(s->src)) < s->frame_size)
+	{
+		close_source(s);
+		return reply(s, "error can not read frames from %s", args + n);
+	}
+	s->nframes = (int)(size / s->frame_size);
+	s->frames = calloc(s->nframes, sizeof(uint8*));
+
+	// Result frame
+	snprintf(s->shm_name, sizeof(s->shm_name), "/vfgs-serve-%d-%u", (int)getpid(), nresults++);
+	fd = shm_open(s->shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0)
+	{
+		void* out = ftruncate(fd, s->frame_size) ? MAP_FAILED : mmap(NULL, s->frame_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (out == MAP_FAILED)
+			shm_unlink(s->shm_name);
+		else
+			s->out = out;
+	}
+	if (!s->frames || !s->out)
+	{
+		close_source(s);
+		return reply(s, "error out of memory");
+	}
+	return reply(s, "ok %d %s %lld", s->nframes, s->shm_name, s->frame_size);
+}
+
+static int cmd_frame(session* s, const char* args)
+{
+	int k;
+
+	if (!s->src)
+		return reply(s, "error no source");
+	if (sscanf(args, "%d", &k) != 1 || k < 0 || k >= s->nframes)
+		return reply(s, "error frame index out of 0..%d range", s->nframes - 1);
+	if (!s->frames[k])
+	{
+		// Read once, then kept
+		uint8* buf = malloc(s->frame_size);
+		if (!buf || fseeko(s->src, s->frame_size * k, SEEK_SET) || fread(buf, 1, s->frame_size, s->src) != (size_t)s->frame_size)
+		{
+			free(buf);
+			return reply(s, "error can not read frame %d", k);
+		}
+		s->frames[k] = buf;
+	}
+	s->cur = k;
+	return reply(s, "ok");
+}
+
+// Configure from an FGC SEI, through the library API structure
+static int set_sei(vfgs_ctx* ctx, const fgs_sei* sei)
+{
+	vfgs_sei api;
+
+	vfgs_sei_to_api(&api, sei);
+	return vfgs_ctx_set_sei(ctx, &api);
+}
+
+static int cmd_cfg(session* s, const char* text)
+{
+	fgs_params par;
+	int sei, err;
+
+	if (!s->ctx)
+		return reply(s, "error no source");
+	init_params(&par);
+	if (vfgs_read_cfg_text(&par, text))
+	{
+		vfgs_free_cfg(&par);
+		return reply(s, "error invalid configuration");
+	}
+	// A single FGC SEI is kept as such, for deltas; other ones go as text
+	sei = !(par.afgs1.num_y_points || par.ntbl || par.nsei > 1);
+	err = sei ? set_sei(s->ctx, &par.sei) : vfgs_ctx_read_cfg_text(s->ctx, text);
+	if (err)
+	{
+		vfgs_free_cfg(&par);
+		return reply(s, "error invalid configuration");
+	}
+	vfgs_free_cfg(&s->par);
+	s->par = par;
+	s->sei = sei;
+	return reply(s, "ok");
+}
+
+static int cmd_interval(session* s, const char* args)
+{
+	fgs_sei sei;
+	int c, k, lower, upper, n, nv = 0;
+	int v[SEI_MAX_MODEL_VALUES];
+
+	if (!s->ctx || !s->sei)
+		return reply(s, "error no FGC SEI configuration");
+	if (sscanf(args, "%d %d %d %d %n", &c, &k, &lower, &upper, &n) < 4)
+		return reply(s, "error usage: interval <c> <k> <lower> <upper> <model values...>");
+	for (args += n; nv < SEI_MAX_MODEL_VALUES && sscanf(args, "%d %n", &v[nv], &n) == 1; args += n)
+		nv ++;
+	sei = s->par.sei;
+	if (c < 0 || c > 2 || !sei.comp_model_present_flag[c] || k < 0 || k > sei.num_intensity_intervals[c] || k > 255)
+		return reply(s, "error no interval %d for component %d", k, c);
+	if (nv != sei.num_model_values[c] || lower < 0 || upper > 255)
+		return reply(s, "error expecting bounds in 0..255 and %d model values", sei.num_model_values[c]);
+	sei.intensity_interval_lower_bound[c][k] = (uint8)lower;
+	sei.intensity_interval_upper_bound[c][k] = (uint8)upper;
+	for (int i=0; i<nv; i++)
+		sei.comp_model_value[c][k][i] = (int16)v[i];
+	if (k == sei.num_intensity_intervals[c])
+		sei.num_intensity_intervals[c] ++;
+	if (set_sei(s->ctx, &sei))
+		return reply(s, "error invalid configuration");
+	s->par.sei = sei;
+	return reply(s, "ok");
+}
+
+static int cmd_grain(session* s)
+{
+	int sz = s->depth > 8 ? 2 : 1;
+	int cw = s->format < VFGS_444 ? s->width / 2 : s->width;
+	int ch = s->format < VFGS_422 ? s->height / 2 : s->height;
+	long long ysize = (long long)s->width * s->height * sz;
+	long long csize = (long long)cw * ch * sz;
+	const uint8* f;
+
+	if (!s->ctx || s->cur < 0)
+		return reply(s, "error no source frame");
+	f = s->frames[s->cur];
+	const void* src[3] = { f, f + ysize, f + ysize + csize };
+	void* dst[3] = { s->out, s->out + ysize, s->out + ysize + csize };
+	int stride[3] = { s->width * sz, cw * sz, cw * sz };
+
+	// Same grain as vfgs -r <seed> on that frame
+	vfgs_ctx_set_seed(s->ctx, s->seed);
+	if (vfgs_process_frame_from(s->ctx, dst, stride, src, stride, s->width, s->height))
+		return reply(s, "error can not add grain");
+	return reply(s, "ok");
+}
+
+/** Run one request line (text: configuration bytes following a cfg line) */
+static int request(session* s, char* line, const char* text)
+{
+	char* args = line + strcspn(line, " ");
+	unsigned value;
+
+	if (*args)
+		*args++ = 0;
+	if (!strcmp(line, "open"))
+		return cmd_open(s, args);
+	if (!strcmp(line, "frame"))
+		return cmd_frame(s, args);
+	if (!strcmp(line, "cfg"))
+		return cmd_cfg(s, text);
+	if (!strcmp(line, "interval"))
+		return cmd_interval(s, args);
+	if (!strcmp(line, "gain"))
+	{
+		if (!s->ctx || sscanf(args, "%u", &value) != 1 || vfgs_ctx_set_gain(s->ctx, value))
+			return reply(s, "error can not set gain");
+		return reply(s, "ok");
+	}
+	if (!strcmp(line, "seed"))
+	{
+		if (!s->ctx || sscanf(args, "%u", &value) != 1 || !value)
+			return reply(s, "error can not set seed");
+		s->seed = value;
+		return reply(s, "ok");
+	}
+	if (!strcmp(line, "grain"))
+		return cmd_grain(s);
+	return reply(s, "error unknown request %s", line);
+}
+
+/** Read from client, and run the requests complete so far; returns 1 when
+ * the connection is to be closed */
+static int serve(session* s)
+{
+	int n, len;
+	char* nl;
+
+	if (!s->in && !(s->in = malloc(MAX_REQUEST + 1)))
+		return 1;
+	n = recv(s->fd, s->in + s->len, MAX_REQUEST - s->len, 0);
+	if (n <= 0)
+		return 1;
+	s->len += n;
+
+	while ((nl = memchr(s->in, '\n', s->len)))
+	{
+		char* text = NULL;
+		int err;
+
+		*nl = 0;
+		len = (int)(nl - s->in) + 1;
+		if (len > 1 && nl[-1] == '\r')
+			nl[-1] = 0;
+		if (!strncmp(s->in, "cfg ", 4))
+		{
+			int bytes = atoi(s->in + 4);
+			if (bytes < 0 || len + bytes > MAX_REQUEST)
+				return 1;
+			if (s->len < len + bytes)
+			{
+				*nl = '\n'; // (wait for configuration text)
+				break;
+			}
+			text = malloc(bytes + 1);
+			if (!text)
+				return 1;
+			memcpy(text, s->in + len, bytes);
+			text[bytes] = 0;
+			len += bytes;
+		}
+		err = request(s, s->in, text);
+		free(text);
+		if (err)
+			return 1;
+		memmove(s->in, s->in + len, s->len - len);
+		s->len -= len;
+	}
+	return s->len == MAX_REQUEST; // (line too long)
+}
+
+int vfgs_serve_supported(void)
+{
+	return 1;
+}
+
+/** Serve preview requests on Unix-domain socket path */
+int vfgs_serve(const char* path)
+{
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	CHECK(strlen(path) < sizeof(addr.sun_path), "socket path %s too long", path);
+	strcpy(addr.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	CHECK(fd >= 0, "can not create socket");
+	unlink(path);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, 16))
+	{
+		close(fd);
+		CHECK(0, "can not listen on %s", path);
+	}
+
+	// Stop on SIGINT / SIGTERM (poll interrupted)
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (!quit)
+	{
+		struct pollfd pfd[MAX_CLIENTS + 1];
+
+		pfd[0].fd = fd;
+		pfd[0].events = POLLIN;
+		for (int k=0; k<nsessions; k++)
+		{
+			pfd[k+1].fd = sessions[k].fd;
+			pfd[k+1].events = POLLIN;
+		}
+		if (poll(pfd, nsessions + 1, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		// (backwards: a closed session is replaced by the last one)
+		for (int k=nsessions-1; k>=0; k--)
+			if (pfd[k+1].revents && serve(&sessions[k]))
+				close_session(k);
+		if (pfd[0].revents & POLLIN)
+		{
+			int cfd = accept(fd, NULL, NULL);
+			if (cfd >= 0 && nsessions == MAX_CLIENTS)
+				close(cfd);
+			else if (cfd >= 0)
+			{
+				session* s = &sessions[nsessions++];
+				memset(s, 0, sizeof(*s));
+				s->fd = cfd;
+				s->cur = -1;
+				init_params(&s->par);
+			}
+		}
+	}
+
+	while (nsessions)
+		close_session(nsessions - 1);
+	close(fd);
+	unlink(path);
+	return 0;
+}
+
+#else
+
+int vfgs_serve_supported(void)
+{
+	return 0;
+}
+
+int vfgs_serve(const char* path)
+{
+	(void)path;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,69 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VFGS_SERVE_H_
+#define _VFGS_SERVE_H_
+
+/** Preview server (vfgs --serve <socket>), for interactive grain tuning
+ *
+ * Listens on a Unix-domain stream socket. Each client connection gets its own
+ * session: a grain context (configuration, programmed patterns), the source
+ * frames it asked for (read once, then kept resident), and a POSIX
+ * shared-memory object the grained frame is written to. Requests are text
+ * lines, each answered by a line "ok [...]" or "error <message>":
+ *
+ *   open <width> <height> <depth> <format> <file>
+ *                        source: raw planar YUV file (8-bit, or 10-bit in 16-bit
+ *                        words), format 420, 422 or 444; answers
+ *                        "ok <frames> <shm name> <frame bytes>"
+ *   frame <index>        select source frame
+ *   cfg <bytes>          configuration (file syntax), in the <bytes> that follow
+ *   interval <c> <k> <lower> <upper> <model values...>
+ *                        FGC SEI delta: set intensity interval k of component c
+ *                        (k = number of intervals adds one)
+ *   gain <percent>       grain strength
+ *   seed <value>         random seed (grain restarts from it on each frame) [1]
+ *   grain                add grain to the selected frame, written to the
+ *                        shared-memory object (packed planar, as the source)
+ *
+ * Only grain patterns whose model values change are made again. Sessions are
+ * served in turn by a single thread.
+ */
+
+int vfgs_serve_supported(void);
+int vfgs_serve(const char* path); // runs until SIGINT / SIGTERM
+
+#endif  // _VFGS_SERVE_H_
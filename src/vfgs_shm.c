@@ -0,0 +1,290 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "vfgs_shm.h"
+
+#ifdef __linux__
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAGIC  0x56464753 // "VFGS"
+#define HEADER 4096       // header size (slots are page-aligned)
+
+// Shared header (the object is laid out as the header, then the slots)
+typedef struct header_s {
+	atomic_uint magic; // set once the header is complete
+	int width;
+	int height;
+	int depth;
+	int format;
+	int layout;
+	int nslots;
+	long long slot_size;
+	atomic_ullong count[3]; // slots released by each role so far
+	atomic_uint ended[3];   // role done with the stream
+	atomic_uint seq;        // futex word, bumped on every change
+} header;
+
+struct vfgs_shm_s {
+	header* h;
+	long long size;
+	int role;
+	char* name; // (creator: unlinked at close)
+	yuv geom;
+};
+
+static void shm_wait(header* h, unsigned seq)
+{
+	syscall(SYS_futex, &h->seq, FUTEX_WAIT, seq, NULL, NULL, 0);
+}
+
+static void shm_wake(header* h)
+{
+	atomic_fetch_add(&h->seq, 1);
+	syscall(SYS_futex, &h->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// POSIX shared-memory object names start with a slash
+static char* shm_path(const char* name)
+{
+	char* path = malloc(strlen(name) + 2);
+
+	if (path)
+	{
+		path[0] = '/';
+		strcpy(path + (name[0] != '/'), name);
+	}
+	return path;
+}
+
+static vfgs_shm* shm_map(int fd, long long size, int role)
+{
+	vfgs_shm* shm = calloc(1, sizeof(vfgs_shm));
+	void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	close(fd);
+	if (!shm || base == MAP_FAILED)
+	{
+		if (base != MAP_FAILED)
+			munmap(base, size);
+		free(shm);
+		return NULL;
+	}
+	shm->h = base;
+	shm->size = size;
+	shm->role = role;
+	return shm;
+}
+
+int vfgs_shm_supported(void)
+{
+	return 1;
+}
+
+/** Create ring (replacing any stale one of the same name), as filter */
+vfgs_shm* vfgs_shm_create(const char* name, int nslots, int width, int height, int depth, int format, int layout)
+{
+	yuv geom;
+	long long slot_size = (yuv_geometry(&geom, width, height, depth, format, layout, 1) + HEADER - 1) & ~(long long)(HEADER - 1);
+	long long size = HEADER + slot_size * nslots;
+	char* path = shm_path(name);
+	vfgs_shm* shm;
+	header* h;
+	int fd;
+
+	if (!path)
+		return NULL;
+	shm_unlink(path);
+	fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 || ftruncate(fd, size) || !(shm = shm_map(fd, size, VFGS_SHM_FILTER)))
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+			shm_unlink(path);
+		}
+		free(path);
+		return NULL;
+	}
+	shm->name = path;
+	shm->geom = geom;
+
+	h = shm->h;
+	h->width = width;
+	h->height = height;
+	h->depth = depth;
+	h->format = format;
+	h->layout = layout;
+	h->nslots = nslots;
+	h->slot_size = slot_size;
+	atomic_store(&h->magic, MAGIC);
+	return shm;
+}
+
+/** Attach to ring created by vfgs (waiting up to timeout_ms for it to exist) */
+vfgs_shm* vfgs_shm_attach(const char* name, int role, int timeout_ms, yuv* geom)
+{
+	struct timespec ts = { 0, 10000000 };
+	char* path = shm_path(name);
+	vfgs_shm* shm = NULL;
+	header* h;
+	struct stat st;
+
+	for (int t = 0; path && !shm && t <= timeout_ms; t += 10)
+	{
+		int fd = shm_open(path, O_RDWR, 0);
+		if (fd >= 0 && !fstat(fd, &st) && st.st_size > HEADER)
+			shm = shm_map(fd, st.st_size, role);
+		else if (fd >= 0)
+			close(fd);
+		if (shm && atomic_load(&shm->h->magic) != MAGIC) // not ready yet
+		{
+			munmap(shm->h, shm->size);
+			free(shm);
+			shm = NULL;
+		}
+		if (!shm)
+			nanosleep(&ts, NULL);
+	}
+	free(path);
+	if (!shm)
+		return NULL;
+
+	h = shm->h;
+	yuv_geometry(&shm->geom, h->width, h->height, h->depth, h->format, h->layout, 1);
+	*geom = shm->geom;
+	return shm;
+}
+
+/** Wait for the next slot of the role (filled by the previous role, or
+ * released by the consumer for the producer) */
+int vfgs_shm_acquire(vfgs_shm* shm, yuv* frame)
+{
+	header* h = shm->h;
+	int r = shm->role;
+	unsigned long long n = atomic_load(&h->count[r]);
+
+	for (;;)
+	{
+		unsigned seq = atomic_load(&h->seq);
+		if (r == VFGS_SHM_PRODUCER)
+		{
+			if (atomic_load(&h->ended[VFGS_SHM_FILTER]) || atomic_load(&h->ended[VFGS_SHM_CONSUMER]))
+				return 1; // nobody left to process frames
+			if (n - atomic_load(&h->count[VFGS_SHM_CONSUMER]) < (unsigned)h->nslots)
+				break;
+		}
+		else
+		{
+			int ended = atomic_load(&h->ended[r-1]); // (before count: its last frames are counted then)
+			if (atomic_load(&h->count[r-1]) != n)
+				break;
+			if (ended || (r == VFGS_SHM_FILTER && atomic_load(&h->ended[VFGS_SHM_CONSUMER])))
+				return 1;
+		}
+		shm_wait(h, seq);
+	}
+
+	*frame = shm->geom;
+	yuv_set_base(frame, (unsigned char*)h + HEADER + (n % h->nslots) * h->slot_size, 1);
+	return 0;
+}
+
+void vfgs_shm_release(vfgs_shm* shm)
+{
+	atomic_fetch_add(&shm->h->count[shm->role], 1);
+	shm_wake(shm->h);
+}
+
+void vfgs_shm_close(vfgs_shm* shm)
+{
+	if (!shm)
+		return;
+	atomic_store(&shm->h->ended[shm->role], 1);
+	shm_wake(shm->h);
+	munmap(shm->h, shm->size);
+	if (shm->name)
+		shm_unlink(shm->name);
+	free(shm->name);
+	free(shm);
+}
+
+#else
+
+int vfgs_shm_supported(void)
+{
+	return 0;
+}
+
+vfgs_shm* vfgs_shm_create(const char* name, int nslots, int width, int height, int depth, int format, int layout)
+{
+	(void)name; (void)nslots; (void)width; (void)height; (void)depth; (void)format; (void)layout;
+	return NULL;
+}
+
+vfgs_shm* vfgs_shm_attach(const char* name, int role, int timeout_ms, yuv* geom)
+{
+	(void)name; (void)role; (void)timeout_ms; (void)geom;
+	return NULL;
+}
+
+int vfgs_shm_acquire(vfgs_shm* shm, yuv* frame)
+{
+	(void)shm; (void)frame;
+	return 1;
+}
+
+void vfgs_shm_release(vfgs_shm* shm)
+{
+	(void)shm;
+}
+
+void vfgs_shm_close(vfgs_shm* shm)
+{
+	(void)shm;
+}
+
+#endif
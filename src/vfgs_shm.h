@@ -0,0 +1,65 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VFGS_SHM_H_
+#define _VFGS_SHM_H_
+
+#include "yuv.h"
+
+/** Shared-memory frame ring, for zero-copy transport between processes
+ *
+ * vfgs creates a POSIX shared-memory object holding a ring of frame slots
+ * (padded layout of yuv_alloc(), so that grain is added in place). A
+ * producer (e.g. a decoder) fills slots, vfgs adds grain to them, and a
+ * consumer (e.g. an encoder) reads them out, each in ring order: a slot is
+ * handed on to the next role when released. Waiting processes sleep on a
+ * futex, woken on every release.
+ */
+
+#define VFGS_SHM_PRODUCER 0
+#define VFGS_SHM_FILTER   1 // (creator)
+#define VFGS_SHM_CONSUMER 2
+
+typedef struct vfgs_shm_s vfgs_shm;
+
+int  vfgs_shm_supported(void);
+vfgs_shm* vfgs_shm_create(const char* name, int nslots, int width, int height, int depth, int format, int layout);
+vfgs_shm* vfgs_shm_attach(const char* name, int role, int timeout_ms, yuv* geom); // slot geometry (no buffers)
+int  vfgs_shm_acquire(vfgs_shm* shm, yuv* frame); // next slot for the role; returns 1 at end of stream
+void vfgs_shm_release(vfgs_shm* shm);             // hand it on to the next role
+void vfgs_shm_close(vfgs_shm* shm);               // ends the stream for the role
+
+#endif  // _VFGS_SHM_H_
@@ -0,0 +1,159 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "vfgs_state.h"
+#include "vfgs_fw.h"
+#include "vfgs_hw.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define CHECK(cond, ...) { if (!(cond)) { fprintf(stderr, "Error: "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); return 1; } }
+
+#define STATE_MAGIC   "VFGSBIN"
+#define STATE_VERSION 1
+
+// File header; configuration follows at offset sizeof(state_header), which
+// keeps it cache-line aligned within the mapping
+typedef struct state_header_s {
+	char   magic[8];
+	uint32 version;
+	uint32 cfg_size; // sizeof(vfgs_hw_cfg): catches layout mismatches
+	uint32 prng[2];
+	uint8  reserved[40];
+} state_header;
+
+// Configuration memory of the last loaded file (mapping or buffer)
+static void* state_mem = NULL;
+
+int vfgs_state_save(const char* filename)
+{
+	state_header h;
+	FILE* f;
+	int err;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, STATE_MAGIC, sizeof(STATE_MAGIC));
+	h.version = STATE_VERSION;
+	h.cfg_size = sizeof(vfgs_hw_cfg);
+	vfgs_get_prng(h.prng);
+
+	f = fopen(filename, "wb");
+	CHECK(f, "can not create file %s", filename);
+	err  = fwrite(&h, sizeof(h), 1, f) != 1;
+	err |= fwrite(vfgs_get_cfg(), sizeof(vfgs_hw_cfg), 1, f) != 1;
+	err |= fclose(f) != 0;
+	CHECK(!err, "can not write file %s", filename);
+
+	return 0;
+}
+
+/** Release the configuration memory of the last loaded state file, once the
+ * hardware no longer points at it */
+void vfgs_state_unload(void)
+{
+	if (!state_mem)
+		return;
+#ifdef _MSC_VER
+	_aligned_free(state_mem);
+#else
+	munmap(state_mem, sizeof(state_header) + sizeof(vfgs_hw_cfg));
+#endif
+	state_mem = NULL;
+}
+
+int vfgs_state_load(const char* filename)
+{
+	state_header h;
+	const vfgs_hw_cfg* cfg;
+	FILE* f;
+	int ok;
+
+	f = fopen(filename, "rb");
+	CHECK(f, "can not open file %s", filename);
+	ok = fread(&h, sizeof(h), 1, f) == 1;
+	if (!ok || memcmp(h.magic, STATE_MAGIC, sizeof(STATE_MAGIC)))
+	{
+		fclose(f);
+		CHECK(0, "%s is not a state file", filename);
+	}
+	if (h.version != STATE_VERSION || h.cfg_size != sizeof(vfgs_hw_cfg))
+	{
+		fclose(f);
+		CHECK(0, "%s: unsupported state file version", filename);
+	}
+
+#ifdef _MSC_VER
+	// No mmap: read configuration into memory (kept until unloaded)
+	vfgs_hw_cfg* buf = _aligned_malloc(sizeof(vfgs_hw_cfg), 64);
+	ok = buf && fread(buf, sizeof(vfgs_hw_cfg), 1, f) == 1;
+	fclose(f);
+	if (!ok)
+	{
+		_aligned_free(buf);
+		CHECK(0, "%s: truncated state file", filename);
+	}
+	vfgs_state_unload();
+	state_mem = buf;
+	cfg = buf;
+#else
+	// Map read-only (mapping kept until unloaded); the hardware copies it on first
+	// modification, e.g. a gain change
+	struct stat st;
+	int fd = fileno(f);
+	ok = !fstat(fd, &st) && st.st_size >= (off_t)(sizeof(h) + sizeof(vfgs_hw_cfg));
+	void* map = ok ? mmap(NULL, sizeof(h) + sizeof(vfgs_hw_cfg), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	fclose(f); // mapping stays valid
+	CHECK(ok, "%s: truncated state file", filename);
+	CHECK(map != MAP_FAILED, "can not map file %s", filename);
+	vfgs_state_unload();
+	state_mem = map;
+	cfg = (const vfgs_hw_cfg*)((const uint8*)map + sizeof(h));
+#endif
+
+	vfgs_init_cfg(cfg);
+	vfgs_set_prng(h.prng);
+
+	return 0;
+}
@@ -34,8 +34,11 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE // copy_file_range(), splice()
 #include "yuv.h"
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #ifdef _MSC_VER
@@ -43,46 +46,90 @@
 #define fseeko _fseeki64
 #else
 #include <mm_malloc.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #endif
 
 #define ALIGN_SIZE 16 // width & height padded to that
 #define ALIGN_MEM  64 // start addr + stride should be a multiple of that
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+#define V210_PITCH(w) (((w) + 47) / 48 * 128) // bytes per row (rows are padded to 128 bytes)
 
 #define uint16 unsigned short
 #define uint8  unsigned char
 
-int yuv_alloc(int width, int height, int depth, int format, yuv* frame)
+#define Y4M_LINE 1024 // max Y4M header line length
+
+// Bytes read ahead by yuv_y4m_probe() from a non-seekable input, given back
+// by the next reads
+static struct {
+	int fd;
+	int pos;
+	int n;
+	uint8 buf[16];
+} ahead = { -1, 0, 0, { 0 } };
+
+/** Set plane pointers (padded: buffer layout of yuv_alloc(), else packed as in files) */
+void yuv_set_base(yuv* frame, void* base, int padded)
+{
+	int sz = (frame->depth == 8) ? 1 : 2;
+	int suby = (frame->height == frame->cheight) ? 1 : 2;
+	int height2 = padded ? ALIGN_UP(frame->height, ALIGN_SIZE) : frame->height;
+	int cheight2 = padded ? ALIGN_UP(frame->cheight, ALIGN_SIZE/suby) : frame->cheight;
+
+	frame->Y = base;
+	frame->U = NULL;
+	frame->V = NULL;
+	if (frame->layout != YUV_V210)
+	{
+		frame->U = (uint8*)frame->Y + (long long)frame->stride * height2 * sz;
+		if (frame->layout == YUV_PLANAR)
+			frame->V = (uint8*)frame->U + (long long)frame->cstride * cheight2 * sz;
+		else
+			frame->V = (uint8*)frame->U + sz; // interleaved with Cb
+	}
+}
+
+/** Frame geometry (padded: for processing, else packed as in files); returns buffer size */
+long long yuv_geometry(yuv* frame, int width, int height, int depth, int format, int layout, int padded)
 {
-	int size;
 	int sz = (depth == 8) ? 1 : 2;
-	int height2, cheight2;
 	int subx = (format > YUV_422) ? 1 : 2;
 	int suby = (format > YUV_420) ? 1 : 2;
+	int n = (layout == YUV_SEMI) ? 2 : 1; // chroma samples per position in a row
+	long long height2 = padded ? ALIGN_UP(height, ALIGN_SIZE) : height;
+	long long cheight2 = padded ? ALIGN_UP(height/suby, ALIGN_SIZE/suby) : height/suby;
 
+	assert(layout != YUV_V210 || (depth == 10 && format == YUV_422));
+	memset(frame, 0, sizeof(*frame));
 	frame->depth = depth;
-
+	frame->layout = layout;
 	frame->width = width;
-	frame->stride = (width & (ALIGN_MEM-1)) ? (width + ALIGN_MEM) & ~(ALIGN_MEM-1) : width;
-
 	frame->height = height;
-	height2 = (height & (ALIGN_SIZE-1)) ? (height + ALIGN_SIZE) & ~(ALIGN_SIZE-1) : height;
+	frame->cwidth = width / subx;
+	frame->cheight = height / suby;
 
-	size = frame->stride * height2 * sz;
-
-	width = width / subx;
-	frame->cwidth = width;
-	frame->cstride = (width & (ALIGN_MEM-1)) ? (width + ALIGN_MEM) & ~(ALIGN_MEM-1) : width;
-
-	height = height / suby;
-	frame->cheight = height;
-	cheight2 = (height & (ALIGN_SIZE/suby-1)) ? (height + ALIGN_SIZE/suby) & ~(ALIGN_SIZE/suby-1) : height;
-
-	size += frame->cstride * cheight2 * 2 * sz;
+	if (layout == YUV_V210)
+	{
+		frame->stride = V210_PITCH(width) / 2; // (16-bit units)
+		return frame->stride * height2 * sz;
+	}
+	frame->stride = padded ? ALIGN_UP(width, ALIGN_MEM) : width;
+	frame->cstride = padded ? ALIGN_UP(n * frame->cwidth, ALIGN_MEM) : n * frame->cwidth;
+	return (frame->stride * height2 + frame->cstride * cheight2 * (3 - n)) * sz;
+}
 
-	frame->Y = _mm_malloc(size, ALIGN_MEM*sz);
-	frame->U = (uint8*) frame->Y + frame->stride * height2 * sz;
-	frame->V = (uint8*) frame->U + frame->cstride * cheight2 * sz;
+int yuv_alloc(int width, int height, int depth, int format, int layout, yuv* frame)
+{
+	long long size = yuv_geometry(frame, width, height, depth, format, layout, 1);
+	int sz = (depth == 8) ? 1 : 2;
 
+	yuv_set_base(frame, _mm_malloc(size, ALIGN_MEM*sz), 1);
 	return !frame->Y;
 }
 
@@ -94,15 +141,38 @@ void yuv_free(yuv* frame)
 	frame->V = NULL;
 }
 
-int yuv_skip(yuv* frame, int n, FILE* file)
+/** Plane holding component c: returns its number of rows, of rowbytes bytes
+ * (as in files), pitch bytes apart in memory; 0 when component c is
+ * interleaved with a previous one */
+int yuv_plane(const yuv* frame, int c, unsigned char** buf, int* rowbytes, int* pitch)
 {
-	int size;
 	int sz = (frame->depth == 8) ? 1 : 2;
 
-	size = frame->width * frame->height * sz;
-	size += frame->cwidth * frame->cheight * 2 * sz;
+	*buf = (uint8*)(c == 0 ? frame->Y : c == 1 ? frame->U : frame->V);
+	if (frame->layout == YUV_V210)
+	{
+		*rowbytes = *pitch = frame->stride * sz;
+		return c ? 0 : frame->height;
+	}
+	if (frame->layout == YUV_SEMI && c == 2)
+		return 0;
+	*rowbytes = (c == 0 ? frame->width : frame->layout == YUV_SEMI ? 2 * frame->cwidth : frame->cwidth) * sz;
+	*pitch = (c ? frame->cstride : frame->stride) * sz;
+	return c ? frame->cheight : frame->height;
+}
+
+/** Frame size in file (packed) */
+long long yuv_size(const yuv* frame)
+{
+	long long size = 0;
 
-	return fseeko(file, (long long)size * n, SEEK_CUR);
+	for (int c=0; c<3; c++)
+	{
+		uint8* buf;
+		int rowbytes, pitch;
+		size += (long long)yuv_plane(frame, c, &buf, &rowbytes, &pitch) * rowbytes;
+	}
+	return size;
 }
 
 static void yuv_pad_comp(void* buffer, int width, int height, int stride, int walign, int halign, int depth)
@@ -151,6 +221,7 @@ static void yuv_pad_comp(void* buffer, int width, int height, int stride, int wa
 
 void yuv_pad(yuv* frame)
 {
+	assert(frame->layout == YUV_PLANAR);
 	int subx = (frame->width == frame->cwidth) ? 1 : 2;
 	int suby = (frame->height == frame->cheight) ? 1 : 2;
 
@@ -159,100 +230,814 @@ void yuv_pad(yuv* frame)
 	yuv_pad_comp(frame->V, frame->cwidth, frame->cheight, frame->cstride, ALIGN_SIZE/subx, ALIGN_SIZE/suby, frame->depth);
 }
 
-static int yuv_read_comp(void* buffer, FILE* file, int width, int height, int stride, int depth)
+/** Update 8-bit intensity histograms with n bytes of a row of plane c (see yuv_plane()) */
+void yuv_hist_row(const yuv* frame, int c, const void* row, long long n, unsigned hist[3][256])
 {
-	uint8* buf8 = buffer;
-	int sz = (depth == 8) ? 1 : 2;
-	int nread = 0;
-	int err = 0;
-	int i;
+	const uint8* buf8 = row;
+	const uint16* buf16 = row;
+	unsigned* h0 = hist[c];
+	unsigned* h1 = hist[(frame->layout == YUV_SEMI && c) ? 2 : c]; // odd samples
+	int shift = (frame->layout == YUV_SEMI) ? 8 : frame->depth - 8; // (MSB-aligned)
+	long long k;
 
-	for (i=0; i<height && !err; i++)
+	if (frame->layout == YUV_V210)
 	{
-		nread = (int)fread(buf8, sz, width, file);
-		buf8 += stride*sz;
-		err = (nread != width);
+		// Cb Y Cr Y ... samples, 3 per 32-bit word
+		static const int comp[4] = { 1, 0, 2, 0 };
+		const uint32_t* buf32 = row;
+		long long ns = (n / 4 * 3 < 2LL * frame->width) ? n / 4 * 3 : 2LL * frame->width;
+
+		for (k=0; k<ns; k++)
+			hist[comp[k & 3]][((buf32[k / 3] >> (10 * (k % 3))) & 0x3ff) >> 2] ++;
 	}
+	else if (frame->depth == 8 && h0 == h1)
+		for (k=0; k<n; k++)
+			h0[buf8[k]] ++;
+	else if (frame->depth == 8)
+		for (k=0; k<n; k+=2)
+		{
+			h0[buf8[k]] ++;
+			h1[buf8[k+1]] ++;
+		}
+	else if (h0 == h1)
+		for (k=0; k<n/2; k++)
+			h0[(uint8)(buf16[k] >> shift)] ++;
+	else
+		for (k=0; k<n/2; k+=2)
+		{
+			h0[(uint8)(buf16[k] >> shift)] ++;
+			h1[(uint8)(buf16[k+1] >> shift)] ++;
+		}
+}
 
-	return err;
+/** Make 8-bit intensity histograms of the components of a frame */
+void yuv_hist(const yuv* frame, unsigned hist[3][256])
+{
+	memset(hist, 0, 3*256*sizeof(unsigned));
+	for (int c=0; c<3; c++)
+	{
+		uint8* row;
+		int rowbytes, pitch;
+		int height = yuv_plane(frame, c, &row, &rowbytes, &pitch);
+		for (int i=0; i<height; i++, row += pitch)
+			yuv_hist_row(frame, c, row, rowbytes, hist);
+	}
 }
 
-int yuv_read(yuv* frame, FILE* file)
+/** Unpack row y of a V210 frame to Y, Cb and Cr sample rows (16-bit, padded
+ * by repeating the last sample up to a multiple of 16 luma samples) */
+void yuv_v210_unpack(const yuv* frame, int y, unsigned short* Y, unsigned short* U, unsigned short* V)
 {
-	int err = 0;
-	err |= yuv_read_comp(frame->Y, file, frame->width, frame->height, frame->stride, frame->depth);
-	err |= yuv_read_comp(frame->U, file, frame->cwidth, frame->cheight, frame->cstride, frame->depth);
-	err |= yuv_read_comp(frame->V, file, frame->cwidth, frame->cheight, frame->cstride, frame->depth);
-	return err;
+	const uint32_t* buf32 = (const uint32_t*)((const uint8*)frame->Y + (long long)y * frame->stride * 2);
+	int w = frame->width / 2;
+	int i, k;
+
+	for (i=0, k=0; i<w; i++, k+=4) // samples k..k+3: Cb Y Cr Y
+	{
+		U[i]     = (buf32[(k+0) / 3] >> (10 * ((k+0) % 3))) & 0x3ff;
+		Y[2*i]   = (buf32[(k+1) / 3] >> (10 * ((k+1) % 3))) & 0x3ff;
+		V[i]     = (buf32[(k+2) / 3] >> (10 * ((k+2) % 3))) & 0x3ff;
+		Y[2*i+1] = (buf32[(k+3) / 3] >> (10 * ((k+3) % 3))) & 0x3ff;
+	}
+	for (; i<ALIGN_UP(w, ALIGN_SIZE/2); i++)
+	{
+		U[i] = U[w-1];
+		V[i] = V[w-1];
+		Y[2*i] = Y[2*i+1] = Y[2*w-1];
+	}
 }
 
-static int yuv_write_comp(void* buffer, FILE* file, int width, int height, int stride, int depth)
+/** Pack Y, Cb and Cr sample rows back into row y of a V210 frame */
+void yuv_v210_pack(yuv* frame, int y, const unsigned short* Y, const unsigned short* U, const unsigned short* V)
 {
-	uint8* buf8 = buffer;
-	int sz = (depth == 8) ? 1 : 2;
-	int nwrite = 0;
-	int err = 0;
-	int i;
+	uint32_t* buf32 = (uint32_t*)((uint8*)frame->Y + (long long)y * frame->stride * 2);
+	int w = frame->width / 2;
 
-	for (i=0; i<height && !err; i++)
+#define PUT(k, v) buf32[(k) / 3] = (buf32[(k) / 3] & ~(0x3ffu << (10 * ((k) % 3)))) | ((uint32_t)(v) << (10 * ((k) % 3)))
+	for (int i=0, k=0; i<w; i++, k+=4)
 	{
-		nwrite = (int)fwrite(buf8, sz, width, file);
-		buf8 += stride*sz;
-		err = (nwrite != width);
+		PUT(k+0, U[i]);
+		PUT(k+1, Y[2*i]);
+		PUT(k+2, V[i]);
+		PUT(k+3, Y[2*i+1]);
 	}
+#undef PUT
+}
 
-	return err;
+#ifdef _MSC_VER
+
+static long long yuv_read_bytes(FILE* file, void* buf, long long n)
+{
+	uint8* buf8 = buf;
+	long long k = 0;
+
+	if (ahead.fd == fileno(file))
+		for (; k < n && ahead.pos < ahead.n; k++)
+			buf8[k] = ahead.buf[ahead.pos++];
+	k += fread(buf8 + k, 1, (size_t)(n - k), file);
+	return ferror(file) ? -1 : k;
+}
+
+static int yuv_write_bytes(FILE* file, const void* buf, long long n)
+{
+	return fwrite(buf, 1, (size_t)n, file) != (size_t)n;
+}
+
+static long long yuv_seek(FILE* file, long long offset, int whence)
+{
+	return fseeko(file, offset, whence) ? -1 : _ftelli64(file);
+}
+
+// Note: when hist is not NULL, the 8-bit intensity histograms are updated
+// with each row as it is read (while still in cache)
+static long long yuv_read_frame(yuv* frame, FILE* file, unsigned hist[3][256])
+{
+	long long total = 0;
+
+	for (int c=0; c<3; c++)
+	{
+		uint8* buf8;
+		int rowbytes, pitch;
+		int height = yuv_plane(frame, c, &buf8, &rowbytes, &pitch);
+
+		for (int i=0; i<height; i++, buf8 += pitch)
+		{
+			long long nread = yuv_read_bytes(file, buf8, rowbytes);
+			if (nread < 0)
+				return -1;
+			if (hist)
+				yuv_hist_row(frame, c, buf8, nread, hist);
+			total += nread;
+			if (nread < rowbytes)
+				return total;
+		}
+	}
+	return total;
 }
 
 int yuv_write(yuv* frame, FILE* file)
 {
-	int err = 0;
-	err |= yuv_write_comp(frame->Y, file, frame->width, frame->height, frame->stride, frame->depth);
-	err |= yuv_write_comp(frame->U, file, frame->cwidth, frame->cheight, frame->cstride, frame->depth);
-	err |= yuv_write_comp(frame->V, file, frame->cwidth, frame->cheight, frame->cstride, frame->depth);
-	return err;
+	for (int c=0; c<3; c++)
+	{
+		uint8* buf8;
+		int rowbytes, pitch;
+		int height = yuv_plane(frame, c, &buf8, &rowbytes, &pitch);
+
+		if (pitch == rowbytes) // packed (e.g. mapped input): single write
+		{
+			if (height && fwrite(buf8, rowbytes, height, file) != (size_t)height)
+				return 1;
+			continue;
+		}
+		for (int i=0; i<height; i++, buf8 += pitch)
+			if (fwrite(buf8, 1, rowbytes, file) != (size_t)rowbytes)
+				return 1;
+	}
+	return 0;
 }
 
-void yuv_to_8bit(yuv* dst, const yuv* src)
+// Read / write n rows at offset off of a file; returns 1 on error
+static int yuv_rows_at(FILE* file, uint8* buf8, int n, int rowbytes, int pitch, long long off, int write)
+{
+	if (n && yuv_seek(file, off, SEEK_SET) < 0)
+		return 1;
+	for (int i=0; i<n; i++, buf8 += pitch)
+		if ((write ? fwrite(buf8, 1, rowbytes, file) : fread(buf8, 1, rowbytes, file)) != (size_t)rowbytes)
+			return 1;
+	return 0;
+}
+
+#else
+
+// Vectored I/O on the file descriptor (no stdio buffering): one system call
+// per component, each row being an iovec into the padded frame buffer (rows
+// are gathered in batches when there are more than IOV_MAX)
+#define ROW_BATCH  1024 // rows per system call (<= IOV_MAX)
+#define HIST_BATCH 32   // rows per system call when making histograms (kept in cache)
+
+// Gather rows of plane c from row r (at most max rows); returns the number of rows
+static int yuv_rows(const yuv* frame, int c, int r, struct iovec* iov, int max)
 {
 	uint8* buf8;
-	uint16* buf16;
-	int i, j;
+	int rowbytes, pitch;
+	int height = yuv_plane(frame, c, &buf8, &rowbytes, &pitch);
+	int n;
+
+	for (n=0; n<max && r+n<height; n++)
+	{
+		iov[n].iov_base = buf8 + (size_t)(r+n) * pitch;
+		iov[n].iov_len = rowbytes;
+	}
+	return n;
+}
+
+// Read / write all of iov (retrying on partial transfers), at the current file
+// position or at offset off (>= 0); returns bytes transferred (less at end of
+// file), or -1 on error
+static long long yuv_rw(int fd, struct iovec* iov, int n, int write, long long off)
+{
+	long long total = 0;
+
+	while (n > 0)
+	{
+		ssize_t k;
+		if (off >= 0)
+			k = write ? pwritev(fd, iov, n, off + total) : preadv(fd, iov, n, off + total);
+		else if (!write && fd == ahead.fd && ahead.pos < ahead.n) // bytes read ahead first
+		{
+			k = (size_t)(ahead.n - ahead.pos) < iov->iov_len ? ahead.n - ahead.pos : (ssize_t)iov->iov_len;
+			memcpy(iov->iov_base, ahead.buf + ahead.pos, k);
+			ahead.pos += (int)k;
+		}
+		else
+			k = write ? writev(fd, iov, n) : readv(fd, iov, n);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k < 0)
+			return -1;
+		if (k == 0)
+			break;
+		total += k;
+		for (; n > 0 && (size_t)k >= iov->iov_len; iov++, n--)
+			k -= iov->iov_len;
+		if (n > 0)
+		{
+			iov->iov_base = (uint8*)iov->iov_base + k;
+			iov->iov_len -= k;
+		}
+	}
+	return total;
+}
+
+static long long yuv_read_bytes(FILE* file, void* buf, long long n)
+{
+	struct iovec iov = { buf, (size_t)n };
+	return yuv_rw(fileno(file), &iov, 1, 0, -1);
+}
+
+static int yuv_write_bytes(FILE* file, const void* buf, long long n)
+{
+	struct iovec iov = { (void*)buf, (size_t)n };
+	return yuv_rw(fileno(file), &iov, 1, 1, -1) != n;
+}
+
+// (the file descriptor is used directly: stdio is bypassed, and its own idea
+// of the file position would be stale)
+static long long yuv_seek(FILE* file, long long offset, int whence)
+{
+	return lseek(fileno(file), offset, whence);
+}
+
+static long long yuv_read_frame(yuv* frame, FILE* file, unsigned hist[3][256])
+{
+	struct iovec iov[ROW_BATCH];
+	long long total = 0;
+
+	for (int c=0; c<3; c++)
+	{
+		uint8* buf8;
+		int rowbytes, pitch;
+		int height = yuv_plane(frame, c, &buf8, &rowbytes, &pitch);
+
+		for (int r=0; r<height; )
+		{
+			int n = yuv_rows(frame, c, r, iov, hist ? HIST_BATCH : ROW_BATCH);
+			uint8* row = iov[0].iov_base; // (iov is modified by partial reads)
+			long long len = iov[0].iov_len;
+			long long k = yuv_rw(fileno(file), iov, n, 0, -1);
+
+			if (k < 0)
+				return -1;
+			total += k;
+			for (long long m = k; hist && m > 0; m -= len, row += pitch)
+				yuv_hist_row(frame, c, row, m < len ? m : len, hist);
+			if (k < n * len)
+				return total; // end of file
+			r += n;
+		}
+	}
+	return total;
+}
+
+int yuv_write(yuv* frame, FILE* file)
+{
+	struct iovec iov[ROW_BATCH];
+
+	for (int c=0; c<3; c++)
+	{
+		uint8* buf8;
+		int rowbytes, pitch;
+		int height = yuv_plane(frame, c, &buf8, &rowbytes, &pitch);
+
+		for (int r=0; r<height; )
+		{
+			int n = yuv_rows(frame, c, r, iov, ROW_BATCH);
+			long long size = 0;
+			for (int i=0; i<n; i++)
+				size += iov[i].iov_len;
+			if (yuv_rw(fileno(file), iov, n, 1, -1) != size)
+				return 1;
+			r += n;
+		}
+	}
+	return 0;
+}
+
+// Read / write n rows at offset off of a file (the file position is left
+// unchanged); returns 1 on error
+static int yuv_rows_at(FILE* file, uint8* buf8, int n, int rowbytes, int pitch, long long off, int write)
+{
+	struct iovec iov[ROW_BATCH];
+
+	while (n > 0)
+	{
+		int m = n < ROW_BATCH ? n : ROW_BATCH;
+		for (int i=0; i<m; i++)
+		{
+			iov[i].iov_base = buf8 + (size_t)i * pitch;
+			iov[i].iov_len = rowbytes;
+		}
+		if (yuv_rw(fileno(file), iov, m, write, off) != (long long)m * rowbytes)
+			return 1;
+		buf8 += (size_t)m * pitch;
+		off += (long long)m * rowbytes;
+		n -= m;
+	}
+	return 0;
+}
+
+#endif
+
+/** Read frame; returns bytes read (less than yuv_size() at end of file), or -1 on error */
+long long yuv_read(yuv* frame, FILE* file)
+{
+	return yuv_read_frame(frame, file, NULL);
+}
+
+/** Same, also making 8-bit intensity histograms of the components */
+long long yuv_read_hist(yuv* frame, FILE* file, unsigned hist[3][256])
+{
+	memset(hist, 0, 3*256*sizeof(unsigned));
+	return yuv_read_frame(frame, file, hist);
+}
+
+// Rows [y, y + strip->height) of the frame at offset pos of a file (frame: its
+// geometry), to / from strip, a buffer of the same geometry with fewer rows
+static int yuv_strip_io(yuv* strip, const yuv* frame, int y, FILE* file, long long pos, int write)
+{
+	for (int c=0; c<3; c++)
+	{
+		uint8 *buf8, *base;
+		int rowbytes = 0, pitch = 0, frowbytes, fpitch; // (not set for an interleaved component)
+		int n = yuv_plane(strip, c, &buf8, &rowbytes, &pitch);
+		int height = yuv_plane(frame, c, &base, &frowbytes, &fpitch);
+		int r = (c && frame->cheight < frame->height) ? y/2 : y; // first row in plane
+
+		if (!height) // (interleaved with a previous component)
+			continue;
+		assert(rowbytes == frowbytes && r + n <= height);
+		if (yuv_rows_at(file, buf8, n, rowbytes, pitch, pos + (long long)r * rowbytes, write))
+			return 1;
+		pos += (long long)height * rowbytes;
+	}
+	return 0;
+}
+
+/** Read a horizontal strip of the frame at offset pos of a regular file:
+ * rows [y, y + strip->height) (chroma: the matching rows); returns 1 on error */
+int yuv_read_strip(yuv* strip, const yuv* frame, int y, FILE* file, long long pos)
+{
+	return yuv_strip_io(strip, frame, y, file, pos, 0);
+}
+
+/** Write a strip to its place in the frame at offset pos of a regular file */
+int yuv_write_strip(const yuv* strip, const yuv* frame, int y, FILE* file, long long pos)
+{
+	return yuv_strip_io((yuv*)strip, frame, y, file, pos, 1);
+}
+
+/** Set the number of rows of a strip (at most those it was allocated with) */
+void yuv_strip_rows(yuv* strip, int height)
+{
+	int suby = (strip->height == strip->cheight) ? 1 : 2;
+
+	strip->height = height;
+	strip->cheight = height / suby;
+}
+
+// Move forward n bytes: seek, or read and discard from a pipe
+static int yuv_skip_bytes(FILE* file, long long n)
+{
+	uint8 buf[1 << 14];
+
+	if (n <= 0 || yuv_seek(file, n, SEEK_CUR) >= 0)
+		return 0;
+	while (n > 0)
+	{
+		long long k = yuv_read_bytes(file, buf, n < (long long)sizeof(buf) ? n : (long long)sizeof(buf));
+		if (k <= 0)
+			return 1;
+		n -= k;
+	}
+	return 0;
+}
+
+/** Skip n frames (read and discarded from a pipe) */
+int yuv_skip(yuv* frame, int n, FILE* file)
+{
+	return yuv_skip_bytes(file, yuv_size(frame) * n);
+}
+
+/** Current file position (-1 for a pipe) */
+long long yuv_tell(FILE* file)
+{
+	return yuv_seek(file, 0, SEEK_CUR);
+}
+
+/** Move to file position pos; returns 1 on error */
+int yuv_set_pos(FILE* file, long long pos)
+{
+	return yuv_seek(file, pos, SEEK_SET) < 0;
+}
+
+/** Skip next frame of a regular file, to be copied later with yuv_transfer();
+ * returns its file offset, or -1 (nothing skipped) if it is not complete or
+ * the file can not be seeked */
+long long yuv_pass(const yuv* frame, FILE* file)
+{
+#ifdef _MSC_VER
+	(void)frame; (void)file;
+	return -1;
+#else
+	struct stat st;
+	long long pos = yuv_tell(file);
+
+	if (pos < 0 || fstat(fileno(file), &st) || !S_ISREG(st.st_mode) || pos + yuv_size(frame) > st.st_size)
+		return -1;
+	return yuv_seek(file, pos + yuv_size(frame), SEEK_SET) < 0 ? -1 : pos;
+#endif
+}
+
+/** Copy n bytes from offset pos of src to dst, within the kernel where possible
+ * (copy_file_range(), or splice() to a pipe); returns 1 on error */
+int yuv_transfer(FILE* dst, FILE* src, long long pos, long long n)
+{
+#ifdef _MSC_VER
+	(void)dst; (void)src; (void)pos; (void)n;
+	return 1;
+#else
+	static int mode = 0; // 0: copy_file_range, 1: splice, 2: through user memory
+	uint8 buf[1 << 14];
+	int in = fileno(src), out = fileno(dst);
+	off_t off = pos;
+
+	while (n > 0)
+	{
+		ssize_t k;
+#ifdef __linux__
+		if (mode == 0)
+			k = copy_file_range(in, &off, out, NULL, n, 0);
+		else if (mode == 1)
+			k = splice(in, &off, out, NULL, n, SPLICE_F_MOVE);
+		else
+#endif
+		if ((k = pread(in, buf, n < (long long)sizeof(buf) ? n : (long long)sizeof(buf), off)) > 0)
+		{
+			if (yuv_write_bytes(dst, buf, k))
+				return 1;
+			off += k;
+		}
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k < 0 && mode < 2 && (errno == EINVAL || errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP))
+		{
+			mode ++; // not supported for these files (e.g. splice needs a pipe)
+			continue;
+		}
+		if (k <= 0)
+			return 1;
+		n -= k;
+	}
+	return 0;
+#endif
+}
+
+// Read a header line (up to '\n', not included); returns its length, or -1
+static int yuv_read_line(FILE* file, char* line, int size)
+{
+	int n = 0;
+
+	while (n < size-1 && yuv_read_bytes(file, line + n, 1) == 1)
+		if (line[n++] == '\n')
+		{
+			line[n-1] = 0;
+			return n-1;
+		}
+	return -1;
+}
+
+/** Check whether file starts with a Y4M stream header (input not consumed) */
+int yuv_y4m_probe(FILE* file)
+{
+	char sig[10];
+	long long pos = yuv_tell(file);
+	long long n = yuv_read_bytes(file, sig, sizeof(sig));
+
+	if (pos >= 0)
+		yuv_seek(file, pos, SEEK_SET);
+	else if (n > 0) // pipe: give bytes back
+	{
+		ahead.fd = fileno(file);
+		ahead.pos = 0;
+		ahead.n = (int)n;
+		memcpy(ahead.buf, sig, n);
+	}
+	return n == sizeof(sig) && !memcmp(sig, "YUV4MPEG2 ", sizeof(sig));
+}
+
+/** Read Y4M stream header; returns 1 if invalid or unsupported (only 8 and
+ * 10-bit 4:2:0, 4:2:2 and 4:4:4) */
+int yuv_y4m_read_header(FILE* file, yuv_y4m* hdr)
+{
+	char line[Y4M_LINE];
+	char* tag;
+
+	memset(hdr, 0, sizeof(*hdr));
+	if (yuv_read_line(file, line, sizeof(line)) < 0 || strncmp(line, "YUV4MPEG2 ", 10))
+		return 1;
+	strcpy(hdr->chroma, "420jpeg");
+
+	for (tag = strtok(line + 10, " "); tag; tag = strtok(NULL, " "))
+	{
+		int len = (int)strlen(hdr->tags);
+		switch (tag[0])
+		{
+		case 'W': hdr->width = atoi(tag + 1); break;
+		case 'H': hdr->height = atoi(tag + 1); break;
+		case 'F': if (sscanf(tag + 1, "%d:%d", &hdr->fps_num, &hdr->fps_den) != 2) return 1; break;
+		case 'C': if (strlen(tag + 1) >= sizeof(hdr->chroma)) return 1; strcpy(hdr->chroma, tag + 1); break;
+		case 'X': if (!strncmp(tag, "XYSCSS=", 7)) break; // (chroma format, from C tag)
+		// fall through
+		default:
+			if (len + strlen(tag) + 2 > sizeof(hdr->tags))
+				return 1;
+			sprintf(hdr->tags + len, "%s%s", len ? " " : "", tag);
+		}
+	}
+
+	if      (!strncmp(hdr->chroma, "420", 3)) hdr->format = YUV_420;
+	else if (!strncmp(hdr->chroma, "422", 3)) hdr->format = YUV_422;
+	else if (!strncmp(hdr->chroma, "444", 3)) hdr->format = YUV_444;
+	else
+		return 1;
+	if (!strcmp(hdr->chroma + 3, "p10"))
+		hdr->depth = 10;
+	else if (!hdr->chroma[3] || (hdr->format == YUV_420 && (!strcmp(hdr->chroma + 3, "jpeg") || !strcmp(hdr->chroma + 3, "mpeg2") || !strcmp(hdr->chroma + 3, "paldv"))))
+		hdr->depth = 8;
+	else
+		return 1;
+
+	return hdr->width <= 0 || hdr->height <= 0;
+}
+
+/** Format Y4M stream header line (with final '\n'); returns its length */
+int yuv_y4m_format_header(const yuv_y4m* hdr, char* line, int size)
+{
+	static const char* fmt[3] = { "420", "422", "444" };
+	char chroma[16];
+
+	if (hdr->chroma[0])
+		strcpy(chroma, hdr->chroma);
+	else
+		sprintf(chroma, "%s%s", fmt[hdr->format], hdr->depth > 8 ? "p10" : hdr->format == YUV_420 ? "jpeg" : "");
+
+	return snprintf(line, size, "YUV4MPEG2 W%d H%d F%d:%d C%s%s%s\n", hdr->width, hdr->height,
+	                hdr->fps_num, hdr->fps_den, chroma, hdr->tags[0] ? " " : "", hdr->tags);
+}
+
+int yuv_y4m_write_header(FILE* file, const yuv_y4m* hdr)
+{
+	char line[Y4M_LINE + 64];
+	return yuv_write_bytes(file, line, yuv_y4m_format_header(hdr, line, sizeof(line)));
+}
+
+/** Read Y4M frame header; returns 1, 0 at end of file, or -1 if invalid */
+int yuv_y4m_read_marker(FILE* file)
+{
+	char line[Y4M_LINE];
+	long long n = yuv_read_bytes(file, line, 6);
+
+	if (n == 0)
+		return 0;
+	if (n < 6 || memcmp(line, "FRAME", 5) || (line[5] != '\n' && line[5] != ' '))
+		return -1;
+	if (line[5] == ' ' && yuv_read_line(file, line, sizeof(line)) < 0) // frame parameters (ignored)
+		return -1;
+	return 1;
+}
+
+int yuv_y4m_write_marker(FILE* file)
+{
+	return yuv_write_bytes(file, "FRAME\n", 6);
+}
+
+/** Skip n frames of Y4M stream */
+int yuv_y4m_skip(yuv* frame, int n, FILE* file)
+{
+	for (int i=0; i<n; i++)
+		if (yuv_y4m_read_marker(file) <= 0 || yuv_skip_bytes(file, yuv_size(frame)))
+			return 1;
+	return 0;
+}
+
+/** Seek to Y4M frame header at offset (checked) */
+int yuv_y4m_seek(FILE* file, long long offset)
+{
+	char marker[5];
+
+	if (yuv_seek(file, offset, SEEK_SET) < 0 || yuv_read_bytes(file, marker, 5) != 5 || memcmp(marker, "FRAME", 5))
+		return 1;
+	return yuv_seek(file, offset, SEEK_SET) < 0;
+}
+
+/** Offsets of all frames of Y4M file, from current position (not moved);
+ * returns NULL on error (e.g. not seekable) */
+long long* yuv_y4m_scan(yuv* frame, FILE* file, int* n)
+{
+	long long start = yuv_tell(file);
+	long long* offsets = NULL;
+	int size = 0;
+	int r;
+
+	*n = 0;
+	if (start < 0)
+		return NULL;
+	for (long long pos = start; (r = yuv_y4m_read_marker(file)) > 0; pos = yuv_tell(file))
+	{
+		if (*n == size)
+		{
+			long long* tmp = realloc(offsets, (size = size ? 2*size : 1024) * sizeof(long long));
+			if (!tmp)
+				break;
+			offsets = tmp;
+		}
+		offsets[(*n)++] = pos;
+		if (yuv_seek(file, yuv_size(frame), SEEK_CUR) < 0)
+			break;
+	}
+	if (r || yuv_seek(file, start, SEEK_SET) < 0)
+	{
+		free(offsets);
+		return NULL;
+	}
+	return offsets;
+}
+
+void yuv_to_8bit(yuv* dst, const yuv* src)
+{
+	int shift = (src->layout == YUV_SEMI) ? 6 : 0; // MSB-aligned
 
 	assert(dst->depth == 8 && src->depth == 10);
+	assert(dst->layout == src->layout && src->layout != YUV_V210);
 	assert(dst->width == src->width && dst->height == src->height);
 	assert(dst->cwidth == src->cwidth && dst->cheight == src->cheight);
 
-	buf16 = src->Y;
-	buf8  = dst->Y;
-	for (j=0; j<src->height; j++)
+	for (int c=0; c<3; c++)
 	{
-		for (i=0; i<src->width; i++)
-			buf8[i] = (uint8)((buf16[i] + 2) >> 2);
+		uint8 *s, *d;
+		int srow, spitch, drow, dpitch;
+		int height = yuv_plane(src, c, &s, &srow, &spitch);
 
-		buf16 += src->stride;
-		buf8  += dst->stride;
+		yuv_plane(dst, c, &d, &drow, &dpitch);
+		for (int j=0; j<height; j++, s += spitch, d += dpitch)
+			for (int i=0; i<drow; i++)
+				d[i] = (uint8)(((((const uint16*)s)[i] >> shift) + 2) >> 2);
 	}
+}
 
-	buf16 = src->U;
-	buf8  = dst->U;
-	for (j=0; j<src->cheight; j++)
+void yuv_copy(yuv* dst, const yuv* src)
+{
+	assert(dst->depth == src->depth && dst->layout == src->layout);
+	assert(dst->width == src->width && dst->height == src->height);
+	assert(dst->cwidth == src->cwidth && dst->cheight == src->cheight);
+
+	for (int c=0; c<3; c++)
 	{
-		for (i=0; i<src->cwidth; i++)
-			buf8[i] = (uint8)((buf16[i] + 2) >> 2);
+		uint8 *s, *d;
+		int rowbytes, spitch, dpitch;
+		int height = yuv_plane(src, c, &s, &rowbytes, &spitch);
+
+		yuv_plane(dst, c, &d, &rowbytes, &dpitch);
+		for (int j=0; j<height; j++, s += spitch, d += dpitch)
+			memcpy(d, s, rowbytes);
+	}
+}
+
+#ifndef _MSC_VER
+
+/** Map input file (from its start: frames are read from current file position) */
+int yuv_map_open(yuv_map* map, int width, int height, int depth, int format, int layout, int y4m, FILE* file)
+{
+	struct stat st;
+
+	memset(map, 0, sizeof(*map));
+	yuv_geometry(&map->geom, width, height, depth, format, layout, 0);
+	map->y4m = y4m;
 
-		buf16 += src->cstride;
-		buf8  += dst->cstride;
+	if (fstat(fileno(file), &st) || !S_ISREG(st.st_mode))
+		return 1;
+	map->size = st.st_size;
+	map->pos = yuv_tell(file);
+	if (map->size == 0)
+		return 0;
+
+	map->base = mmap(NULL, map->size, PROT_READ, MAP_SHARED, fileno(file), 0);
+	if (map->base == MAP_FAILED)
+	{
+		map->base = NULL;
+		return 1;
 	}
+	madvise(map->base, map->size, MADV_SEQUENTIAL);
+	return 0;
+}
+
+/** Point frame at next frame of mapped file (returns 1 at end of file, -1 on
+ * invalid Y4M frame header) */
+int yuv_map_read(yuv_map* map, yuv* frame, unsigned hist[3][256])
+{
+	long long fsize = yuv_size(&map->geom);
+	long long page = sysconf(_SC_PAGESIZE);
+	uint8* p;
 
-	buf16 = src->V;
-	buf8  = dst->V;
-	for (j=0; j<src->cheight; j++)
+	if (map->y4m && map->pos >= 0 && map->pos < map->size)
 	{
-		for (i=0; i<src->cwidth; i++)
-			buf8[i] = (uint8)((buf16[i] + 2) >> 2);
+		long long len = (map->size - map->pos < Y4M_LINE) ? map->size - map->pos : Y4M_LINE;
+		uint8* nl = memchr(map->base + map->pos, '\n', len);
+		if (!nl || len < 6 || memcmp(map->base + map->pos, "FRAME", 5))
+			return -1;
+		map->pos = nl + 1 - map->base;
+	}
+	p = map->base + map->pos;
+	if (map->pos < 0 || map->pos + fsize > map->size)
+		return 1;
+	map->pos += fsize;
+	if (map->pos < map->size) // read ahead next frame
+	{
+		long long start = map->pos & ~(page - 1);
+		long long end = (map->pos + fsize < map->size) ? map->pos + fsize : map->size;
+		madvise(map->base + start, end - start, MADV_WILLNEED);
+	}
+
+	*frame = map->geom;
+	yuv_set_base(frame, p, 0);
+	if (hist)
+		yuv_hist(frame, hist);
+	return 0;
+}
 
-		buf16 += src->cstride;
-		buf8  += dst->cstride;
+/** Release pages of frames up to this one (when done with them, in order) */
+void yuv_map_release(yuv_map* map, const yuv* frame)
+{
+	long long page = sysconf(_SC_PAGESIZE);
+	long long end = ((uint8*)frame->Y - map->base + yuv_size(&map->geom)) & ~(page - 1); // next frame may share last page
+
+	if (end > map->released)
+	{
+		madvise(map->base + map->released, end - map->released, MADV_DONTNEED);
+		map->released = end;
 	}
 }
+
+void yuv_map_close(yuv_map* map)
+{
+	if (map->base)
+		munmap(map->base, map->size);
+	map->base = NULL;
+}
+
+#else
+
+int yuv_map_open(yuv_map* map, int width, int height, int depth, int format, int layout, int y4m, FILE* file)
+{
+	(void)width; (void)height; (void)depth; (void)format; (void)layout; (void)y4m; (void)file;
+	memset(map, 0, sizeof(*map));
+	return 1;
+}
+
+int yuv_map_read(yuv_map* map, yuv* frame, unsigned hist[3][256])
+{
+	(void)map; (void)frame; (void)hist;
+	return 1;
+}
+
+void yuv_map_release(yuv_map* map, const yuv* frame)
+{
+	(void)map; (void)frame;
+}
+
+void yuv_map_close(yuv_map* map)
+{
+	(void)map;
+}
+
+#endif
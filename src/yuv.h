@@ -44,26 +44,89 @@
 #define YUV_422 1
 #define YUV_444 2
 
+// Frame layouts
+#define YUV_PLANAR 0 // one plane per component, 16-bit samples LSB-aligned
+#define YUV_SEMI   1 // luma plane + interleaved Cb/Cr plane: NV12 / NV16 / NV24 (8-bit),
+                     // or P010 / P210 / P410 (16-bit samples MSB-aligned)
+#define YUV_V210   2 // 10-bit 4:2:2, Cb Y Cr Y ... samples packed 3 per 32-bit word,
+                     // rows padded to 128 bytes (U and V are NULL)
+
 typedef struct yuv_s {
 	void* Y;
 	void* U;
 	void* V;
 	unsigned short width;
 	unsigned short height;
-	unsigned short stride;
+	unsigned short stride;  // in samples (V210: in 16-bit units)
 	unsigned short cwidth;
 	unsigned short cheight;
-	unsigned short cstride;
+	unsigned short cstride; // in samples (semi-planar: Cb + Cr)
 	unsigned       depth;
+	unsigned char  layout;
 } yuv;
 
-int  yuv_alloc(int width, int height, int depth, int format, yuv* frame);
+/** Memory-mapped input file; frames read from it are read-only views into
+ * the mapping (packed layout) */
+typedef struct yuv_map_s {
+	unsigned char* base;
+	long long size;     // file size
+	long long pos;      // next frame offset
+	long long released; // pages up to there were released
+	int y4m;            // frames preceded by Y4M frame headers
+	yuv geom;           // frame geometry (no buffers)
+} yuv_map;
+
+/** Y4M (YUV4MPEG2) stream header */
+typedef struct yuv_y4m_s {
+	int width;
+	int height;
+	int depth;
+	int format;
+	int fps_num;    // 0 if not given
+	int fps_den;
+	char chroma[16]; // C tag (regenerated from format and depth if empty)
+	char tags[256];  // other tags (interlacing, aspect ratio, extensions), kept as is
+} yuv_y4m;
+
+int  yuv_alloc(int width, int height, int depth, int format, int layout, yuv* frame);
+long long yuv_geometry(yuv* frame, int width, int height, int depth, int format, int layout, int padded);
+void yuv_set_base(yuv* frame, void* base, int padded);
 void yuv_free(yuv* frame);
 void yuv_pad(yuv* frame);
 int  yuv_skip(yuv* frame, int n, FILE* file);
-int  yuv_read(yuv* frame, FILE* file);
+long long yuv_tell(FILE* file);
+int  yuv_set_pos(FILE* file, long long pos);
+long long yuv_pass(const yuv* frame, FILE* file);
+int  yuv_transfer(FILE* dst, FILE* src, long long pos, long long n);
+long long yuv_size(const yuv* frame);
+int  yuv_plane(const yuv* frame, int c, unsigned char** buf, int* rowbytes, int* pitch);
+long long yuv_read(yuv* frame, FILE* file);
+long long yuv_read_hist(yuv* frame, FILE* file, unsigned hist[3][256]);
 int  yuv_write(yuv* frame, FILE* file);
+int  yuv_read_strip(yuv* strip, const yuv* frame, int y, FILE* file, long long pos);
+int  yuv_write_strip(const yuv* strip, const yuv* frame, int y, FILE* file, long long pos);
+void yuv_strip_rows(yuv* strip, int height);
 void yuv_to_8bit(yuv* dst, const yuv* src);
+void yuv_copy(yuv* dst, const yuv* src);
+void yuv_hist_row(const yuv* frame, int c, const void* row, long long n, unsigned hist[3][256]);
+void yuv_hist(const yuv* frame, unsigned hist[3][256]);
+void yuv_v210_unpack(const yuv* frame, int y, unsigned short* Y, unsigned short* U, unsigned short* V);
+void yuv_v210_pack(yuv* frame, int y, const unsigned short* Y, const unsigned short* U, const unsigned short* V);
+
+int  yuv_map_open(yuv_map* map, int width, int height, int depth, int format, int layout, int y4m, FILE* file);
+int  yuv_map_read(yuv_map* map, yuv* frame, unsigned hist[3][256]);
+void yuv_map_release(yuv_map* map, const yuv* frame);
+void yuv_map_close(yuv_map* map);
+
+int  yuv_y4m_probe(FILE* file);
+int  yuv_y4m_read_header(FILE* file, yuv_y4m* hdr);
+int  yuv_y4m_format_header(const yuv_y4m* hdr, char* line, int size);
+int  yuv_y4m_write_header(FILE* file, const yuv_y4m* hdr);
+int  yuv_y4m_read_marker(FILE* file);
+int  yuv_y4m_write_marker(FILE* file);
+int  yuv_y4m_skip(yuv* frame, int n, FILE* file);
+int  yuv_y4m_seek(FILE* file, long long offset);
+long long* yuv_y4m_scan(yuv* frame, FILE* file, int* n);
 
 #endif  // _YUV_H_
 
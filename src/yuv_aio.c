@@ -0,0 +1,545 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE // O_DIRECT, fallocate()
+#include "yuv_aio.h"
+
+#ifdef VFGS_URING
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK (4 << 10)      // direct I/O alignment of file offsets, sizes and buffers
+#define MIN_CHUNK (4 << 20)  // bytes per request: a frame, within these bounds
+#define MAX_CHUNK (1 << 30)
+#define DEPTH 4              // chunks (requests in flight)
+
+typedef struct chunk_s {
+	unsigned char* buf;
+	struct iovec iov;
+	long long off; // file offset
+	int len;       // bytes to transfer
+	int done;      // bytes transferred by previous requests (short transfers)
+	int res;       // bytes transferred by last request, or -errno
+	int busy;      // request in flight
+} chunk;
+
+struct yuv_aio_s {
+	int fd;
+	int fl; // file status flags (at open)
+	int write;
+	int flags;
+	int err;
+
+	// io_uring (ring < 0: synchronous transfers)
+	int ring;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	void* sq_ptr;
+	void* cq_ptr;
+	size_t sq_size, cq_size, sqes_size;
+
+	chunk ch[DEPTH];
+	int chunk;      // chunk size
+	int cur;        // chunk being filled / consumed
+	int pos;        // position within it
+	long long next; // file offset of next chunk request
+	long long size; // file size (at open)
+	long long total; // bytes written
+	int y4m;        // frames preceded by Y4M frame headers
+};
+
+int yuv_aio_supported(void)
+{
+	return 1;
+}
+
+static int ring_setup(yuv_aio* io)
+{
+	struct io_uring_params p;
+	uint8_t* sq;
+	uint8_t* cq;
+
+	memset(&p, 0, sizeof(p));
+	io->ring = (int)syscall(__NR_io_uring_setup, DEPTH, &p);
+	if (io->ring < 0)
+		return 1;
+
+	io->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	io->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		io->sq_size = io->cq_size = (io->sq_size > io->cq_size) ? io->sq_size : io->cq_size;
+	io->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	io->sq_ptr = mmap(NULL, io->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ring, IORING_OFF_SQ_RING);
+	io->cq_ptr = (p.features & IORING_FEAT_SINGLE_MMAP) ? io->sq_ptr :
+	             mmap(NULL, io->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ring, IORING_OFF_CQ_RING);
+	io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ring, IORING_OFF_SQES);
+	if (io->sq_ptr == MAP_FAILED || io->cq_ptr == MAP_FAILED || io->sqes == MAP_FAILED)
+		return 1;
+
+	sq = io->sq_ptr;
+	io->sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+	io->sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+	io->sq_array = (unsigned*)(sq + p.sq_off.array);
+	cq = io->cq_ptr;
+	io->cq_head = (unsigned*)(cq + p.cq_off.head);
+	io->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	io->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+	io->cqes    = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return 0;
+}
+
+static void ring_free(yuv_aio* io)
+{
+	if (io->sqes && io->sqes != MAP_FAILED)
+		munmap(io->sqes, io->sqes_size);
+	if (io->cq_ptr && io->cq_ptr != MAP_FAILED && io->cq_ptr != io->sq_ptr)
+		munmap(io->cq_ptr, io->cq_size);
+	if (io->sq_ptr && io->sq_ptr != MAP_FAILED)
+		munmap(io->sq_ptr, io->sq_size);
+	if (io->ring >= 0)
+		close(io->ring);
+	io->sqes = NULL;
+	io->sq_ptr = io->cq_ptr = NULL;
+	io->ring = -1;
+}
+
+// Synchronous transfer (retrying on partial transfers, stopping at end of file)
+static int sync_rw(yuv_aio* io, chunk* c)
+{
+	unsigned char* buf = c->iov.iov_base;
+	long long off = c->off + c->done;
+	size_t done = 0;
+
+	while (done < c->iov.iov_len)
+	{
+		ssize_t k = io->write ? pwrite(io->fd, buf + done, c->iov.iov_len - done, off + done)
+		                      : pread (io->fd, buf + done, c->iov.iov_len - done, off + done);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k < 0)
+			return -errno;
+		if (k == 0)
+			break;
+		done += k;
+	}
+	return (int)done;
+}
+
+// Request transfer of the rest of chunk c (from byte c->done)
+static void submit_part(yuv_aio* io, chunk* c)
+{
+	long long off = c->off + c->done;
+
+	c->iov.iov_base = c->buf + c->done;
+	c->iov.iov_len = c->len - c->done;
+
+	if (io->ring >= 0)
+	{
+		unsigned tail = *io->sq_tail;
+		unsigned idx = tail & *io->sq_mask;
+		struct io_uring_sqe* sqe = &io->sqes[idx];
+		int n;
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = io->write ? IORING_OP_WRITEV : IORING_OP_READV;
+		sqe->fd = io->fd;
+		sqe->addr = (uintptr_t)&c->iov;
+		sqe->len = 1;
+		sqe->off = off;
+		sqe->user_data = (uintptr_t)c;
+		io->sq_array[idx] = idx;
+		__atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+		do
+			n = (int)syscall(__NR_io_uring_enter, io->ring, 1, 0, 0, NULL, 0);
+		while (n < 0 && errno == EINTR);
+		c->busy = (n == 1);
+		c->res = (n == 1) ? 0 : -EIO;
+	}
+	else
+		c->res = sync_rw(io, c);
+}
+
+// Request transfer of len bytes of chunk c at file offset off
+static void submit_chunk(yuv_aio* io, chunk* c, long long off, int len)
+{
+	c->off = off;
+	c->len = len;
+	c->done = 0;
+	submit_part(io, c);
+}
+
+// Wait for chunk c to be transferred
+static void await_chunk(yuv_aio* io, chunk* c)
+{
+	while (c->busy)
+	{
+		unsigned head = *io->cq_head;
+		unsigned tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+
+		for (; head != tail; head++)
+		{
+			struct io_uring_cqe* cqe = &io->cqes[head & *io->cq_mask];
+			chunk* done = (chunk*)(uintptr_t)cqe->user_data;
+			done->res = cqe->res;
+			done->busy = 0;
+		}
+		__atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+
+		if (c->busy && syscall(__NR_io_uring_enter, io->ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+		{
+			c->res = -errno;
+			c->busy = 0;
+		}
+	}
+}
+
+// Wait for chunk c to be transferred in full, requesting the rest of short
+// transfers (e.g. on network file systems), unless a read reached end of
+// file; returns bytes transferred, or -1 on error
+static int await_full(yuv_aio* io, chunk* c)
+{
+	for (;;)
+	{
+		int n;
+
+		await_chunk(io, c);
+		if (c->res < 0 || (io->write && c->res == 0 && c->done < c->len))
+			return -1;
+		n = c->done + c->res;
+		if (n == c->len || (!io->write && (c->res == 0 || c->off + n >= io->size)))
+			return n;
+		// (direct I/O: from the block the transfer stopped in)
+		c->done = ((io->flags & YUV_AIO_DIRECT) && (n & ~(BLOCK - 1)) > c->done) ? n & ~(BLOCK - 1) : n;
+		submit_part(io, c);
+	}
+}
+
+static int put(yuv_aio* io, const unsigned char* src, long long n);
+
+static yuv_aio* aio_open(FILE* file, int write, long long frame_size)
+{
+	yuv_aio* io;
+	struct stat st;
+
+	fflush(file);
+	if (fstat(fileno(file), &st) || !S_ISREG(st.st_mode))
+		return NULL;
+	io = calloc(1, sizeof(yuv_aio));
+	if (!io)
+		return NULL;
+	io->fd = fileno(file);
+	io->fl = fcntl(io->fd, F_GETFL);
+	io->ring = -1;
+	io->write = write;
+	io->size = st.st_size;
+
+	// A frame per chunk, so that several frames are in flight
+	frame_size = (frame_size + BLOCK - 1) & ~(long long)(BLOCK - 1);
+	io->chunk = frame_size < MIN_CHUNK ? MIN_CHUNK : frame_size > MAX_CHUNK ? MAX_CHUNK : (int)frame_size;
+	for (int i=0; i<DEPTH; i++)
+		if (posix_memalign((void**)&io->ch[i].buf, BLOCK, io->chunk))
+		{
+			yuv_aio_close(io);
+			return NULL;
+		}
+
+	if (io->fl != -1 && !fcntl(io->fd, F_SETFL, io->fl | O_DIRECT))
+		io->flags |= YUV_AIO_DIRECT;
+	if (!ring_setup(io))
+		io->flags |= YUV_AIO_ASYNC;
+	else
+		ring_free(io);
+	return io;
+}
+
+/** Open input stream of frames of frame_size bytes, starting at byte offset
+ * pos; chunks are read ahead */
+yuv_aio* yuv_aio_open_read(FILE* file, long long pos, long long frame_size, int y4m)
+{
+	yuv_aio* io = aio_open(file, 0, frame_size);
+	long long start = pos & ~(long long)(BLOCK - 1);
+
+	if (!io)
+		return NULL;
+	io->y4m = y4m;
+	for (int i=0; i<DEPTH; i++)
+		submit_chunk(io, &io->ch[i], start + (long long)i * io->chunk, io->chunk);
+	io->next = start + (long long)DEPTH * io->chunk;
+	io->pos = (int)(pos - start);
+	return io;
+}
+
+/** Open output stream of frames of frame_size bytes (from start of file,
+ * starting with Y4M stream header if given), preallocating size bytes if
+ * non-zero */
+yuv_aio* yuv_aio_open_write(FILE* file, long long size, long long frame_size, const char* y4m)
+{
+	yuv_aio* io = aio_open(file, 1, frame_size);
+
+	if (io && size > 0)
+		fallocate(io->fd, 0, 0, size); // best effort (extents are allocated upfront)
+	if (io && y4m)
+	{
+		io->y4m = 1;
+		put(io, (const unsigned char*)y4m, strlen(y4m));
+	}
+	return io;
+}
+
+int yuv_aio_flags(const yuv_aio* io)
+{
+	return io->flags;
+}
+
+long long yuv_aio_file_size(const yuv_aio* io)
+{
+	return io->size;
+}
+
+// Copy n bytes from input stream; returns bytes copied (less at end of file), or -1 on error
+static long long get(yuv_aio* io, unsigned char* dst, long long n)
+{
+	long long total = 0;
+
+	while (n > 0)
+	{
+		chunk* c = &io->ch[io->cur];
+		int avail = await_full(io, c);
+		int k;
+
+		if (avail < 0)
+			return -1;
+		if (io->pos >= avail)
+		{
+			if (avail < c->len) // end of file
+				break;
+			submit_chunk(io, c, io->next, io->chunk); // read ahead
+			io->next += io->chunk;
+			io->cur = (io->cur + 1) % DEPTH;
+			io->pos = 0;
+			continue;
+		}
+		k = (avail - io->pos < n) ? avail - io->pos : (int)n;
+		memcpy(dst, c->buf + io->pos, k);
+		io->pos += k;
+		dst += k;
+		n -= k;
+		total += k;
+	}
+	return total;
+}
+
+// Copy n bytes to output stream; full chunks are written behind
+static int put(yuv_aio* io, const unsigned char* src, long long n)
+{
+	while (n > 0)
+	{
+		chunk* c = &io->ch[io->cur];
+		int k;
+
+		if (io->pos == 0 && await_full(io, c) < 0)
+			return 1;
+		k = (io->chunk - io->pos < n) ? io->chunk - io->pos : (int)n;
+		memcpy(c->buf + io->pos, src, k);
+		io->pos += k;
+		io->total += k;
+		src += k;
+		n -= k;
+		if (io->pos == io->chunk)
+		{
+			submit_chunk(io, c, io->next, io->chunk);
+			io->next += io->chunk;
+			io->cur = (io->cur + 1) % DEPTH;
+			io->pos = 0;
+		}
+	}
+	return 0;
+}
+
+/** Read frame; returns bytes read (less than yuv_size() at end of file), or -1 on error */
+long long yuv_aio_read(yuv_aio* io, yuv* frame, unsigned hist[3][256])
+{
+	long long total = 0;
+
+	if (io->y4m) // frame header
+	{
+		unsigned char m[6];
+		long long k = get(io, m, 6);
+
+		if (k == 0)
+			return 0;
+		if (k < 6 || memcmp(m, "FRAME", 5))
+			return -1;
+		for (int i=0; m[5] != '\n'; i++)
+			if (i == 1024 || get(io, m + 5, 1) != 1)
+				return -1;
+	}
+	if (hist)
+		memset(hist, 0, 3*256*sizeof(unsigned));
+	for (int c=0; c<3; c++)
+	{
+		unsigned char* row;
+		int rowbytes, pitch;
+		int height = yuv_plane(frame, c, &row, &rowbytes, &pitch);
+
+		for (int r=0; r<height; r++, row += pitch)
+		{
+			long long k = get(io, row, rowbytes);
+			if (k < 0)
+				return -1;
+			if (hist)
+				yuv_hist_row(frame, c, row, k, hist);
+			total += k;
+			if (k < rowbytes)
+				return total;
+		}
+	}
+	return total;
+}
+
+int yuv_aio_write(yuv_aio* io, const yuv* frame)
+{
+	if (io->y4m && put(io, (const unsigned char*)"FRAME\n", 6))
+		return io->err = 1;
+	for (int c=0; c<3; c++)
+	{
+		unsigned char* row;
+		int rowbytes, pitch;
+		int height = yuv_plane(frame, c, &row, &rowbytes, &pitch);
+
+		for (int r=0; r<height; r++, row += pitch)
+			if (put(io, row, rowbytes))
+				return io->err = 1;
+	}
+	return 0;
+}
+
+/** Close stream: output is flushed (last chunk padded to BLOCK, then file truncated) */
+int yuv_aio_close(yuv_aio* io)
+{
+	int err;
+
+	if (!io)
+		return 0;
+	if (io->write && !io->err && io->pos > 0)
+	{
+		chunk* c = &io->ch[io->cur];
+		int len = (io->pos + BLOCK - 1) & ~(BLOCK - 1);
+		memset(c->buf + io->pos, 0, len - io->pos);
+		submit_chunk(io, c, io->next, len);
+	}
+	for (int i=0; i<DEPTH; i++)
+	{
+		chunk* c = &io->ch[i];
+		await_chunk(io, c);
+		if (io->write && await_full(io, c) < 0)
+			io->err = 1;
+		free(c->buf);
+	}
+	if (io->write && ftruncate(io->fd, io->total))
+		io->err = 1;
+	ring_free(io);
+	if (io->flags & YUV_AIO_DIRECT)
+		fcntl(io->fd, F_SETFL, io->fl);
+	err = io->err;
+	free(io);
+	return err;
+}
+
+#else
+
+int yuv_aio_supported(void)
+{
+	return 0;
+}
+
+yuv_aio* yuv_aio_open_read(FILE* file, long long pos, long long frame_size, int y4m)
+{
+	(void)file; (void)pos; (void)frame_size; (void)y4m;
+	return NULL;
+}
+
+yuv_aio* yuv_aio_open_write(FILE* file, long long size, long long frame_size, const char* y4m)
+{
+	(void)file; (void)size; (void)frame_size; (void)y4m;
+	return NULL;
+}
+
+int yuv_aio_flags(const yuv_aio* io)
+{
+	(void)io;
+	return 0;
+}
+
+long long yuv_aio_file_size(const yuv_aio* io)
+{
+	(void)io;
+	return 0;
+}
+
+long long yuv_aio_read(yuv_aio* io, yuv* frame, unsigned hist[3][256])
+{
+	(void)io; (void)frame; (void)hist;
+	return -1;
+}
+
+int yuv_aio_write(yuv_aio* io, const yuv* frame)
+{
+	(void)io; (void)frame;
+	return 1;
+}
+
+int yuv_aio_close(yuv_aio* io)
+{
+	(void)io;
+	return 0;
+}
+
+#endif
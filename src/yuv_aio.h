@@ -0,0 +1,70 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _YUV_AIO_H_
+#define _YUV_AIO_H_
+
+#include "yuv.h"
+
+/** Asynchronous direct I/O (Linux io_uring, O_DIRECT)
+ *
+ * Frames are streamed through a few block-aligned chunk buffers of about a
+ * frame each (frame_size), with several chunk reads (read-ahead) or writes
+ * (write-behind) in flight, and without going through the page cache. Short
+ * transfers are resumed. Files must be regular files, read
+ * or written sequentially (one stream per thread).
+ *
+ * Where direct I/O is not supported by the file system, the page cache is
+ * used; where io_uring is not available, chunks are transferred
+ * synchronously (see yuv_aio_flags()).
+ */
+
+#define YUV_AIO_DIRECT 1 // page cache bypassed
+#define YUV_AIO_ASYNC  2 // requests queued with io_uring
+
+typedef struct yuv_aio_s yuv_aio;
+
+int  yuv_aio_supported(void);
+yuv_aio* yuv_aio_open_read(FILE* file, long long pos, long long frame_size, int y4m); // frames read from byte offset pos
+yuv_aio* yuv_aio_open_write(FILE* file, long long size, long long frame_size, const char* y4m); // Y4M if stream header given;
+                                                                                                // preallocated if size is known (else 0)
+int  yuv_aio_flags(const yuv_aio* io);
+long long yuv_aio_file_size(const yuv_aio* io);
+long long yuv_aio_read(yuv_aio* io, yuv* frame, unsigned hist[3][256]); // same as yuv_read() / yuv_read_hist()
+int  yuv_aio_write(yuv_aio* io, const yuv* frame);
+int  yuv_aio_close(yuv_aio* io); // returns 1 on (write) error
+
+#endif  // _YUV_AIO_H_
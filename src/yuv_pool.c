@@ -0,0 +1,201 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "yuv_pool.h"
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <unistd.h>
+#elif defined(_MSC_VER)
+#include <malloc.h>
+#else
+#include <mm_malloc.h>
+#endif
+
+#define PAGE      (4 << 10) // frames are page-aligned in the pool
+#define HUGE_PAGE (2 << 20)
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) / (a) * (a))
+
+struct yuv_pool_s {
+	unsigned char* base;
+	long long size;   // mapping size
+	long long stride; // bytes between frames
+	int n;
+	int flags;
+	yuv geom; // frame geometry (no buffers)
+};
+
+#ifdef __linux__
+
+// Map size bytes: huge pages if reserved, else advised to use transparent ones
+static unsigned char* pool_map(long long* size, int* flags)
+{
+	void* p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	if (*size >= HUGE_PAGE)
+	{
+		long long s = ALIGN_UP(*size, HUGE_PAGE);
+		p = mmap(NULL, s, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED)
+		{
+			*size = s;
+			*flags |= YUV_POOL_HUGE;
+			return p;
+		}
+	}
+#endif
+	p = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+#ifdef MADV_HUGEPAGE
+	if (*size >= HUGE_PAGE && !madvise(p, *size, MADV_HUGEPAGE))
+		*flags |= YUV_POOL_HUGE;
+#endif
+	return p;
+}
+
+// Prefer node for pages not faulted in yet
+static int pool_bind(void* p, long long size, int node)
+{
+	unsigned long mask[16] = { 0 };
+	int bits = (int)(sizeof(mask) * 8);
+
+	if (node < 0 || node >= bits)
+		return 1;
+	mask[node / (sizeof(long) * 8)] = 1ul << (node % (sizeof(long) * 8));
+	return syscall(SYS_mbind, p, (unsigned long)size, MPOL_PREFERRED, mask, (unsigned long)bits, 0) != 0;
+}
+
+/** NUMA node of a CPU (-1 if unknown) */
+int yuv_pool_cpu_node(int cpu)
+{
+	char path[64];
+	struct dirent* e;
+	DIR* d;
+	int node = -1;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	d = opendir(path);
+	while (d && (e = readdir(d)) && node < 0)
+		if (sscanf(e->d_name, "node%d", &node) != 1)
+			node = -1;
+	if (d)
+		closedir(d);
+	return node;
+}
+
+static void pool_unmap(yuv_pool* pool)
+{
+	munmap(pool->base, pool->size);
+}
+
+#else
+
+static unsigned char* pool_map(long long* size, int* flags)
+{
+	(void)flags;
+	return _mm_malloc(*size, PAGE);
+}
+
+static int pool_bind(void* p, long long size, int node)
+{
+	(void)p; (void)size; (void)node;
+	return 1;
+}
+
+int yuv_pool_cpu_node(int cpu)
+{
+	(void)cpu;
+	return -1;
+}
+
+static void pool_unmap(yuv_pool* pool)
+{
+	_mm_free(pool->base);
+}
+
+#endif
+
+/** Preallocate n frames (placed on NUMA node, unless -1); returns NULL if out of memory */
+yuv_pool* yuv_pool_create(int n, int width, int height, int depth, int format, int layout, int node)
+{
+	yuv_pool* pool = calloc(1, sizeof(yuv_pool));
+
+	if (!pool)
+		return NULL;
+	pool->n = n;
+	pool->stride = ALIGN_UP(yuv_geometry(&pool->geom, width, height, depth, format, layout, 1), PAGE);
+	pool->size = pool->stride * n;
+	pool->base = pool_map(&pool->size, &pool->flags);
+	if (!pool->base)
+	{
+		free(pool);
+		return NULL;
+	}
+	if (node >= 0 && !pool_bind(pool->base, pool->size, node))
+		pool->flags |= YUV_POOL_NUMA;
+
+	// Prefault (pages are zeroed, then placed as bound, at first write)
+	for (long long off = 0; off < pool->size; off += PAGE)
+		pool->base[off] = 0;
+	return pool;
+}
+
+/** Frame k of the pool */
+void yuv_pool_frame(const yuv_pool* pool, int k, yuv* frame)
+{
+	*frame = pool->geom;
+	yuv_set_base(frame, pool->base + pool->stride * k, 1);
+}
+
+int yuv_pool_flags(const yuv_pool* pool)
+{
+	return pool->flags;
+}
+
+void yuv_pool_free(yuv_pool* pool)
+{
+	if (!pool)
+		return;
+	pool_unmap(pool);
+	free(pool);
+}
@@ -0,0 +1,62 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Copyright (c) 2022-2023, InterDigital
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted (subject to the limitations in the disclaimer below) provided that
+ * the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of InterDigital nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+ * LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _YUV_POOL_H_
+#define _YUV_POOL_H_
+
+#include "yuv.h"
+
+/** Pool of preallocated frame buffers
+ *
+ * All frames of the pool are carved out of a single mapping, backed by 2 MB
+ * pages where available (reserved huge pages, else transparent huge pages),
+ * bound to a NUMA node (that of the thread processing them), and prefaulted
+ * so that no page fault happens while processing frames. Frames are taken
+ * once and reused for the whole run (e.g. as frame ring slots).
+ */
+
+#define YUV_POOL_HUGE 1 // backed by huge pages (or advised to)
+#define YUV_POOL_NUMA 2 // bound to the requested NUMA node
+
+typedef struct yuv_pool_s yuv_pool;
+
+yuv_pool* yuv_pool_create(int n, int width, int height, int depth, int format, int layout, int node); // node -1: any
+void yuv_pool_frame(const yuv_pool* pool, int k, yuv* frame); // frame k (0..n-1)
+int  yuv_pool_flags(const yuv_pool* pool);
+void yuv_pool_free(yuv_pool* pool);
+int  yuv_pool_cpu_node(int cpu); // NUMA node of a CPU (-1 if unknown)
+
+#endif  // _YUV_POOL_H_
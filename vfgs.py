@@ -0,0 +1,224 @@
+# The copyright in this software is being made available under the BSD
+# License, included below. This software may be subject to other third party
+# and contributor rights, including patent rights, and no such rights are
+# granted under this license.
+#
+# Copyright (c) 2022-2024, InterDigital
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted (subject to the limitations in the disclaimer below) provided that
+# the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+#
+# 3. Neither the name of InterDigital nor the names of its contributors may be
+#    used to endorse or promote products derived from this software
+#    without specific prior written permission.
+#
+# NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY THIS
+# LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+# THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+''' Python binding to libvfgs (ctypes)
+
+Grain is added in-process to frames held as NumPy arrays (one 2-D array per
+component, 8-bit or 16-bit samples), with no copy: the library reads and
+writes the arrays through their own memory and strides.
+
+	from vfgs import Vfgs
+	fg = Vfgs(depth=10, format=420)
+	fg.configure(open('fgs_sei.cfg').read(), seed=1234, gain=100)
+	fg.grain(Y, U, V)                   # in place
+	fg.grain(gY, gU, gV, src=(Y, U, V)) # out of place, (Y, U, V) untouched
+
+The library is looked for in $VFGS_LIB, then on the system library path,
+then in build directories next to this file.
+
+VfgsClient does the same through a preview server (vfgs --serve <socket>),
+which keeps source frames and grain patterns resident across clients; the
+grained frame is read from shared memory.
+'''
+
+import ctypes
+import ctypes.util
+import mmap
+import os
+import socket
+import numpy as np
+
+_FORMATS = { 420: 0, 422: 1, 444: 2 }
+
+_lib = None
+
+def _load():
+	global _lib
+	if _lib:
+		return _lib
+	names = ['vfgs.dll', 'libvfgs.dylib', 'libvfgs.so'] if os.name == 'nt' else ['libvfgs.so', 'libvfgs.dylib']
+	here = os.path.dirname(os.path.abspath(__file__))
+	paths = [os.environ.get('VFGS_LIB'), ctypes.util.find_library('vfgs')]
+	for d in ('build', 'build/Release', '_build', '.'):
+		paths += [os.path.join(here, d, n) for n in names]
+	for p in paths:
+		if p and (os.path.isfile(p) or not os.path.dirname(p)):
+			try:
+				lib = ctypes.CDLL(p)
+				break
+			except OSError:
+				pass
+	else:
+		raise OSError('libvfgs not found (build it with cmake, or set VFGS_LIB)')
+
+	planes = ctypes.c_void_p * 3
+	strides = ctypes.c_int * 3
+	ctx = ctypes.c_void_p
+	lib.vfgs_create.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_int]
+	lib.vfgs_create.restype = ctx
+	lib.vfgs_destroy.argtypes = [ctx]
+	lib.vfgs_destroy.restype = None
+	lib.vfgs_ctx_read_cfg_text.argtypes = [ctx, ctypes.c_char_p]
+	lib.vfgs_ctx_read_cfg.argtypes = [ctx, ctypes.c_char_p]
+	lib.vfgs_ctx_set_seed.argtypes = [ctx, ctypes.c_uint]
+	lib.vfgs_ctx_set_seed.restype = None
+	lib.vfgs_ctx_set_gain.argtypes = [ctx, ctypes.c_uint]
+	lib.vfgs_process_frame_from.argtypes = [ctx, planes, strides, planes, strides, ctypes.c_int, ctypes.c_int]
+	lib.vfgs_process_region.argtypes = [ctx, planes, strides, planes, strides] + [ctypes.c_int] * 6
+	_lib = lib
+	return lib
+
+class Vfgs:
+	''' Grain context for frames of given bit depth (8 or 10) and chroma format
+	(420, 422 or 444); planar layout, 10-bit samples LSB-aligned in uint16 '''
+
+	def __init__(self, depth=10, format=420):
+		self.lib = _load()
+		self.depth = depth
+		self.format = format
+		self.dtype = np.uint8 if depth == 8 else np.uint16
+		self.ctx = self.lib.vfgs_create(depth, _FORMATS.get(format, -1), 0) if format in _FORMATS else None
+		if not self.ctx:
+			raise ValueError(f'unsupported bit depth {depth} or chroma format {format}')
+
+	def close(self):
+		if self.ctx:
+			self.lib.vfgs_destroy(self.ctx)
+			self.ctx = None
+
+	def __del__(self):
+		self.close()
+
+	def configure(self, text=None, filename=None, seed=None, gain=100):
+		''' Configure from text (configuration file syntax) or from a file (as
+		vfgs -c), restarting the random generator (from seed if given) '''
+		if seed is not None:
+			self.lib.vfgs_ctx_set_seed(self.ctx, seed & 0xffffffff)
+		if self.lib.vfgs_ctx_set_gain(self.ctx, gain):
+			raise ValueError('can not set gain')
+		if filename is not None:
+			err = self.lib.vfgs_ctx_read_cfg(self.ctx, os.fsencode(filename))
+		else:
+			err = self.lib.vfgs_ctx_read_cfg_text(self.ctx, text.encode())
+		if err:
+			raise ValueError('invalid film grain configuration')
+
+	def _planes(self, planes, writable):
+		Y, U, V = planes
+		height, width = np.shape(Y)
+		cheight = height // 2 if self.format == 420 else height
+		cwidth = width // 2 if self.format != 444 else width
+		for a, shape in ((Y, (height, width)), (U, (cheight, cwidth)), (V, (cheight, cwidth))):
+			if not isinstance(a, np.ndarray) or a.dtype != self.dtype or a.shape != shape or a.strides[1] != a.itemsize:
+				raise ValueError(f'planes shall be {np.dtype(self.dtype).name} arrays of {width}x{height} and {cwidth}x{cheight} samples, with contiguous rows')
+			if writable and not a.flags.writeable:
+				raise ValueError('output planes shall be writable')
+		p = (ctypes.c_void_p * 3)(*(a.ctypes.data for a in planes))
+		s = (ctypes.c_int * 3)(*(a.strides[0] for a in planes))
+		return p, s, width, height
+
+	def grain(self, Y, U, V, src=None, roi=None):
+		''' Add grain to frame (Y, U, V) in place, or to frame src written to
+		(Y, U, V), and advance random generator to next frame; roi=(x, y, w, h)
+		only outputs the rows of that region, over the 16-sample block columns
+		covering it '''
+		p, s, width, height = self._planes((Y, U, V), True)
+		q, qs, w, h = self._planes(src, False) if src is not None else (p, s, width, height)
+		if (w, h) != (width, height):
+			raise ValueError('source and output frames differ in size')
+		x, y, w, h = roi if roi is not None else (0, 0, width, height)
+		if self.lib.vfgs_process_region(self.ctx, p, s, q, qs, width, height, x, y, w, h):
+			raise ValueError('can not add grain to frame')
+
+class VfgsClient:
+	''' Session on a preview server (vfgs --serve <socket>), for a raw planar
+	YUV source file '''
+
+	def __init__(self, path, filename, width, height, depth=10, format=420):
+		self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+		self.sock.connect(path)
+		self.file = self.sock.makefile('rb')
+		n, name, size = self._request(f'open {width} {height} {depth} {format} {filename}').split()
+		self.frames = int(n)
+		fd = os.open('/dev/shm' + name, os.O_RDONLY)
+		try:
+			self.result = mmap.mmap(fd, int(size), prot=mmap.PROT_READ)
+		finally:
+			os.close(fd)
+		# Grained frame, as views on the shared memory
+		dtype = np.uint8 if depth == 8 else np.uint16
+		cwidth = width if format == 444 else width // 2
+		cheight = height // 2 if format == 420 else height
+		buf = np.frombuffer(self.result, dtype=dtype)
+		ysize, csize = width * height, cwidth * cheight
+		self.planes = (buf[:ysize].reshape(height, width),
+		               buf[ysize:ysize+csize].reshape(cheight, cwidth),
+		               buf[ysize+csize:].reshape(cheight, cwidth))
+
+	def close(self):
+		self.planes = None
+		try:
+			self.result.close()
+		except BufferError:
+			pass # (views still in use: unmapped once released)
+		self.sock.close()
+
+	def _request(self, line, data=b''):
+		self.sock.sendall(line.encode() + b'\n' + data)
+		answer = self.file.readline().decode().strip()
+		if not answer.startswith('ok'):
+			raise ValueError(answer[6:] if answer.startswith('error') else 'connection closed')
+		return answer[3:]
+
+	def configure(self, text, seed=None, gain=100):
+		data = text.encode()
+		self._request(f'cfg {len(data)}', data)
+		if seed is not None:
+			self._request(f'seed {seed & 0xffffffff}')
+		self._request(f'gain {gain}')
+
+	def interval(self, c, k, lower, upper, values):
+		''' FGC SEI delta: set intensity interval k of component c '''
+		self._request(f'interval {c} {k} {lower} {upper} ' + ' '.join(str(v) for v in values))
+
+	def gain(self, gain):
+		self._request(f'gain {gain}')
+
+	def grain(self, frame):
+		''' Grained source frame, as (Y, U, V) views on the shared memory (valid
+		until next call) '''
+		self._request(f'frame {frame}')
+		self._request('grain')
+		return self.planes